@@ -0,0 +1,142 @@
+// Build, refit and query costs of the scene BVH against a linear scan, at 10k to 1M instances.
+// Instances are unit-ish boxes scattered at a constant density, so the query cost per hit stays
+// comparable between sizes. Built with -DBUILD_BENCHMARKS=ON, runs headless.
+#include <culling/bvh.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static const unsigned int FRUSTUM_QUERIES = 100;
+static const unsigned int RAY_QUERIES = 10000;
+static const unsigned int SPHERE_QUERIES = 10000;
+
+static float elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Bounds box(const glm::vec3 &center, float halfSize)
+{
+    Bounds bounds;
+    bounds.add(center - glm::vec3(halfSize));
+    bounds.add(center + glm::vec3(halfSize));
+    return bounds;
+}
+
+// same conservative plane test as BVH::frustum, one box at a time
+static bool inFrustum(const glm::vec4 planes[6], const Bounds &bounds)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec3 normal(planes[i]);
+        glm::vec3 farthest = glm::mix(bounds.min, bounds.max, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+        if (glm::dot(normal, farthest) + planes[i].w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+static void run(unsigned int count)
+{
+    std::mt19937 random(count);
+    float extent = 2.0f * std::cbrt((float)count); // about one instance per 8 cubic units
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<glm::vec3> centers(count);
+    std::vector<Bounds> boxes(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        centers[i] = glm::vec3(position(random), position(random), position(random));
+        boxes[i] = box(centers[i], 0.5f);
+    }
+
+    BVH bvh;
+    bvh.build(boxes);
+    std::printf("%8u instances: build %8.2f ms, %u nodes, depth %u, cost %.1f\n", count, bvh.stats.buildMs,
+                bvh.stats.nodes, bvh.stats.depth, bvh.stats.builtCost);
+
+    // a tenth of the instances drift a little every frame, for a few frames
+    float refitMs = 0.0f;
+    unsigned int rotations = 0, frames = 10;
+    for (unsigned int frame = 0; frame < frames; frame++)
+    {
+        for (unsigned int i = frame % 10; i < count; i += 10)
+        {
+            centers[i] += glm::vec3(unit(random), unit(random), unit(random)) * 0.5f;
+            boxes[i] = box(centers[i], 0.5f);
+            bvh.setBounds(i, boxes[i]);
+        }
+        bvh.refit();
+        refitMs += bvh.stats.refitMs;
+        rotations += bvh.stats.rotations;
+    }
+    std::printf("          refit 10%%: %8.2f ms/frame, %u rotations, cost %.1f (rebuilt %.1f)\n", refitMs / frames,
+                rotations, bvh.cost(), [&] { BVH fresh; fresh.build(boxes); return fresh.stats.builtCost; }());
+
+    std::vector<unsigned int> found;
+    size_t bvhHits = 0, scanHits = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<glm::mat4> views;
+    for (unsigned int q = 0; q < FRUSTUM_QUERIES; q++)
+    {
+        glm::vec3 eye(position(random), position(random), position(random));
+        glm::vec3 target = eye + glm::vec3(unit(random), unit(random), unit(random));
+        views.push_back(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) * glm::lookAt(eye, target, glm::vec3(0, 1, 0)));
+    }
+    start = std::chrono::steady_clock::now();
+    for (const glm::mat4 &viewProjection : views)
+    {
+        found.clear();
+        bvh.frustum(viewProjection, found);
+        bvhHits += found.size();
+    }
+    float frustumMs = elapsedMs(start) / FRUSTUM_QUERIES;
+    start = std::chrono::steady_clock::now();
+    for (const glm::mat4 &viewProjection : views)
+    {
+        glm::vec4 planes[6];
+        for (int i = 0; i < 3; i++)
+        {
+            glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+            planes[i * 2] = w + row;
+            planes[i * 2 + 1] = w - row;
+        }
+        for (const Bounds &bounds : boxes)
+            scanHits += inFrustum(planes, bounds);
+    }
+    float scanMs = elapsedMs(start) / FRUSTUM_QUERIES;
+    std::printf("          frustum: %8.3f ms (scan %8.3f ms), %zu hits%s\n", frustumMs, scanMs, bvhHits / FRUSTUM_QUERIES,
+                bvhHits == scanHits ? "" : " MISMATCH");
+
+    start = std::chrono::steady_clock::now();
+    unsigned int rayHits = 0;
+    for (unsigned int q = 0; q < RAY_QUERIES; q++)
+    {
+        glm::vec3 origin(position(random), position(random), position(random));
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(1e-3f));
+        float distance;
+        rayHits += bvh.raycast(origin, direction, 1e30f, distance) >= 0;
+    }
+    std::printf("          ray:     %8.3f us, %u of %u hit\n", elapsedMs(start) * 1000.0f / RAY_QUERIES, rayHits, RAY_QUERIES);
+
+    start = std::chrono::steady_clock::now();
+    size_t sphereHits = 0;
+    for (unsigned int q = 0; q < SPHERE_QUERIES; q++)
+    {
+        found.clear();
+        bvh.overlap(glm::vec3(position(random), position(random), position(random)), 5.0f, found);
+        sphereHits += found.size();
+    }
+    std::printf("          sphere:  %8.3f us, %zu hits\n", elapsedMs(start) * 1000.0f / SPHERE_QUERIES, sphereHits / SPHERE_QUERIES);
+}
+
+int main()
+{
+    for (unsigned int count : {10000u, 100000u, 1000000u})
+        run(count);
+    return 0;
+}
@@ -36,6 +36,17 @@ void Camera::MoveCameraForward(float yoffset)
     Camera::Position += Front * (yoffset * 0.2f);
 }
 
+// unprojects the point on the near and the far plane under the cursor, the ray runs between them
+void Camera::ScreenRay(float x, float y, float width, float height, const glm::mat4 &projection, glm::vec3 &origin, glm::vec3 &direction)
+{
+    glm::mat4 inverse = glm::inverse(projection * GetViewMatrix());
+    glm::vec2 ndc(2.0f * x / width - 1.0f, 1.0f - 2.0f * y / height);
+    glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
+
 // calculates the front vector from the Camera's (updated) Euler Angles
 void Camera::updateCameraVectors()
 {
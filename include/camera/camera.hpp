@@ -53,6 +53,8 @@ class Camera
         void PanCamera(float X, float Y, float deltaTime);
         void RotateCamera(float xoffset, float yoffset, GLboolean constrainPitch = true);
         void MoveCameraForward(float yoffset);
+        // world space ray through a window position (pixels, top left origin) for the given projection
+        void ScreenRay(float x, float y, float width, float height, const glm::mat4 &projection, glm::vec3 &origin, glm::vec3 &direction);
 
     private:
         void updateCameraVectors();
@@ -0,0 +1,85 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <glm/glm.hpp>
+#include <helpers/bounds.hpp>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Counters of the last build() and refit()
+struct BVHStats {
+    unsigned int items = 0;
+    unsigned int nodes = 0;
+    unsigned int depth = 0;
+    unsigned int refitted = 0;  // leaves moved by the last refit()
+    unsigned int rotations = 0; // by the last refit()
+    float buildMs = 0.0f;
+    float refitMs = 0.0f;
+    float builtCost = 0.0f;     // cost() right after the last build
+};
+
+// Dynamic bounding volume hierarchy over boxes, one item per leaf. build() splits top-down with
+// a binned surface area heuristic. Moving items does not rebuild: setBounds() only updates the
+// leaf, refit() then grows/shrinks its ancestors and tries a tree rotation at each of them (swap
+// a child with a grandchild when that shrinks the surface area), which keeps most of the build
+// quality for items that drift. cost() tells how far it has degraded, rebuild when it is well
+// above stats.builtCost. No GL calls, so it runs headless (see benchmarks/bvhBenchmark.cpp).
+// Queries keep their traversal stacks between calls, so one tree is not queried from two threads at once.
+class BVH {
+public:
+    void build(const std::vector<Bounds> &items);
+    void setBounds(unsigned int item, const Bounds &bounds);
+    const Bounds &bounds(unsigned int item) const { return nodes[leafOf[item]].bounds; }
+    void refit();
+    // SAH cost of the tree: surface area of every internal node relative to the root's
+    float cost() const;
+
+    // Items whose box touches the frustum of viewProjection, appended to visible
+    void frustum(const glm::mat4 &viewProjection, std::vector<unsigned int> &visible) const;
+    // Items whose box overlaps the box or the sphere, appended to found
+    void overlap(const Bounds &box, std::vector<unsigned int> &found) const;
+    void overlap(const glm::vec3 &center, float radius, std::vector<unsigned int> &found) const;
+    // Nearest item along the ray within maxDistance, -1 for none. Boxes are visited front to back;
+    // hit (when given) refines a box hit into an exact one, it gets the box entry distance and
+    // replaces it with the real hit or returns false for a miss. Without it the box distance counts.
+    int raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance,
+                const std::function<bool(unsigned int item, float &distance)> &hit = nullptr) const;
+
+    unsigned int size() const { return (unsigned int)leafOf.size(); }
+    BVHStats stats;
+
+private:
+    struct Node {
+        Bounds bounds;
+        int parent = -1;
+        int children[2] = {-1, -1};
+        int item = -1; // leaves only
+    };
+
+    // items are partitioned in place while building, so each split scans contiguous memory
+    struct BuildItem {
+        Bounds bounds;
+        glm::vec3 centroid;
+        unsigned int item;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> leafOf; // node of each item
+    std::vector<int> dirty;  // leaves changed since the last refit()
+    std::vector<unsigned int> stamps; // per node, == refitStamp when it has a dirty leaf below
+    unsigned int refitStamp = 0;
+    int root = -1;
+    // traversal stacks of the queries, kept so they stop allocating once grown
+    mutable std::vector<int> stack;
+    mutable std::vector<int> collectStack; // collect() runs in the middle of frustum()
+    mutable std::vector<std::pair<int, int>> frustumStack;
+    mutable std::vector<std::pair<int, float>> rayStack;
+
+    int buildRange(std::vector<BuildItem> &work, unsigned int begin, unsigned int end, int parent, unsigned int depth);
+    void refitNode(int node);
+    void rotate(int node);
+    void collect(int node, std::vector<unsigned int> &items) const;
+};
+
+#endif // BVH_HPP
@@ -0,0 +1,113 @@
+#include <culling/gpuCuller.hpp>
+#include <helpers/glExtensions.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <helpers/glState.hpp>
+#include <algorithm>
+
+static const unsigned int GROUP_SIZE = 64; // local_size_x in instanceCull_compute.glsl
+
+GPUCuller::GPUCuller()
+{
+    program = new Shader("resources/shaders/instanceCull_compute.glsl", ShaderDefines());
+
+    glGenTextures(1, &hiZTexture);
+    GLState::bindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZTexture);
+    int levels = 0;
+    for (int width = OcclusionCuller::WIDTH, height = OcclusionCuller::HEIGHT; ; levels++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+        if (width == 1 && height == 1)
+            break;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenBuffers(1, &inputBuffer);
+    glGenBuffers(1, &resultBuffer);
+}
+
+GPUCuller::~GPUCuller()
+{
+    delete program;
+    GLState::deleteTextures(1, &hiZTexture);
+    GLState::deleteBuffers(1, &inputBuffer);
+    GLState::deleteBuffers(1, &resultBuffer);
+}
+
+void GPUCuller::begin(const OcclusionCuller &occlusion)
+{
+    this->occlusion = &occlusion;
+    stats = GPUCullStats();
+
+    GLState::bindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZTexture);
+    for (size_t level = 0; level < occlusion.levelCount(); level++)
+    {
+        glm::ivec2 size = occlusion.levelSize(level);
+        glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, size.x, size.y, GL_RED, GL_FLOAT, occlusion.level(level).data());
+    }
+
+    program->use();
+    program->setMat4("viewProjection", occlusion.matrix());
+    program->setInt("hiZ", HIZ_UNIT);
+    program->setInt("hiZLevels", (int)occlusion.levelCount());
+}
+
+void GPUCuller::cull(const std::vector<glm::mat4> &matrices, const Bounds &localBounds, GLuint instanceBuffer,
+                     GLuint commandBuffer, unsigned int commandCount)
+{
+    if (matrices.empty() || occlusion == nullptr)
+        return;
+
+    // inputs are rewritten whole every call, orphaning keeps the driver from waiting on the last dispatch
+    size_t bytes = matrices.size() * sizeof(glm::mat4);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, inputBuffer);
+    if (bytes > inputCapacity)
+        inputCapacity = bytes;
+    glBufferData(GL_SHADER_STORAGE_BUFFER, inputCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, matrices.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, matrices.size() * sizeof(GLuint), nullptr, GL_STREAM_READ);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, inputBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, resultBuffer);
+
+    GLState::bindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZTexture);
+    program->use();
+    program->setVec3("boundsMin", localBounds.min);
+    program->setVec3("boundsMax", localBounds.max);
+    program->setUint("instanceCount", (unsigned int)matrices.size());
+    program->setUint("commandCount", commandCount);
+    glextDispatchCompute((GLuint)((matrices.size() + GROUP_SIZE - 1) / GROUP_SIZE), 1, 1);
+    glextMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    stats.dispatches++;
+    stats.instances += (unsigned int)matrices.size();
+    if (!validate)
+        return;
+
+    // stalls on the dispatch, only for checking the shader against the CPU test
+    FrameVector<GLuint> results(matrices.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, results.size() * sizeof(GLuint), results.data());
+    for (size_t i = 0; i < matrices.size(); i++)
+    {
+        Bounds bounds;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 local((corner & 1) ? localBounds.max.x : localBounds.min.x,
+                            (corner & 2) ? localBounds.max.y : localBounds.min.y,
+                            (corner & 4) ? localBounds.max.z : localBounds.min.z);
+            bounds.add(glm::vec3(matrices[i] * glm::vec4(local, 1.0f)));
+        }
+        OcclusionCuller::Result expected = occlusion->classify(bounds);
+        if (results[i] != (GLuint)expected)
+            stats.mismatches++;
+        if (results[i] == OcclusionCuller::Visible)
+            stats.visible++;
+    }
+}
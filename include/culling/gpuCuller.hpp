@@ -0,0 +1,51 @@
+#ifndef GPU_CULLER_HPP
+#define GPU_CULLER_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <culling/occlusionCuller.hpp>
+#include <shaders/shader.hpp>
+#include <vector>
+
+// texture unit of the uploaded Hi-Z pyramid (the light list data is on 23)
+#define HIZ_UNIT 24
+
+// Counters of the current frame; visible and mismatches are only known with validate on
+struct GPUCullStats {
+    unsigned int dispatches = 0;
+    unsigned int instances = 0;
+    unsigned int visible = 0;
+    unsigned int mismatches = 0; // instances where the compute result differs from OcclusionCuller::classify
+};
+
+// GL 4.3 instance culling. The instance matrices go to an SSBO, and instanceCull_compute.glsl runs
+// the same frustum and Hi-Z test as OcclusionCuller::classify against the CPU rasterized pyramid
+// (uploaded as a mipmapped R32F texture). Surviving matrices are compacted into the model's
+// instance buffer and counted into the MeshBatch indirect commands, so the draw needs no readback.
+// With validate on, the per-instance results are read back and compared with the CPU test.
+class GPUCuller {
+public:
+    GPUCuller();
+    ~GPUCuller();
+
+    // Uploads the pyramid and view-projection of an already rasterized OcclusionCuller
+    void begin(const OcclusionCuller &occlusion);
+    // Culls one model: matrices are its instances, localBounds their shared model space box.
+    // Writes the visible matrices to instanceBuffer and counts them into commandCount commands
+    // of commandBuffer (zeroed beforehand, see MeshBatch::resetCommands)
+    void cull(const std::vector<glm::mat4> &matrices, const Bounds &localBounds, GLuint instanceBuffer,
+              GLuint commandBuffer, unsigned int commandCount);
+
+    bool validate = false;
+    GPUCullStats stats;
+
+private:
+    Shader *program;
+    GLuint hiZTexture = 0;
+    GLuint inputBuffer = 0;
+    GLuint resultBuffer = 0;
+    size_t inputCapacity = 0;
+    const OcclusionCuller *occlusion = nullptr;
+};
+
+#endif // GPU_CULLER_HPP
@@ -0,0 +1,373 @@
+#include <culling/occlusionCuller.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// rows per raster job
+static const unsigned int RASTER_BAND = 8;
+
+OccluderMesh OccluderMesh::simplify(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+                                    const Bounds &bounds, unsigned int maxTriangles)
+{
+    OccluderMesh result;
+    glm::vec3 extent = bounds.max - bounds.min;
+    float longest = std::max(extent.x, std::max(extent.y, extent.z));
+    if (bounds.empty() || longest <= 0.0f || indices.size() < 3)
+        return result;
+
+    for (int cells = 64; cells >= 2; cells /= 2)
+    {
+        float cellSize = longest / cells;
+        std::unordered_map<uint64_t, unsigned int> cellIndex;
+        std::vector<glm::vec3> sums;
+        std::vector<unsigned int> counts;
+        std::vector<unsigned int> remap(positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            glm::ivec3 cell = glm::clamp(glm::ivec3((positions[i] - bounds.min) / cellSize), glm::ivec3(0), glm::ivec3(cells - 1));
+            uint64_t key = (uint64_t)cell.x | ((uint64_t)cell.y << 20) | ((uint64_t)cell.z << 40);
+            auto found = cellIndex.find(key);
+            if (found == cellIndex.end())
+            {
+                found = cellIndex.emplace(key, (unsigned int)sums.size()).first;
+                sums.push_back(glm::vec3(0.0f));
+                counts.push_back(0);
+            }
+            remap[i] = found->second;
+            sums[found->second] += positions[i];
+            counts[found->second]++;
+        }
+
+        // collapsed and duplicate triangles go; duplicates are found by their sorted corners, the kept
+        // triangle has its original winding, which tells the normals below where inside is
+        typedef std::array<unsigned int, 3> Triangle;
+        std::vector<std::pair<Triangle, Triangle>> kept; // sorted corners, triangle
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            Triangle triangle = {remap[indices[i]], remap[indices[i + 1]], remap[indices[i + 2]]};
+            if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+                continue;
+            Triangle corners = triangle;
+            std::sort(corners.begin(), corners.end());
+            kept.emplace_back(corners, triangle);
+        }
+        std::sort(kept.begin(), kept.end());
+        kept.erase(std::unique(kept.begin(), kept.end(), [](const std::pair<Triangle, Triangle> &a, const std::pair<Triangle, Triangle> &b) {
+                       return a.first == b.first;
+                   }),
+                   kept.end());
+        if (kept.size() > maxTriangles && cells > 2)
+            continue;
+
+        // the average is off the surface by up to the farthest vertex it replaced
+        result.positions.resize(sums.size());
+        for (size_t i = 0; i < sums.size(); i++)
+            result.positions[i] = sums[i] / (float)counts[i];
+        std::vector<float> spread(sums.size(), 0.0f);
+        for (size_t i = 0; i < positions.size(); i++)
+            spread[remap[i]] = std::max(spread[remap[i]], glm::length(positions[i] - result.positions[remap[i]]));
+        std::vector<glm::vec3> normals(sums.size(), glm::vec3(0.0f));
+        float volume = 0.0f; // signed, negative for a mesh wound inside out
+        for (const std::pair<Triangle, Triangle> &entry : kept)
+        {
+            const Triangle &triangle = entry.second;
+            const glm::vec3 &a = result.positions[triangle[0]], &b = result.positions[triangle[1]], &c = result.positions[triangle[2]];
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            for (unsigned int corner : triangle)
+                normals[corner] += normal; // area weighted
+            volume += glm::dot(a, glm::cross(b, c));
+            result.indices.insert(result.indices.end(), triangle.begin(), triangle.end());
+        }
+        float outward = volume < 0.0f ? -1.0f : 1.0f;
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        for (size_t i = 0; i < result.positions.size(); i++)
+        {
+            if (spread[i] == 0.0f)
+                continue;
+            // towards the middle of the mesh instead when the normal is missing (both sides of a thin wall
+            // cancel out) or, on a coarse grid, so skewed that the step would end farther out
+            glm::vec3 &position = result.positions[i];
+            float fromCenter = glm::length(center - position);
+            glm::vec3 moved = position;
+            if (glm::length(normals[i]) > 0.0f)
+                moved -= glm::normalize(outward * normals[i]) * spread[i];
+            if (moved == position || glm::length(center - moved) > fromCenter)
+                moved = fromCenter > 0.0f ? position + (center - position) * (std::min(spread[i], fromCenter) / fromCenter) : position;
+            position = moved;
+        }
+        break;
+    }
+    return result;
+}
+
+OcclusionCuller::OcclusionCuller(JobSystem &jobs) : jobs(jobs)
+{
+    glm::ivec2 size(WIDTH, HEIGHT);
+    while (true)
+    {
+        levelSizes.push_back(size);
+        levels.push_back(std::vector<float>(size.x * size.y, 1.0f));
+        if (size.x == 1 && size.y == 1)
+            break;
+        size = glm::max(size / 2, glm::ivec2(1));
+    }
+}
+
+void OcclusionCuller::begin(const glm::mat4 &viewProjection)
+{
+    frameStart = std::chrono::steady_clock::now();
+    this->viewProjection = viewProjection;
+    triangles.clear();
+    stats = OcclusionStats();
+    std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+}
+
+void OcclusionCuller::addOccluder(const OccluderMesh &mesh, const glm::mat4 &model)
+{
+    if (mesh.indices.empty())
+        return;
+    glm::mat4 transform = viewProjection * model;
+    FrameVector<glm::vec4> clip(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+        clip[i] = transform * glm::vec4(mesh.positions[i], 1.0f);
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        glm::vec4 triangle[3] = {clip[mesh.indices[i]], clip[mesh.indices[i + 1]], clip[mesh.indices[i + 2]]};
+        // all three outside one side plane, or beyond the far plane
+        bool outside = false;
+        for (int axis = 0; axis < 3 && !outside; axis++)
+        {
+            outside = (triangle[0][axis] > triangle[0].w && triangle[1][axis] > triangle[1].w && triangle[2][axis] > triangle[2].w) ||
+                      (axis < 2 && triangle[0][axis] < -triangle[0].w && triangle[1][axis] < -triangle[1].w && triangle[2][axis] < -triangle[2].w);
+        }
+        if (!outside)
+            clipAndAdd(triangle);
+    }
+    stats.occluders++;
+}
+
+void OcclusionCuller::clipAndAdd(const glm::vec4 clip[3])
+{
+    // Sutherland-Hodgman against the near plane (z = -w), which gives at most a quad
+    glm::vec4 polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec4 &a = clip[i];
+        const glm::vec4 &b = clip[(i + 1) % 3];
+        float da = a.z + a.w, db = b.z + b.w;
+        if (da >= 0.0f)
+            polygon[count++] = a;
+        if ((da >= 0.0f) != (db >= 0.0f))
+            polygon[count++] = a + (b - a) * (da / (da - db));
+    }
+    if (count < 3)
+        return;
+
+    glm::vec3 screen[4];
+    for (int i = 0; i < count; i++)
+    {
+        float w = std::max(polygon[i].w, 1e-6f);
+        glm::vec3 ndc = glm::vec3(polygon[i]) / w;
+        screen[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z * 0.5f + 0.5f);
+    }
+    for (int i = 1; i + 1 < count; i++)
+    {
+        triangles.push_back(ScreenTriangle{{screen[0], screen[i], screen[i + 1]}});
+        stats.triangles++;
+    }
+}
+
+void OcclusionCuller::rasterizeRows(int firstRow, int lastRow)
+{
+    std::vector<float> &buffer = levels[0];
+    for (const ScreenTriangle &triangle : triangles)
+    {
+        glm::vec3 v0 = triangle.v[0], v1 = triangle.v[1], v2 = triangle.v[2];
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::abs(area) < 1e-8f)
+            continue;
+        if (area < 0.0f)
+        {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+        int x0 = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+        int x1 = std::min(WIDTH - 1, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+        int y0 = std::max(firstRow, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+        int y1 = std::min(lastRow, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+        if (x0 > x1 || y0 > y1)
+            continue;
+
+        // edge functions e = a * x + b * y + c, positive inside; edge i is opposite vertex i
+        const glm::vec3 *from[3] = {&v1, &v2, &v0};
+        const glm::vec3 *to[3] = {&v2, &v0, &v1};
+        float a[3], b[3], c[3];
+        for (int i = 0; i < 3; i++)
+        {
+            a[i] = -(to[i]->y - from[i]->y);
+            b[i] = to[i]->x - from[i]->x;
+            c[i] = -(a[i] * from[i]->x + b[i] * from[i]->y);
+        }
+        // depth is linear in screen space: the barycentric blend of the vertex depths
+        float zA = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) / area;
+        float zB = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) / area;
+        float zC = (c[0] * v0.z + c[1] * v1.z + c[2] * v2.z) / area;
+
+        int xStart = x0 & ~3; // WIDTH is a multiple of 4, so 4-wide steps never run past a row
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = y + 0.5f;
+            float *row = &buffer[y * WIDTH];
+#ifdef __SSE2__
+            __m128 px = _mm_add_ps(_mm_set1_ps(xStart + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+            __m128 step = _mm_set1_ps(4.0f);
+            __m128 zero = _mm_setzero_ps();
+            __m128 edgeA[3], edgeRow[3];
+            for (int i = 0; i < 3; i++)
+            {
+                edgeA[i] = _mm_set1_ps(a[i]);
+                edgeRow[i] = _mm_set1_ps(b[i] * py + c[i]);
+            }
+            __m128 depthA = _mm_set1_ps(zA);
+            __m128 depthRow = _mm_set1_ps(zB * py + zC);
+            for (int x = xStart; x <= x1; x += 4)
+            {
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), edgeRow[0]), zero);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], px), edgeRow[1]), zero));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], px), edgeRow[2]), zero));
+                if (_mm_movemask_ps(inside) != 0)
+                {
+                    __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, px), depthRow);
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearest = _mm_min_ps(old, depth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                }
+                px = _mm_add_ps(px, step);
+            }
+#else
+            for (int x = xStart; x <= x1; x++)
+            {
+                float px = x + 0.5f;
+                if (a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f || a[2] * px + b[2] * py + c[2] < 0.0f)
+                    continue;
+                row[x] = std::min(row[x], zA * px + zB * py + zC);
+            }
+#endif
+        }
+    }
+}
+
+void OcclusionCuller::buildPyramid()
+{
+    // every texel keeps the farthest depth below it, so a box behind it is behind everything there
+    for (size_t level = 1; level < levels.size(); level++)
+    {
+        const std::vector<float> &source = levels[level - 1];
+        glm::ivec2 sourceSize = levelSizes[level - 1];
+        glm::ivec2 size = levelSizes[level];
+        for (int y = 0; y < size.y; y++)
+        {
+            int sy0 = std::min(y * 2, sourceSize.y - 1), sy1 = std::min(y * 2 + 1, sourceSize.y - 1);
+            for (int x = 0; x < size.x; x++)
+            {
+                int sx0 = std::min(x * 2, sourceSize.x - 1), sx1 = std::min(x * 2 + 1, sourceSize.x - 1);
+                levels[level][y * size.x + x] = std::max(std::max(source[sy0 * sourceSize.x + sx0], source[sy0 * sourceSize.x + sx1]),
+                                                         std::max(source[sy1 * sourceSize.x + sx0], source[sy1 * sourceSize.x + sx1]));
+            }
+        }
+    }
+}
+
+void OcclusionCuller::rasterize()
+{
+    // bands of rows no two jobs share, small enough for idle workers to steal some
+    jobs.parallelFor(HEIGHT, RASTER_BAND, [this](unsigned int first, unsigned int end) { rasterizeRows((int)first, (int)end - 1); });
+
+    buildPyramid();
+    stats.rasterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+}
+
+bool OcclusionCuller::visible(const Bounds &bounds)
+{
+    return visible(bounds, stats);
+}
+
+bool OcclusionCuller::visible(const Bounds &bounds, OcclusionStats &counts) const
+{
+    if (bounds.empty())
+        return true;
+    counts.tested++;
+    Result result = classify(bounds);
+    if (result == OutsideFrustum)
+        counts.frustumCulled++;
+    else if (result == Occluded)
+        counts.occluded++;
+    return result == Visible;
+}
+
+OcclusionCuller::Result OcclusionCuller::classify(const Bounds &bounds) const
+{
+    if (bounds.empty())
+        return Visible;
+
+    glm::vec4 clip[8];
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point((corner & 1) ? bounds.max.x : bounds.min.x,
+                        (corner & 2) ? bounds.max.y : bounds.min.y,
+                        (corner & 4) ? bounds.max.z : bounds.min.z);
+        clip[corner] = viewProjection * glm::vec4(point, 1.0f);
+    }
+
+    // frustum: every corner outside the same plane, which holds in clip space whatever the sign of w
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bool above = true, below = true;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            above = above && clip[corner][axis] > clip[corner].w;
+            below = below && clip[corner][axis] < -clip[corner].w;
+        }
+        if (above || below)
+            return OutsideFrustum;
+    }
+
+    // a box crossing the eye plane has no sensible screen rectangle
+    glm::vec3 ndcMin(1e30f), ndcMax(-1e30f);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        if (clip[corner].w <= 1e-5f)
+            return Visible;
+        glm::vec3 ndc = glm::vec3(clip[corner]) / clip[corner].w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    float nearest = ndcMin.z * 0.5f + 0.5f;
+
+    int x0 = std::max(0, (int)std::floor((ndcMin.x * 0.5f + 0.5f) * WIDTH));
+    int x1 = std::min(WIDTH - 1, (int)std::floor((ndcMax.x * 0.5f + 0.5f) * WIDTH));
+    int y0 = std::max(0, (int)std::floor((ndcMin.y * 0.5f + 0.5f) * HEIGHT));
+    int y1 = std::min(HEIGHT - 1, (int)std::floor((ndcMax.y * 0.5f + 0.5f) * HEIGHT));
+
+    // coarsest useful level: the rectangle spans at most 2x2 texels
+    size_t level = 0;
+    while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        level++;
+    glm::ivec2 size = levelSizes[level];
+    float farthest = 0.0f;
+    for (int y = std::min(y0 >> level, size.y - 1); y <= std::min(y1 >> level, size.y - 1); y++)
+    {
+        for (int x = std::min(x0 >> level, size.x - 1); x <= std::min(x1 >> level, size.x - 1); x++)
+            farthest = std::max(farthest, levels[level][y * size.x + x]);
+    }
+    return nearest > farthest ? Occluded : Visible;
+}
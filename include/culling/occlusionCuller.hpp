@@ -0,0 +1,87 @@
+#ifndef OCCLUSION_CULLER_HPP
+#define OCCLUSION_CULLER_HPP
+
+#include <glm/glm.hpp>
+#include <helpers/bounds.hpp>
+#include <helpers/jobSystem.hpp>
+#include <chrono>
+#include <vector>
+
+// Low poly stand-in of a mesh for the software rasterizer, in model space
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+
+    unsigned int triangles() const { return (unsigned int)(indices.size() / 3); }
+
+    // Vertex clustering: vertices are merged per cell of a grid over bounds, the grid is coarsened
+    // until at most maxTriangles survive. A merged vertex starts at its cell's average and is moved
+    // inward along its normal by the farthest of its vertices, so an occluder must not stick out
+    // of the mesh and hide what the mesh does not. That holds for closed, outward wound meshes that
+    // are convex at the scale of a cell; in a concave corner smaller than a cell it can still stick
+    // out, by less than the cell's diagonal
+    static OccluderMesh simplify(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+                                 const Bounds &bounds, unsigned int maxTriangles);
+};
+
+// Counters of the last frame
+struct OcclusionStats {
+    unsigned int occluders = 0; // occluder instances rasterized
+    unsigned int triangles = 0; // after near clipping
+    unsigned int tested = 0;
+    unsigned int frustumCulled = 0;
+    unsigned int occluded = 0;
+    float rasterMs = 0.0f; // begin() to the end of rasterize()
+};
+
+// CPU hierarchical-Z occlusion culling. Occluder meshes are rasterized into a small depth buffer
+// (nearest depth wins), in bands of rows run as jobs, with SSE when available.
+// A max-depth pyramid is built on top, and visible() compares the nearest depth of a box against
+// the farthest occluder depth over its screen rectangle, at the level where that rectangle is a
+// couple of texels wide. No GL calls, so it runs headless.
+class OcclusionCuller {
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+
+    enum Result { Visible, OutsideFrustum, Occluded };
+
+    explicit OcclusionCuller(JobSystem &jobs);
+
+    void begin(const glm::mat4 &viewProjection);
+    void addOccluder(const OccluderMesh &mesh, const glm::mat4 &model);
+    // Rasterizes the queued occluders and builds the pyramid
+    void rasterize();
+    // False when the box is outside the frustum or behind the occluders, counted in stats
+    bool visible(const Bounds &bounds);
+    // The same, counted in counts instead, so jobs can test boxes side by side
+    bool visible(const Bounds &bounds, OcclusionStats &counts) const;
+    // The test behind visible(), without touching stats; instanceCull_compute.glsl mirrors it
+    Result classify(const Bounds &bounds) const;
+
+    const glm::mat4 &matrix() const { return viewProjection; }
+    // max-depth pyramid, row 0 at the bottom of the screen, in [0, 1] window depth
+    size_t levelCount() const { return levels.size(); }
+    const std::vector<float> &level(size_t index) const { return levels[index]; }
+    glm::ivec2 levelSize(size_t index) const { return levelSizes[index]; }
+
+    OcclusionStats stats;
+
+private:
+    struct ScreenTriangle {
+        glm::vec3 v[3]; // pixel x, y and window depth
+    };
+
+    JobSystem &jobs;
+    glm::mat4 viewProjection;
+    std::chrono::steady_clock::time_point frameStart; // rasterMs runs from begin()
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<float>> levels; // levels[0] is WIDTH * HEIGHT, each next one halves
+    std::vector<glm::ivec2> levelSizes;
+
+    void clipAndAdd(const glm::vec4 clip[3]);
+    void rasterizeRows(int firstRow, int lastRow);
+    void buildPyramid();
+};
+
+#endif // OCCLUSION_CULLER_HPP
@@ -0,0 +1,88 @@
+#include <culling/sceneBVH.hpp>
+#include <model/model.hpp>
+
+void SceneBVH::rebuild(const std::vector<Model *> &models)
+{
+    this->models = models;
+    items.clear();
+    firstItem.clear();
+    itemCount.clear();
+    std::vector<Bounds> boxes;
+    for (Model *model : models)
+    {
+        firstItem.push_back((unsigned int)items.size());
+        unsigned int count = model->localBounds.empty() ? 0 : (unsigned int)model->modelMatrix.size();
+        itemCount.push_back(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            items.push_back(SceneItem{model, i});
+            boxes.push_back(model->instanceBounds(i));
+        }
+    }
+    bvh.build(boxes);
+    cost = bvh.stats.builtCost;
+    framesSinceCheck = 0;
+    rebuilds++;
+}
+
+void SceneBVH::update(const std::vector<Model *> &models)
+{
+    bool changed = models != this->models;
+    for (unsigned int m = 0; m < models.size(); m++)
+    {
+        models[m]->updateModelMatrices();
+        unsigned int count = models[m]->localBounds.empty() ? 0 : (unsigned int)models[m]->modelMatrix.size();
+        changed = changed || count != itemCount[m];
+    }
+    if (changed)
+    {
+        rebuild(models);
+        return;
+    }
+
+    // transforms are edited in place, so every box is compared against the one in the tree
+    for (unsigned int i = 0; i < items.size(); i++)
+    {
+        Bounds bounds = items[i].model->instanceBounds(items[i].instance);
+        const Bounds &current = bvh.bounds(i);
+        if (bounds.min != current.min || bounds.max != current.max)
+            bvh.setBounds(i, bounds);
+    }
+    bvh.refit();
+    if (++framesSinceCheck >= COST_CHECK_INTERVAL)
+    {
+        framesSinceCheck = 0;
+        cost = bvh.cost();
+        if (cost > bvh.stats.builtCost * REBUILD_COST)
+            rebuild(models);
+    }
+}
+
+void SceneBVH::cullFrustum(const glm::mat4 &viewProjection)
+{
+    visible.clear();
+    bvh.frustum(viewProjection, visible);
+    inFrustum = (unsigned int)visible.size();
+    for (unsigned int m = 0; m < models.size(); m++)
+        models[m]->instanceVisible.assign(models[m]->modelMatrix.size(), itemCount[m] == 0);
+    for (unsigned int i : visible)
+        items[i].model->instanceVisible[items[i].instance] = true;
+}
+
+int SceneBVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const
+{
+    return bvh.raycast(origin, direction, 1e30f, distance, [&](unsigned int item, float &hitDistance) {
+        hitDistance = 1e30f;
+        return items[item].model->raycast(items[item].instance, origin, direction, hitDistance);
+    });
+}
+
+int SceneBVH::item(const Model *model, unsigned int instance) const
+{
+    for (unsigned int m = 0; m < models.size(); m++)
+    {
+        if (models[m] == model)
+            return instance < itemCount[m] ? (int)(firstItem[m] + instance) : -1;
+    }
+    return -1;
+}
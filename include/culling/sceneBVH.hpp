@@ -0,0 +1,52 @@
+#ifndef SCENE_BVH_HPP
+#define SCENE_BVH_HPP
+
+#include <culling/bvh.hpp>
+#include <vector>
+
+class Model;
+
+// One BVH item, an instance of a scene model
+struct SceneItem {
+    Model *model;
+    unsigned int instance;
+};
+
+// BVH over the world bounds of every instance in the scene. Items are numbered model by model, in
+// the order update() got them; models without bounds are left out and count as always visible.
+class SceneBVH {
+public:
+    // Rebuilds when instances were added or removed (or refitting let the tree degrade past
+    // REBUILD_COST times its built cost), otherwise refits the instances whose bounds moved
+    void update(const std::vector<Model *> &models);
+    // Sets instanceVisible of every model: true for the instances touching the frustum
+    void cullFrustum(const glm::mat4 &viewProjection);
+    // Item whose triangles the ray hits first, -1 for none; instance boxes narrow it down first,
+    // then Model::raycast tests the meshes of the ones the ray enters, nearest box first
+    int raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const;
+
+    // item of an instance, -1 when it is not in the tree
+    int item(const Model *model, unsigned int instance) const;
+    const SceneItem &operator[](unsigned int item) const { return items[item]; }
+    const BVH &tree() const { return bvh; }
+
+    unsigned int rebuilds = 0;
+    float cost = 0.0f;          // tree().cost() as of the last rebuild or cost check
+    unsigned int inFrustum = 0; // items found by the last cullFrustum()
+
+private:
+    static constexpr float REBUILD_COST = 1.5f;
+    static const unsigned int COST_CHECK_INTERVAL = 30; // frames between cost() checks, it walks every node
+
+    BVH bvh;
+    std::vector<SceneItem> items;
+    std::vector<Model *> models;
+    std::vector<unsigned int> firstItem; // per model
+    std::vector<unsigned int> itemCount; // per model, 0 for models without bounds
+    std::vector<unsigned int> visible;
+    unsigned int framesSinceCheck = 0;
+
+    void rebuild(const std::vector<Model *> &models);
+};
+
+#endif // SCENE_BVH_HPP
@@ -0,0 +1,61 @@
+#include <helpers/allocationCounter.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> allocationCount(0);
+static std::atomic<size_t> allocatedBytes(0);
+static thread_local bool counting = false;
+
+void AllocationCounter::begin() { counting = true; }
+void AllocationCounter::end() { counting = false; }
+
+size_t AllocationCounter::allocations() { return allocationCount.load(std::memory_order_relaxed); }
+size_t AllocationCounter::bytes() { return allocatedBytes.load(std::memory_order_relaxed); }
+
+#ifdef NDEBUG
+
+const bool AllocationCounter::enabled = false;
+
+#else
+
+const bool AllocationCounter::enabled = true;
+
+// Replacements of the global (not over-aligned) operator new and delete, on top of malloc
+static void *countedAllocate(size_t size)
+{
+    if (counting)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(size_t size)
+{
+    void *memory = countedAllocate(size);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    void *memory = countedAllocate(size);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return countedAllocate(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return countedAllocate(size); }
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, size_t) noexcept { std::free(memory); }
+void operator delete(void *memory, const std::nothrow_t &) noexcept { std::free(memory); }
+void operator delete[](void *memory, const std::nothrow_t &) noexcept { std::free(memory); }
+
+#endif
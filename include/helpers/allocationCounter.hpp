@@ -0,0 +1,24 @@
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <cstddef>
+
+// Counts calls to the global operator new, so a frame can be checked for heap allocations.
+// Only debug builds (no NDEBUG) replace operator new; release builds keep the default one and
+// the counters stay at zero. malloc calls (ImGui, stb_image, the frame allocator) are not seen.
+// Only a thread between begin() and end() is counted, so the saver, the world reader and the job
+// workers do not show up in the frame's count; neither do the jobs of the frame they run.
+class AllocationCounter {
+public:
+    static const bool enabled;
+
+    // counting on the calling thread
+    static void begin();
+    static void end();
+
+    // since the program started, of the counted threads
+    static size_t allocations();
+    static size_t bytes();
+};
+
+#endif // ALLOCATION_COUNTER_HPP
@@ -0,0 +1,15 @@
+#ifndef BOUNDS_HPP
+#define BOUNDS_HPP
+
+#include <glm/glm.hpp>
+
+// Axis aligned box, empty (min > max) until something is added
+struct Bounds{
+    glm::vec3 min = glm::vec3(1e30f);
+    glm::vec3 max = glm::vec3(-1e30f);
+
+    void add(const glm::vec3 &point) { min = glm::min(min, point); max = glm::max(max, point); }
+    bool empty() const { return min.x > max.x; }
+};
+
+#endif // BOUNDS_HPP
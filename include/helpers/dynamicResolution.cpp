@@ -0,0 +1,108 @@
+#include <helpers/dynamicResolution.hpp>
+#include <helpers/glState.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// the scale aims this far under the target, so it does not sit right on the edge
+static const float HEADROOM = 0.9f;
+// scales snap to 1/32 steps, small wobbles in the timings do not reallocate the target
+static const float SCALE_STEP = 1.0f / 32.0f;
+
+DynamicResolution::~DynamicResolution()
+{
+    release();
+}
+
+void DynamicResolution::release()
+{
+    if (fbo == 0)
+        return;
+    GLState::deleteTextures(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteFramebuffers(1, &fbo);
+    fbo = 0;
+}
+
+void DynamicResolution::allocate(unsigned int width, unsigned int height)
+{
+    release();
+    targetWidth = width;
+    targetHeight = height;
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    glGenTextures(1, &color);
+    GLState::bindTexture(0, GL_TEXTURE_2D, color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+
+    // same format as the G-buffer depth, so the deferred path can blit it in
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::DYNAMIC_RESOLUTION::FRAMEBUFFER_INCOMPLETE: " << width << "x" << height << std::endl;
+}
+
+void DynamicResolution::adjust(float frameMs, float gpuMs)
+{
+    smoothedFrameMs = smoothedFrameMs == 0.0f ? frameMs : smoothedFrameMs * 0.8f + frameMs * 0.2f;
+    smoothedGpuMs = smoothedGpuMs == 0.0f ? gpuMs : smoothedGpuMs * 0.8f + gpuMs * 0.2f;
+    if (++frame % ADJUST_INTERVAL != 0)
+        return;
+
+    float measured = smoothedGpuMs > 0.0f ? smoothedGpuMs : smoothedFrameMs;
+    if (measured <= 0.0f)
+        return;
+    // cost goes with the pixel count, i.e. the square of the axis scale
+    float ideal = scale * std::sqrt(targetMs * HEADROOM / measured);
+    float next = scale;
+    if (ideal < scale && smoothedFrameMs > targetMs)
+        next = std::max(ideal, scale - 0.1f);
+    else if (ideal > scale && smoothedFrameMs < targetMs)
+        next = std::min(ideal, scale + 0.05f);
+    next = std::round(next / SCALE_STEP) * SCALE_STEP;
+    scale = std::min(std::max(next, minScale), maxScale);
+}
+
+void DynamicResolution::beginFrame(unsigned int windowWidth, unsigned int windowHeight, float frameMs, float gpuMs)
+{
+    this->windowWidth = windowWidth;
+    this->windowHeight = windowHeight;
+    if (!enabled)
+    {
+        width = windowWidth;
+        height = windowHeight;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        return;
+    }
+
+    adjust(frameMs, gpuMs);
+    width = std::max(1u, (unsigned int)(windowWidth * scale));
+    height = std::max(1u, (unsigned int)(windowHeight * scale));
+    if (fbo == 0 || width != targetWidth || height != targetHeight)
+        allocate(width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DynamicResolution::present()
+{
+    if (!enabled)
+        return;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+}
@@ -0,0 +1,49 @@
+#ifndef DYNAMIC_RESOLUTION_HPP
+#define DYNAMIC_RESOLUTION_HPP
+
+#include <glad/glad.h>
+
+// Renders the 3D scene into an offscreen target whose size follows the frame time. Every few
+// frames the scale is moved towards the one that would fit the GPU time (or the whole frame,
+// without timer queries) into targetMs, assuming cost grows with the pixel count. It only drops
+// when frames actually miss the target, so a CPU bound frame does not shrink the image for nothing.
+// present() upscales the result into the window, UI drawn after it stays at native resolution.
+class DynamicResolution {
+public:
+    DynamicResolution() {}
+    ~DynamicResolution();
+
+    // Picks this frame's scale, (re)allocates the target, binds it, sets the viewport and clears it.
+    // Disabled: renders straight into the default framebuffer at window size
+    void beginFrame(unsigned int windowWidth, unsigned int windowHeight, float frameMs, float gpuMs);
+    // Linear blit of the scene to the window, then the default framebuffer is bound again
+    void present();
+
+    GLuint framebuffer() const { return enabled ? fbo : 0; }
+
+    bool enabled = false;
+    float targetMs = 1000.0f / 60.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float scale = 1.0f;          // of each axis, applied from the next beginFrame
+    unsigned int width = 0;      // render size of the current frame
+    unsigned int height = 0;
+
+private:
+    static const unsigned int ADJUST_INTERVAL = 10; // frames, longer than the timer query latency
+
+    GLuint fbo = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+    unsigned int targetWidth = 0, targetHeight = 0;
+    unsigned int windowWidth = 0, windowHeight = 0;
+    unsigned int frame = 0;
+    float smoothedFrameMs = 0.0f;
+    float smoothedGpuMs = 0.0f;
+
+    void adjust(float frameMs, float gpuMs);
+    void allocate(unsigned int width, unsigned int height);
+    void release();
+};
+
+#endif // DYNAMIC_RESOLUTION_HPP
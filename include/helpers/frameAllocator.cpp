@@ -0,0 +1,71 @@
+#include <helpers/frameAllocator.hpp>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+FrameAllocator FrameAllocator::frame(1024 * 1024);
+
+FrameAllocator::FrameAllocator(size_t capacity)
+{
+    size = capacity;
+    memory = static_cast<unsigned char *>(std::malloc(size));
+    overflow.reserve(16);
+}
+
+FrameAllocator::~FrameAllocator()
+{
+    reset();
+    std::free(memory);
+}
+
+void *FrameAllocator::allocate(size_t bytes, size_t alignment)
+{
+    size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes <= size)
+    {
+        offset = start + bytes;
+        peak = std::max(peak, used());
+        return memory + start;
+    }
+
+    // malloc is aligned for any fundamental type, which covers everything allocated here
+    void *block = std::malloc(std::max<size_t>(bytes, 1));
+    overflow.push_back(block);
+    spilled += bytes;
+    overflows++;
+    peak = std::max(peak, used());
+    return block;
+}
+
+const char *FrameAllocator::format(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    va_list measure;
+    va_copy(measure, args);
+    int length = std::vsnprintf(nullptr, 0, format, measure);
+    va_end(measure);
+    char *text = static_cast<char *>(allocate(length + 1, 1));
+    std::vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    return text;
+}
+
+void FrameAllocator::reset()
+{
+    for (void *block : overflow)
+        std::free(block);
+    overflow.clear();
+    if (peak > size)
+    {
+        // headroom, so a frame slightly bigger than the last one does not spill again
+        size = peak + peak / 2;
+        std::free(memory);
+        memory = static_cast<unsigned char *>(std::malloc(size));
+    }
+    offset = 0;
+    spilled = 0;
+    overflows = 0;
+}
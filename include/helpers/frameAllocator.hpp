@@ -0,0 +1,60 @@
+#ifndef FRAME_ALLOCATOR_HPP
+#define FRAME_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for data that only lives until the end of the frame. allocate() moves an offset,
+// nothing is freed on its own; reset() at the start of every frame drops it all at once. A frame
+// that does not fit spills into heap blocks, and the next reset grows the arena to the peak, so
+// after a few frames transient allocations stop reaching the heap. Main thread only.
+class FrameAllocator {
+public:
+    explicit FrameAllocator(size_t capacity);
+    ~FrameAllocator();
+
+    FrameAllocator(const FrameAllocator &) = delete;
+    FrameAllocator &operator=(const FrameAllocator &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    template <typename T> T *allocate(size_t count) { return static_cast<T *>(allocate(sizeof(T) * count, alignof(T))); }
+    // printf into frame memory, e.g. uniform names built in a loop
+    const char *format(const char *format, ...);
+
+    // Everything handed out since the last reset is invalid afterwards
+    void reset();
+
+    size_t used() const { return offset + spilled; }
+    size_t capacity() const { return size; }
+    size_t peak = 0;            // most bytes used by one frame
+    unsigned int overflows = 0; // heap blocks taken by the last frame
+
+    // The allocator of the frame loop, reset by main
+    static FrameAllocator frame;
+
+private:
+    unsigned char *memory;
+    size_t size;
+    size_t offset = 0;
+    size_t spilled = 0;
+    std::vector<void *> overflow;
+};
+
+// std allocator on FrameAllocator::frame: deallocate does nothing, the memory goes with the frame
+template <typename T> struct FrameStlAllocator {
+    typedef T value_type;
+
+    FrameStlAllocator() = default;
+    template <typename U> FrameStlAllocator(const FrameStlAllocator<U> &) {}
+
+    T *allocate(size_t count) { return FrameAllocator::frame.allocate<T>(count); }
+    void deallocate(T *, size_t) {}
+
+    template <typename U> bool operator==(const FrameStlAllocator<U> &) const { return true; }
+    template <typename U> bool operator!=(const FrameStlAllocator<U> &) const { return false; }
+};
+
+// Scratch vector for one frame, it must not be kept past the frame loop iteration
+template <typename T> using FrameVector = std::vector<T, FrameStlAllocator<T>>;
+
+#endif // FRAME_ALLOCATOR_HPP
@@ -0,0 +1,66 @@
+#include <helpers/glExtensions.hpp>
+#include <cstring>
+
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glextMaxShaderCompilerThreads = nullptr;
+PFNGLGETTEXTUREHANDLEARBPROC glextGetTextureHandle = nullptr;
+PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glextMakeTextureHandleResident = nullptr;
+PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glextMakeTextureHandleNonResident = nullptr;
+PFNGLDISPATCHCOMPUTEPROC glextDispatchCompute = nullptr;
+PFNGLMEMORYBARRIERPROC glextMemoryBarrier = nullptr;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glextMultiDrawElementsIndirect = nullptr;
+
+int GLExtensions::majorVersion = 3;
+int GLExtensions::minorVersion = 3;
+bool GLExtensions::parallelShaderCompile = false;
+bool GLExtensions::shaderStorageBuffer = false;
+bool GLExtensions::bindlessTexture = false;
+bool GLExtensions::computeShader = false;
+
+bool GLExtensions::atLeast(int major, int minor)
+{
+    return majorVersion > major || (majorVersion == major && minorVersion >= minor);
+}
+
+bool GLExtensions::has(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != nullptr && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+void GLExtensions::load(GLADloadproc loader)
+{
+    // drivers usually hand out their newest core version even though we ask for 3.3
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+
+    if (has("GL_KHR_parallel_shader_compile"))
+        glextMaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loader("glMaxShaderCompilerThreadsKHR");
+    else if (has("GL_ARB_parallel_shader_compile"))
+        glextMaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loader("glMaxShaderCompilerThreadsARB");
+    parallelShaderCompile = glextMaxShaderCompilerThreads != nullptr;
+
+    shaderStorageBuffer = atLeast(4, 3);
+
+    if (shaderStorageBuffer)
+    {
+        glextDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)loader("glDispatchCompute");
+        glextMemoryBarrier = (PFNGLMEMORYBARRIERPROC)loader("glMemoryBarrier");
+        glextMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)loader("glMultiDrawElementsIndirect");
+        computeShader = glextDispatchCompute != nullptr && glextMemoryBarrier != nullptr && glextMultiDrawElementsIndirect != nullptr;
+    }
+
+    if (shaderStorageBuffer && has("GL_ARB_bindless_texture"))
+    {
+        glextGetTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC)loader("glGetTextureHandleARB");
+        glextMakeTextureHandleResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)loader("glMakeTextureHandleResidentARB");
+        glextMakeTextureHandleNonResident = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)loader("glMakeTextureHandleNonResidentARB");
+        bindlessTexture = glextGetTextureHandle != nullptr && glextMakeTextureHandleResident != nullptr && glextMakeTextureHandleNonResident != nullptr;
+    }
+}
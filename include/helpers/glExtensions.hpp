@@ -0,0 +1,52 @@
+#ifndef GL_EXTENSIONS_HPP
+#define GL_EXTENSIONS_HPP
+
+#include <glad/glad.h>
+
+// The bundled glad only covers core 3.3, so the few extensions we use are loaded here by hand.
+// Call GLExtensions::load() once, right after gladLoadGLLoader().
+
+// KHR/ARB_parallel_shader_compile (both share the enum values)
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glextMaxShaderCompilerThreads;
+
+// GL 4.3 / ARB_shader_storage_buffer_object
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+
+// GL 4.3 compute shaders and indirect multi-draw
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawCount, GLsizei stride);
+extern PFNGLDISPATCHCOMPUTEPROC glextDispatchCompute;
+extern PFNGLMEMORYBARRIERPROC glextMemoryBarrier;
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glextMultiDrawElementsIndirect;
+
+// ARB_bindless_texture
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+extern PFNGLGETTEXTUREHANDLEARBPROC glextGetTextureHandle;
+extern PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glextMakeTextureHandleResident;
+extern PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glextMakeTextureHandleNonResident;
+
+struct GLExtensions {
+    static int majorVersion;
+    static int minorVersion;
+    static bool parallelShaderCompile;
+    static bool shaderStorageBuffer;
+    static bool bindlessTexture; // only set together with shaderStorageBuffer, the handles live in an SSBO
+    static bool computeShader;   // compute dispatch and glMultiDrawElementsIndirect (GL 4.3)
+
+    static void load(GLADloadproc loader);
+    static bool has(const char *name);
+    static bool atLeast(int major, int minor);
+};
+
+#endif // GL_EXTENSIONS_HPP
@@ -0,0 +1,351 @@
+#include <helpers/glState.hpp>
+#include <iostream>
+
+GLStateStats GLState::frameStats;
+bool GLState::debugValidate = false;
+
+GLuint GLState::program = GLState::UNKNOWN;
+GLuint GLState::vao = GLState::UNKNOWN;
+GLuint GLState::buffers[GLState::BUFFER_SLOTS];
+GLuint GLState::textures[GLState::MAX_TEXTURE_UNITS][GLState::TEXTURE_SLOTS];
+GLuint GLState::samplers[GLState::MAX_TEXTURE_UNITS];
+GLuint GLState::activeUnit = GLState::UNKNOWN;
+int GLState::caps[GLState::CAP_SLOTS];
+GLenum GLState::depthFuncValue = GLState::UNKNOWN;
+int GLState::depthMaskValue = -1;
+
+static const GLenum bufferTargets[] = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_TEXTURE_BUFFER};
+static const GLenum bufferBindings[] = {GL_ARRAY_BUFFER_BINDING, GL_ELEMENT_ARRAY_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING, GL_TEXTURE_BUFFER};
+static const GLenum textureTargets[] = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER, GL_TEXTURE_CUBE_MAP};
+static const GLenum textureBindings[] = {GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_BUFFER, GL_TEXTURE_BINDING_CUBE_MAP};
+static const GLenum capabilities[] = {GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_STENCIL_TEST};
+
+void GLState::useProgram(GLuint id)
+{
+    if (program == id)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    glUseProgram(id);
+    program = id;
+    frameStats.issued++;
+    if (debugValidate)
+    {
+        GLint actual;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &actual);
+        check("program", program, actual);
+    }
+}
+
+void GLState::bindVertexArray(GLuint id)
+{
+    if (vao == id)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    glBindVertexArray(id);
+    vao = id;
+    // the element buffer binding is part of the VAO, so it changes with it
+    buffers[ElementArrayBuffer] = UNKNOWN;
+    frameStats.issued++;
+    if (debugValidate)
+    {
+        GLint actual;
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &actual);
+        check("vertex array", vao, actual);
+    }
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+    int slot = bufferSlot(target);
+    if (slot < 0)
+    {
+        glBindBuffer(target, buffer);
+        frameStats.issued++;
+        return;
+    }
+    if (buffers[slot] == buffer)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    glBindBuffer(target, buffer);
+    buffers[slot] = buffer;
+    frameStats.issued++;
+    if (debugValidate)
+    {
+        GLint actual;
+        glGetIntegerv(bufferBindings[slot], &actual);
+        check("buffer", buffer, actual);
+    }
+}
+
+void GLState::setActiveUnit(unsigned int unit)
+{
+    if (activeUnit == unit)
+        return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    activeUnit = unit;
+    frameStats.issued++;
+}
+
+void GLState::bindTexture(unsigned int unit, GLenum target, GLuint texture)
+{
+    int slot = textureSlot(target);
+    if (unit >= MAX_TEXTURE_UNITS || slot < 0)
+    {
+        setActiveUnit(unit);
+        glBindTexture(target, texture);
+        frameStats.issued++;
+        return;
+    }
+    if (textures[unit][slot] == texture)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    setActiveUnit(unit);
+    glBindTexture(target, texture);
+    textures[unit][slot] = texture;
+    frameStats.issued++;
+    if (debugValidate)
+    {
+        GLint actual;
+        glGetIntegerv(textureBindings[slot], &actual);
+        check("texture", texture, actual);
+    }
+}
+
+void GLState::bindSampler(unsigned int unit, GLuint sampler)
+{
+    if (unit < MAX_TEXTURE_UNITS && samplers[unit] == sampler)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    glBindSampler(unit, sampler);
+    if (unit < MAX_TEXTURE_UNITS)
+        samplers[unit] = sampler;
+    frameStats.issued++;
+}
+
+void GLState::setCap(GLenum cap, bool on)
+{
+    int slot = capSlot(cap);
+    if (slot >= 0 && caps[slot] == (int)on)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    if (on)
+        glEnable(cap);
+    else
+        glDisable(cap);
+    if (slot >= 0)
+        caps[slot] = (int)on;
+    frameStats.issued++;
+    if (debugValidate)
+        check("capability", on, glIsEnabled(cap));
+}
+
+void GLState::enable(GLenum cap)
+{
+    setCap(cap, true);
+}
+
+void GLState::disable(GLenum cap)
+{
+    setCap(cap, false);
+}
+
+void GLState::depthFunc(GLenum func)
+{
+    if (depthFuncValue == func)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    glDepthFunc(func);
+    depthFuncValue = func;
+    frameStats.issued++;
+}
+
+void GLState::depthMask(bool write)
+{
+    if (depthMaskValue == (int)write)
+    {
+        frameStats.skipped++;
+        return;
+    }
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    depthMaskValue = (int)write;
+    frameStats.issued++;
+}
+
+void GLState::deleteBuffers(GLsizei count, const GLuint *ids)
+{
+    glDeleteBuffers(count, ids);
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (int slot = 0; slot < BUFFER_SLOTS; slot++)
+        {
+            if (ids[i] != 0 && buffers[slot] == ids[i])
+                buffers[slot] = 0;
+        }
+    }
+}
+
+void GLState::deleteVertexArrays(GLsizei count, const GLuint *ids)
+{
+    glDeleteVertexArrays(count, ids);
+    for (GLsizei i = 0; i < count; i++)
+    {
+        if (ids[i] != 0 && vao == ids[i])
+        {
+            vao = 0;
+            buffers[ElementArrayBuffer] = UNKNOWN;
+        }
+    }
+}
+
+void GLState::deleteTextures(GLsizei count, const GLuint *ids)
+{
+    glDeleteTextures(count, ids);
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+        {
+            for (int slot = 0; slot < TEXTURE_SLOTS; slot++)
+            {
+                if (ids[i] != 0 && textures[unit][slot] == ids[i])
+                    textures[unit][slot] = 0;
+            }
+        }
+    }
+}
+
+void GLState::invalidate()
+{
+    program = UNKNOWN;
+    vao = UNKNOWN;
+    activeUnit = UNKNOWN;
+    depthFuncValue = UNKNOWN;
+    depthMaskValue = -1;
+    for (int i = 0; i < BUFFER_SLOTS; i++)
+        buffers[i] = UNKNOWN;
+    for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+    {
+        samplers[unit] = UNKNOWN;
+        for (int i = 0; i < TEXTURE_SLOTS; i++)
+            textures[unit][i] = UNKNOWN;
+    }
+    for (int i = 0; i < CAP_SLOTS; i++)
+        caps[i] = -1;
+}
+
+bool GLState::validate()
+{
+    bool ok = true;
+    GLint actual;
+
+    if (program != UNKNOWN)
+    {
+        glGetIntegerv(GL_CURRENT_PROGRAM, &actual);
+        ok = check("program", program, actual) && ok;
+    }
+    if (vao != UNKNOWN)
+    {
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &actual);
+        ok = check("vertex array", vao, actual) && ok;
+    }
+    for (int i = 0; i < BUFFER_SLOTS; i++)
+    {
+        if (buffers[i] == UNKNOWN)
+            continue;
+        glGetIntegerv(bufferBindings[i], &actual);
+        ok = check("buffer", buffers[i], actual) && ok;
+    }
+    for (int i = 0; i < CAP_SLOTS; i++)
+    {
+        if (caps[i] >= 0)
+            ok = check("capability", caps[i], glIsEnabled(capabilities[i])) && ok;
+    }
+    if (depthFuncValue != UNKNOWN)
+    {
+        glGetIntegerv(GL_DEPTH_FUNC, &actual);
+        ok = check("depth func", depthFuncValue, actual) && ok;
+    }
+    if (depthMaskValue >= 0)
+    {
+        GLboolean mask;
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &mask);
+        ok = check("depth mask", depthMaskValue, mask) && ok;
+    }
+
+    // texture queries go through the active unit, so walk the units and put it back afterwards
+    GLint previousUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &previousUnit);
+    if (activeUnit != UNKNOWN)
+        ok = check("active texture", GL_TEXTURE0 + activeUnit, previousUnit) && ok;
+    for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+    {
+        if (samplers[unit] != UNKNOWN)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glGetIntegerv(GL_SAMPLER_BINDING, &actual);
+            ok = check("sampler", samplers[unit], actual) && ok;
+        }
+        for (int i = 0; i < TEXTURE_SLOTS; i++)
+        {
+            if (textures[unit][i] == UNKNOWN)
+                continue;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glGetIntegerv(textureBindings[i], &actual);
+            ok = check("texture", textures[unit][i], actual) && ok;
+        }
+    }
+    glActiveTexture(previousUnit);
+
+    return ok;
+}
+
+bool GLState::check(const char *what, GLint expected, GLint actual)
+{
+    if (expected == actual)
+        return true;
+    std::cout << "ERROR::GLSTATE::CACHE_MISMATCH: " << what << " cached " << expected << " but GL has " << actual << std::endl;
+    return false;
+}
+
+int GLState::bufferSlot(GLenum target)
+{
+    for (int i = 0; i < BUFFER_SLOTS; i++)
+    {
+        if (bufferTargets[i] == target)
+            return i;
+    }
+    return -1;
+}
+
+int GLState::textureSlot(GLenum target)
+{
+    for (int i = 0; i < TEXTURE_SLOTS; i++)
+    {
+        if (textureTargets[i] == target)
+            return i;
+    }
+    return -1;
+}
+
+int GLState::capSlot(GLenum cap)
+{
+    for (int i = 0; i < CAP_SLOTS; i++)
+    {
+        if (capabilities[i] == cap)
+            return i;
+    }
+    return -1;
+}
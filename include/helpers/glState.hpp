@@ -0,0 +1,71 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+#include <glad/glad.h>
+
+// Bind/enable counters, reset by GLState::beginFrame()
+struct GLStateStats {
+    unsigned int issued = 0;  // calls that reached GL
+    unsigned int skipped = 0; // calls dropped because GL already had that state
+};
+
+// Shadow of the GL binding state we touch, so redundant binds never reach the driver.
+// Everything in the renderer has to go through here for the cache to stay right; after code
+// that talks to GL directly (ImGui) call invalidate(). With debugValidate on, every call and
+// the end of each frame compare the cache with glGet queries and print any mismatch.
+class GLState {
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+    static void useProgram(GLuint program);
+    static GLuint currentProgram() { return program; }
+    static void bindVertexArray(GLuint vao);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    static void bindTexture(unsigned int unit, GLenum target, GLuint texture);
+    static void bindSampler(unsigned int unit, GLuint sampler);
+    static void enable(GLenum cap);
+    static void disable(GLenum cap);
+    static void depthFunc(GLenum func);
+    static void depthMask(bool write);
+
+    // glDelete* that also drop the names from the cache: GL unbinds a deleted object and hands its
+    // name out again, after which a bind of the new object would look redundant
+    static void deleteBuffers(GLsizei count, const GLuint *ids);
+    static void deleteVertexArrays(GLsizei count, const GLuint *ids);
+    static void deleteTextures(GLsizei count, const GLuint *ids);
+
+    // Forget everything: the next call of each kind always reaches GL
+    static void invalidate();
+    // Compares the whole cache with GL, returns false (and prints) on mismatch
+    static bool validate();
+
+    static void beginFrame() { frameStats = GLStateStats(); }
+    static GLStateStats frameStats;
+    static bool debugValidate;
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+    enum BufferSlot { ArrayBuffer, ElementArrayBuffer, UniformBuffer, TextureBuffer, BUFFER_SLOTS };
+    enum TextureSlot { Texture2D, Texture2DArray, TextureBufferTarget, TextureCubeMap, TEXTURE_SLOTS };
+    enum CapSlot { DepthTest, CullFace, Blend, ScissorTest, StencilTest, CAP_SLOTS };
+
+    static GLuint program;
+    static GLuint vao;
+    static GLuint buffers[BUFFER_SLOTS];
+    static GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_SLOTS];
+    static GLuint samplers[MAX_TEXTURE_UNITS];
+    static GLuint activeUnit;
+    static int caps[CAP_SLOTS]; // -1 unknown, 0 off, 1 on
+    static GLenum depthFuncValue;
+    static int depthMaskValue;
+
+    static int bufferSlot(GLenum target);
+    static int textureSlot(GLenum target);
+    static int capSlot(GLenum cap);
+    static void setCap(GLenum cap, bool on);
+    static void setActiveUnit(unsigned int unit);
+    static bool check(const char *what, GLint expected, GLint actual);
+};
+
+#endif // GL_STATE_HPP
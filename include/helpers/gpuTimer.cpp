@@ -0,0 +1,75 @@
+#include <helpers/gpuTimer.hpp>
+#include <GLFW/glfw3.h>
+#include <iostream>
+
+std::vector<GPUTimers::Timer *> GPUTimers::timers;
+GPUTimers::Timer *GPUTimers::current = nullptr;
+unsigned int GPUTimers::frameCount = 0;
+
+GPUTimers::Timer *GPUTimers::find(const char *name)
+{
+    for (Timer *timer : timers)
+    {
+        if (timer->name == name)
+            return timer;
+    }
+    Timer *timer = new Timer();
+    timer->name = name;
+    glGenQueries(LATENCY, timer->queries);
+    timers.push_back(timer);
+    return timer;
+}
+
+void GPUTimers::begin(const char *name)
+{
+    if (current != nullptr)
+    {
+        std::cout << "ERROR::GPU_TIMER::NESTED: " << name << " started inside " << current->name << std::endl;
+        return;
+    }
+    Timer *timer = find(name);
+    int slot = timer->frame % LATENCY;
+
+    // collect the query issued LATENCY frames ago before reusing it
+    if (timer->pending[slot])
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(timer->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timer->queries[slot], GL_QUERY_RESULT, &elapsed);
+            timer->gpuMs = timer->gpuMs * 0.9f + (float)(elapsed / 1.0e6) * 0.1f;
+        }
+        // a result that is still not back is dropped rather than waited for
+        timer->pending[slot] = false;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[slot]);
+    timer->cpuStart = glfwGetTime();
+    current = timer;
+}
+
+void GPUTimers::end()
+{
+    if (current == nullptr)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    float cpuMs = (float)((glfwGetTime() - current->cpuStart) * 1000.0);
+    current->cpuMs = current->cpuMs * 0.9f + cpuMs * 0.1f;
+    current->pending[current->frame % LATENCY] = true;
+    current->frame++;
+    current->lastUsed = frameCount;
+    current = nullptr;
+}
+
+FrameVector<const GPUTimers::Timer *> GPUTimers::active()
+{
+    FrameVector<const Timer *> result;
+    for (const Timer *timer : timers)
+    {
+        if (timer->lastUsed + 1 >= frameCount)
+            result.push_back(timer);
+    }
+    return result;
+}
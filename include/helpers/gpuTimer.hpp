@@ -0,0 +1,42 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include <glad/glad.h>
+#include <helpers/frameAllocator.hpp>
+#include <string>
+#include <vector>
+
+// Per-pass GPU and CPU timings. begin()/end() wrap a pass with a GL_TIME_ELAPSED query; results are
+// read back LATENCY frames later so the CPU never waits on the GPU. Timer queries cannot nest, so
+// passes have to be timed one after the other.
+class GPUTimers {
+public:
+    static const int LATENCY = 3;
+
+    struct Timer {
+        std::string name;
+        GLuint queries[LATENCY] = {};
+        bool pending[LATENCY] = {};
+        int frame = 0;
+        double cpuStart = 0.0;
+        float gpuMs = 0.0f; // smoothed over a few frames
+        float cpuMs = 0.0f;
+        unsigned int lastUsed = 0; // GPUTimers frame counter, stale timers are hidden
+    };
+
+    static void begin(const char *name);
+    static void end();
+    static void beginFrame() { frameCount++; }
+
+    // Timers used in the previous frame, in the order they were first created
+    static FrameVector<const Timer *> active();
+
+private:
+    static std::vector<Timer *> timers;
+    static Timer *current;
+    static unsigned int frameCount;
+
+    static Timer *find(const char *name);
+};
+
+#endif // GPU_TIMER_HPP
@@ -0,0 +1,222 @@
+#include <helpers/jobSystem.hpp>
+#include <algorithm>
+
+// failed rounds of stealing before an idle worker goes to sleep
+static const unsigned int SPIN_ROUNDS = 64;
+
+thread_local JobSystem::Worker *JobSystem::current = nullptr;
+
+// The deque follows Lê, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak
+// Memory Models", with the fences folded into sequentially consistent accesses of top and bottom
+bool JobSystem::Worker::push(const Job &job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY)
+        return false;
+    Slot &slot = slots[b & (DEQUE_CAPACITY - 1)];
+    slot.function.store(job.function, std::memory_order_relaxed);
+    slot.data.store(job.data, std::memory_order_relaxed);
+    slot.begin.store(job.begin, std::memory_order_relaxed);
+    slot.end.store(job.end, std::memory_order_relaxed);
+    slot.counter.store(job.counter, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_seq_cst);
+    return true;
+}
+
+bool JobSystem::Worker::pop(Job &job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b)
+    {
+        // empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+    const Slot &slot = slots[b & (DEQUE_CAPACITY - 1)];
+    job = Job{slot.function.load(std::memory_order_relaxed), slot.data.load(std::memory_order_relaxed),
+              slot.begin.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed),
+              slot.counter.load(std::memory_order_relaxed)};
+    if (t < b)
+        return true;
+    // the last job, a thief may be after it too
+    bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return won;
+}
+
+bool JobSystem::Worker::steal(Job &job)
+{
+    int64_t t = top.load(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b)
+        return false;
+    const Slot &slot = slots[t & (DEQUE_CAPACITY - 1)];
+    job = Job{slot.function.load(std::memory_order_relaxed), slot.data.load(std::memory_order_relaxed),
+              slot.begin.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed),
+              slot.counter.load(std::memory_order_relaxed)};
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+JobSystem::JobSystem()
+{
+    unsigned int threads = std::thread::hardware_concurrency();
+    unsigned int count = std::min(8u, std::max(1u, threads > 1 ? threads - 1 : 1u));
+    for (unsigned int i = 0; i < count; i++)
+    {
+        workers.push_back(std::make_unique<Worker>());
+        workers[i]->system = this;
+        workers[i]->index = i;
+        workers[i]->random = 0x9E3779B9u * (i + 1);
+    }
+    stats.resize(count);
+    current = workers[0].get();
+    frameStart = std::chrono::steady_clock::now();
+    // only once every deque exists, the threads steal from all of them
+    for (unsigned int i = 1; i < count; i++)
+        workers[i]->thread = std::thread(&JobSystem::work, this, std::ref(*workers[i]));
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 1; i < workers.size(); i++)
+        workers[i]->thread.join();
+    if (current == workers[0].get())
+        current = nullptr;
+}
+
+JobSystem::Worker *JobSystem::worker() const
+{
+    return current != nullptr && current->system == this ? current : nullptr;
+}
+
+void JobSystem::run(JobCounter &counter, JobFunction function, const void *data, unsigned int begin, unsigned int end)
+{
+    Worker *self = worker();
+    if (self == nullptr)
+    {
+        function(data, begin, end);
+        return;
+    }
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+    if (!self->push(Job{function, data, begin, end, &counter}))
+    {
+        execute(*self, Job{function, data, begin, end, &counter});
+        return;
+    }
+    // seen by a worker that is about to sleep, or it sees the worker sleeping and wakes it
+    queued.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    Worker *self = worker();
+    while (!counter.done())
+    {
+        // the last jobs are running on other workers
+        if (self == nullptr || !runOne(*self))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::parallelFor(unsigned int count, unsigned int grain, JobFunction function, const void *data)
+{
+    grain = std::max(grain, 1u);
+    Worker *self = worker();
+    if (count <= grain || workers.size() == 1 || self == nullptr)
+    {
+        if (count > 0)
+            function(data, 0, count);
+        return;
+    }
+    JobCounter counter;
+    for (unsigned int begin = grain; begin < count; begin += grain)
+        run(counter, function, data, begin, std::min(begin + grain, count));
+    execute(*self, Job{function, data, 0, grain, nullptr});
+    wait(counter);
+}
+
+void JobSystem::endFrame()
+{
+    auto now = std::chrono::steady_clock::now();
+    float frameNanoseconds = std::max(1.0f, (float)std::chrono::duration_cast<std::chrono::nanoseconds>(now - frameStart).count());
+    frameStart = now;
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        Worker &worker = *workers[i];
+        stats[i].utilization = std::min(1.0f, (float)worker.busyNanoseconds.exchange(0, std::memory_order_relaxed) / frameNanoseconds);
+        stats[i].jobs = worker.jobs.exchange(0, std::memory_order_relaxed);
+        stats[i].steals = worker.steals.exchange(0, std::memory_order_relaxed);
+    }
+}
+
+bool JobSystem::runOne(Worker &self)
+{
+    Job job;
+    bool found = self.pop(job);
+    for (size_t tries = 0; !found && tries < workers.size() - 1; tries++)
+    {
+        // xorshift, starting the search at a different victim each time
+        self.random ^= self.random << 13;
+        self.random ^= self.random >> 17;
+        self.random ^= self.random << 5;
+        size_t victim = (self.index + 1 + self.random % (workers.size() - 1)) % workers.size();
+        found = workers[victim]->steal(job);
+        if (found)
+            self.steals.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!found)
+        return false;
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    execute(self, job);
+    return true;
+}
+
+void JobSystem::execute(Worker &self, const Job &job)
+{
+    auto start = std::chrono::steady_clock::now();
+    job.function(job.data, job.begin, job.end);
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    self.busyNanoseconds.fetch_add((uint64_t)nanoseconds, std::memory_order_relaxed);
+    self.jobs.fetch_add(1, std::memory_order_relaxed);
+    if (job.counter != nullptr)
+        job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::work(Worker &self)
+{
+    current = &self;
+    unsigned int idleRounds = 0;
+    while (true)
+    {
+        if (runOne(self))
+        {
+            idleRounds = 0;
+            continue;
+        }
+        if (stopping.load())
+            return;
+        if (++idleRounds < SPIN_ROUNDS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+        wake.wait(lock, [this]() { return stopping.load() || queued.load(std::memory_order_seq_cst) > 0; });
+        sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        idleRounds = 0;
+    }
+}
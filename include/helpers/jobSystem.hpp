@@ -0,0 +1,116 @@
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the range [begin, end) of a job; data is what the job was queued with
+typedef void (*JobFunction)(const void *data, unsigned int begin, unsigned int end);
+
+// Dependency counter: queuing a job against it adds one, the job finishing takes it off again.
+// Whatever needs those jobs done waits on it, and runs other jobs meanwhile
+struct JobCounter {
+    std::atomic<unsigned int> pending{0};
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// One worker over the last frame
+struct JobWorkerStats {
+    float utilization = 0.0f; // share of the frame spent running jobs
+    unsigned int jobs = 0;
+    unsigned int steals = 0;  // jobs taken from another worker's deque
+};
+
+// Work-stealing job system. Each worker, the main thread (worker 0) included, owns a Chase-Lev deque:
+// the owner pushes and pops at the bottom without a lock, idle workers steal the oldest jobs from the
+// top. Jobs are queued from the main thread or from other jobs; any other thread (the saver, the world
+// reader) runs what it queues right away, as does a worker whose deque is full. Jobs must not block on
+// anything but a JobCounter.
+class JobSystem {
+public:
+    // one thread per core besides the main thread, at most 8 workers in all; construct it on the main thread
+    JobSystem();
+    // the deques must be empty by then
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // data has to stay valid until counter is done
+    void run(JobCounter &counter, JobFunction function, const void *data, unsigned int begin = 0, unsigned int end = 1);
+    // returns once counter is done, running queued jobs until then
+    void wait(JobCounter &counter);
+
+    // body(begin, end) over [0, count) in ranges of grain items, the calling thread taking one of them;
+    // returns once all have run
+    template <typename Body> void parallelFor(unsigned int count, unsigned int grain, const Body &body)
+    {
+        JobFunction function = [](const void *data, unsigned int begin, unsigned int end) {
+            (*static_cast<const Body *>(data))(begin, end);
+        };
+        parallelFor(count, grain, function, &body);
+    }
+    void parallelFor(unsigned int count, unsigned int grain, JobFunction function, const void *data);
+
+    unsigned int workerCount() const { return (unsigned int)workers.size(); }
+    // once per frame on the main thread: the busy time and job counts of the frame just ended go to stats
+    void endFrame();
+    std::vector<JobWorkerStats> stats; // per worker, 0 is the main thread
+
+private:
+    static const int64_t DEQUE_CAPACITY = 1024; // a power of two
+
+    // A queued job. A thief reads the slot before it knows whether the steal wins, while the owner may
+    // already reuse it, so the fields are atomics; a lost steal just drops what it read
+    struct Slot {
+        std::atomic<JobFunction> function{nullptr};
+        std::atomic<const void *> data{nullptr};
+        std::atomic<unsigned int> begin{0}, end{0};
+        std::atomic<JobCounter *> counter{nullptr};
+    };
+    struct Job {
+        JobFunction function;
+        const void *data;
+        unsigned int begin, end;
+        JobCounter *counter;
+    };
+    struct Worker {
+        JobSystem *system;
+        unsigned int index;
+        std::atomic<int64_t> top{0}, bottom{0};
+        Slot slots[DEQUE_CAPACITY];
+        uint32_t random; // picks the victims to steal from
+        std::atomic<uint64_t> busyNanoseconds{0};
+        std::atomic<unsigned int> jobs{0}, steals{0};
+        std::thread thread; // not for worker 0
+
+        bool push(const Job &job);
+        bool pop(Job &job);
+        bool steal(Job &job);
+    };
+    static thread_local Worker *current;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::chrono::steady_clock::time_point frameStart;
+
+    // sleeping workers wake up once something is queued
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<int> queued{0}; // pushed and not taken yet
+    std::atomic<unsigned int> sleeping{0};
+    std::atomic<bool> stopping{false};
+
+    Worker *worker() const;
+    // pops a job of self or steals one, then runs it; false when there was none
+    bool runOne(Worker &self);
+    void execute(Worker &self, const Job &job);
+    void work(Worker &self);
+};
+
+#endif // JOB_SYSTEM_HPP
@@ -0,0 +1,139 @@
+#ifndef OPEN_HASH_MAP_HPP
+#define OPEN_HASH_MAP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Flat hash map with linear probing. Keys and values sit in one array, deletion shifts the
+// following entries back instead of leaving tombstones, so probe lengths stay short no matter
+// how many inserts and erases happen. Hash results are scrambled with a Fibonacci multiply, which
+// makes sequential integer keys (std::hash is the identity for them) spread like random ones.
+// Pointers returned by find() are invalidated by the next insert or erase.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class OpenHashMap {
+public:
+    explicit OpenHashMap(size_t capacity = 16) { rehash(capacity); }
+
+    Value *find(const Key &key)
+    {
+        size_t index;
+        return locate(key, index) ? &entries[index].value : nullptr;
+    }
+    const Value *find(const Key &key) const
+    {
+        size_t index;
+        return locate(key, index) ? &entries[index].value : nullptr;
+    }
+
+    // False (and nothing changes) when the key is already there
+    bool insert(const Key &key, const Value &value)
+    {
+        if ((count + 1) * 4 > entries.size() * 3)
+            rehash(entries.size() * 2);
+        size_t index = home(key);
+        while (used[index])
+        {
+            if (entries[index].key == key)
+                return false;
+            index = (index + 1) & mask;
+        }
+        entries[index] = Entry{key, value};
+        used[index] = 1;
+        count++;
+        return true;
+    }
+
+    bool erase(const Key &key)
+    {
+        size_t hole;
+        if (!locate(key, hole))
+            return false;
+        used[hole] = 0;
+        count--;
+        // pull back every following entry whose home is not between the hole and itself
+        for (size_t next = (hole + 1) & mask; used[next]; next = (next + 1) & mask)
+        {
+            size_t wanted = home(entries[next].key);
+            bool reachable = hole <= next ? (wanted > hole && wanted <= next) : (wanted > hole || wanted <= next);
+            if (reachable)
+                continue;
+            entries[hole] = std::move(entries[next]);
+            used[hole] = 1;
+            used[next] = 0;
+            hole = next;
+        }
+        return true;
+    }
+
+    // Grows the table so count entries fit without a rehash
+    void reserve(size_t entryCount)
+    {
+        size_t capacity = entries.size();
+        while (entryCount * 4 > capacity * 3)
+            capacity *= 2;
+        if (capacity != entries.size())
+            rehash(capacity);
+    }
+
+    void clear()
+    {
+        std::fill(used.begin(), used.end(), 0);
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+
+private:
+    struct Entry {
+        Key key;
+        Value value;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint8_t> used;
+    size_t count = 0;
+    size_t mask = 0;
+    int shift = 0;
+
+    size_t home(const Key &key) const
+    {
+        return (size_t)(((uint64_t)Hash()(key) * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    bool locate(const Key &key, size_t &index) const
+    {
+        for (index = home(key); used[index]; index = (index + 1) & mask)
+        {
+            if (entries[index].key == key)
+                return true;
+        }
+        return false;
+    }
+
+    void rehash(size_t capacity)
+    {
+        size_t size = 16;
+        while (size < capacity)
+            size *= 2;
+        std::vector<Entry> oldEntries(size);
+        std::vector<uint8_t> oldUsed(size, 0);
+        oldEntries.swap(entries);
+        oldUsed.swap(used);
+        mask = size - 1;
+        shift = 64;
+        for (size_t bits = size; bits > 1; bits >>= 1)
+            shift--;
+        count = 0;
+        for (size_t i = 0; i < oldEntries.size(); i++)
+        {
+            if (oldUsed[i])
+                insert(oldEntries[i].key, oldEntries[i].value);
+        }
+    }
+};
+
+#endif // OPEN_HASH_MAP_HPP
@@ -0,0 +1,80 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed size object pool. Objects live in blocks of BLOCK slots that are never given back, freed
+// slots are chained through their own storage and handed out again first, so once the pool has
+// grown to the working set, allocate and release never touch the heap. Pointers stay valid until
+// the object is released or the pool cleared. clear() forgets every object at once without
+// visiting them, which is why T has to be trivially destructible.
+template <typename T, size_t BLOCK = 256>
+class Pool {
+    static_assert(std::is_trivially_destructible<T>::value, "Pool::clear does not run destructors");
+
+public:
+    Pool() = default;
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    template <typename... Args> T *allocate(Args &&...args)
+    {
+        void *memory;
+        if (freeList != nullptr)
+        {
+            memory = freeList;
+            freeList = freeList->next;
+        }
+        else
+        {
+            if (used == BLOCK * blocks.size())
+                blocks.emplace_back(new Slot[BLOCK]);
+            memory = &blocks[used / BLOCK][used % BLOCK];
+            used++;
+        }
+        live++;
+        return new (memory) T{std::forward<Args>(args)...};
+    }
+
+    void release(T *object)
+    {
+        if (object == nullptr)
+            return;
+        FreeSlot *slot = reinterpret_cast<FreeSlot *>(object);
+        slot->next = freeList;
+        freeList = slot;
+        live--;
+    }
+
+    // Every object is gone, the blocks are kept for the next ones
+    void clear()
+    {
+        used = 0;
+        freeList = nullptr;
+        live = 0;
+    }
+
+    size_t size() const { return live; }
+    size_t capacity() const { return blocks.size() * BLOCK; }
+
+private:
+    struct FreeSlot {
+        FreeSlot *next;
+    };
+    union Slot {
+        FreeSlot free;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> blocks;
+    size_t used = 0; // slots of the blocks handed out at least once since the last clear
+    FreeSlot *freeList = nullptr;
+    size_t live = 0;
+};
+
+#endif // POOL_HPP
@@ -0,0 +1,114 @@
+#include <helpers/sceneIndex.hpp>
+#include <iostream>
+
+unsigned int SceneIndex::intern(const std::string &name)
+{
+    const unsigned int *found = nameIds.find(name);
+    if (found != nullptr)
+        return *found;
+    unsigned int id = (unsigned int)names.size();
+    names.push_back(name);
+    nameIds.insert(name, id);
+    return id;
+}
+
+void SceneIndex::reserve(size_t count)
+{
+    instances.reserve(count);
+    slotById.reserve(count);
+}
+
+void SceneIndex::clear()
+{
+    instances.clear();
+    slotById.clear();
+    slotByName.clear();
+}
+
+unsigned int SceneIndex::insert(Entity entity, size_t id, const std::string &name, SceneTreeNode *node)
+{
+    unsigned int slot = (unsigned int)instances.size();
+    if (!slotById.insert(id, slot))
+    {
+        std::cout << "ERROR::SCENE_INDEX::DUPLICATE_ID: " << id << std::endl;
+        return NONE;
+    }
+
+    unsigned int nameId = intern(name);
+    instances.push_back(SceneInstance{entity, id, nameId, node, NONE, NONE});
+    unsigned int *head = slotByName.find(nameId);
+    if (head != nullptr)
+    {
+        instances[slot].nextSameName = *head;
+        instances[*head].previousSameName = slot;
+        *head = slot;
+    }
+    else
+    {
+        slotByName.insert(nameId, slot);
+    }
+    return slot;
+}
+
+void SceneIndex::unlinkName(unsigned int slot)
+{
+    SceneInstance &entry = instances[slot];
+    if (entry.previousSameName != NONE)
+        instances[entry.previousSameName].nextSameName = entry.nextSameName;
+    else if (entry.nextSameName != NONE)
+        *slotByName.find(entry.name) = entry.nextSameName;
+    else
+        slotByName.erase(entry.name);
+    if (entry.nextSameName != NONE)
+        instances[entry.nextSameName].previousSameName = entry.previousSameName;
+}
+
+bool SceneIndex::remove(size_t id)
+{
+    const unsigned int *found = slotById.find(id);
+    if (found == nullptr)
+        return false;
+    unsigned int slot = *found;
+    unlinkName(slot);
+    slotById.erase(id);
+
+    // the last instance fills the hole, everything that pointed at it follows
+    unsigned int last = (unsigned int)instances.size() - 1;
+    if (slot != last)
+    {
+        instances[slot] = instances[last];
+        SceneInstance &moved = instances[slot];
+        *slotById.find(moved.id) = slot;
+        if (moved.previousSameName != NONE)
+            instances[moved.previousSameName].nextSameName = slot;
+        else
+            *slotByName.find(moved.name) = slot;
+        if (moved.nextSameName != NONE)
+            instances[moved.nextSameName].previousSameName = slot;
+    }
+    instances.pop_back();
+    return true;
+}
+
+unsigned int SceneIndex::find(size_t id) const
+{
+    const unsigned int *found = slotById.find(id);
+    return found != nullptr ? *found : NONE;
+}
+
+unsigned int SceneIndex::findByName(const std::string &name) const
+{
+    const unsigned int *nameId = nameIds.find(name);
+    if (nameId == nullptr)
+        return NONE;
+    const unsigned int *head = slotByName.find(*nameId);
+    return head != nullptr ? *head : NONE;
+}
+
+std::vector<unsigned int> SceneIndex::findAllByName(const std::string &name) const
+{
+    std::vector<unsigned int> slots;
+    for (unsigned int slot = findByName(name); slot != NONE; slot = instances[slot].nextSameName)
+        slots.push_back(slot);
+    return slots;
+}
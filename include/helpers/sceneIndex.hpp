@@ -0,0 +1,57 @@
+#ifndef SCENE_INDEX_HPP
+#define SCENE_INDEX_HPP
+
+#include <helpers/openHashMap.hpp>
+#include <scene/entityStore.hpp>
+#include <string>
+#include <vector>
+
+struct SceneTreeNode;
+
+// One indexed instance. Slots are dense: removing one moves the last instance into its place
+struct SceneInstance {
+    Entity entity;             // handle in Model::entities, survives the instance moving
+    size_t id;                 // the instance's StableId, stable across moves
+    unsigned int name;         // interned, see SceneIndex::nameOf
+    SceneTreeNode *node;       // hierarchy node shown in the scene tree, may be null
+    unsigned int previousSameName;
+    unsigned int nextSameName; // instances sharing a name form a list, headed by the name lookup
+};
+
+// Instance lookup by stable ID and by name, both O(1) through OpenHashMap. Names are interned
+// once, so instances only carry a small integer; instances with the same name are chained, the
+// name map points at the most recently inserted one.
+class SceneIndex {
+public:
+    static const unsigned int NONE = 0xFFFFFFFF;
+
+    // Indexes an instance under its stable ID (Model::id) and name; returns the slot,
+    // NONE if the ID is taken
+    unsigned int insert(Entity entity, size_t id, const std::string &name, SceneTreeNode *node = nullptr);
+    bool remove(size_t id);
+    // Slot of the instance, NONE when unknown
+    unsigned int find(size_t id) const;
+    unsigned int findByName(const std::string &name) const;
+    std::vector<unsigned int> findAllByName(const std::string &name) const;
+
+    unsigned int intern(const std::string &name);
+    const std::string &nameOf(unsigned int name) const { return names[name]; }
+
+    SceneInstance &operator[](unsigned int slot) { return instances[slot]; }
+    const SceneInstance &operator[](unsigned int slot) const { return instances[slot]; }
+    size_t size() const { return instances.size(); }
+    void reserve(size_t count);
+    // Drops every instance, the interned names stay
+    void clear();
+
+private:
+    std::vector<SceneInstance> instances;
+    OpenHashMap<size_t, unsigned int> slotById;
+    OpenHashMap<unsigned int, unsigned int> slotByName; // head of the name's chain
+    OpenHashMap<std::string, unsigned int> nameIds;
+    std::vector<std::string> names;
+
+    void unlinkName(unsigned int slot);
+};
+
+#endif // SCENE_INDEX_HPP
@@ -1,59 +1,117 @@
 #ifndef SCENE_TREE_HPP
 #define SCENE_TREE_HPP
 
-#include <vector>
 #include <model/model.hpp>
+#include <helpers/pool.hpp>
+#include <helpers/sceneIndex.hpp>
 
+// Node of the scene hierarchy shown in the Scene Tree window; lookups go through SceneIndex.
+// Children are an intrusive doubly linked list, so a node owns no allocation of its own
 struct SceneTreeNode{
     Model* NodeModel;
-    unsigned int instanceCount;
-    SceneTreeNode* leftChildInstance;
-    SceneTreeNode* rightChildInstance;
+    Entity entity; // the instance's handle, its index within NodeModel changes when others are removed
 
-    vector<SceneTreeNode*> childrenInstances;
     SceneTreeNode* parentNode;
+    SceneTreeNode* firstChild;
+    SceneTreeNode* lastChild;
+    SceneTreeNode* previousSibling;
+    SceneTreeNode* nextSibling;
 
-} typedef SceneTreeNode;
-
-SceneTreeNode* insertInstanceToSceneTree(SceneTreeNode* root, Model* model, unsigned int instanceIndex){
-    if(root->NodeModel == nullptr){
-        root->instanceCount = instanceIndex;
-        root->NodeModel = model;
-        return root;
-    }else{
-        if(model->Hash_ID[instanceIndex] < root->NodeModel->Hash_ID[0]){
-            if(root->leftChildInstance == nullptr){
-                SceneTreeNode* newNode = new SceneTreeNode();
-                newNode->NodeModel = model;
-                newNode->instanceCount = instanceIndex;
-                newNode->leftChildInstance = nullptr;
-                newNode->rightChildInstance = nullptr;
-                root->leftChildInstance = newNode;
-                return newNode;
-            }else{
-                return insertInstanceToSceneTree(root->leftChildInstance, model, instanceIndex);
-            }
-        }else{
-            if(root->rightChildInstance == nullptr){
-                SceneTreeNode* newNode = new SceneTreeNode();
-                newNode->NodeModel = model;
-                newNode->instanceCount = instanceIndex;
-                newNode->leftChildInstance = nullptr;
-                newNode->rightChildInstance = nullptr;
-                root->rightChildInstance = newNode;
-                return newNode;
-            }else{
-                return insertInstanceToSceneTree(root->rightChildInstance, model, instanceIndex);
-            }
-        }
+    unsigned int instance() const { return Model::entities.get<RenderHandle>(entity)->instance; }
+};
+
+// Every scene tree node comes from here
+inline Pool<SceneTreeNode> sceneTreeNodes;
+
+inline void appendSceneTreeChild(SceneTreeNode* parent, SceneTreeNode* child){
+    child->parentNode = parent;
+    child->previousSibling = parent->lastChild;
+    child->nextSibling = nullptr;
+    if (parent->lastChild != nullptr)
+        parent->lastChild->nextSibling = child;
+    else
+        parent->firstChild = child;
+    parent->lastChild = child;
+}
+
+inline void unlinkSceneTreeChild(SceneTreeNode* child){
+    SceneTreeNode* parent = child->parentNode;
+    if (parent == nullptr)
+        return;
+    if (child->previousSibling != nullptr)
+        child->previousSibling->nextSibling = child->nextSibling;
+    else
+        parent->firstChild = child->nextSibling;
+    if (child->nextSibling != nullptr)
+        child->nextSibling->previousSibling = child->previousSibling;
+    else
+        parent->lastChild = child->previousSibling;
+    child->parentNode = child->previousSibling = child->nextSibling = nullptr;
+}
+
+// Creates the node of an instance under parent (null for a root) and indexes it
+inline SceneTreeNode* insertInstanceToSceneTree(SceneIndex& index, SceneTreeNode* parent, Model* model, unsigned int instanceIndex){
+    SceneTreeNode* node = sceneTreeNodes.allocate(model, model->instanceEntities[instanceIndex], nullptr, nullptr, nullptr, nullptr, nullptr);
+    if (index.insert(node->entity, model->id(instanceIndex), model->name(instanceIndex), node) == SceneIndex::NONE)
+    {
+        sceneTreeNodes.release(node);
+        return nullptr;
     }
+    if (parent != nullptr)
+        appendSceneTreeChild(parent, node);
+    return node;
 }
 
-void removeInstanceFromSceneTree(SceneTreeNode& root, Model* model, unsigned int instanceIndex){}
+// Deletes the instance from its model, its index entry and its node; its children move up to its parent
+inline void removeInstanceFromSceneTree(SceneIndex& index, size_t id){
+    unsigned int slot = index.find(id);
+    if (slot == SceneIndex::NONE)
+        return;
+    SceneTreeNode* node = index[slot].node;
+    Entity entity = index[slot].entity;
+    index.remove(id);
+    if (Model::entities.alive(entity))
+    {
+        RenderHandle handle = *Model::entities.get<RenderHandle>(entity);
+        handle.model->removeInstance(handle.instance);
+    }
+    if (node == nullptr)
+        return;
+    SceneTreeNode* parent = node->parentNode;
+    unlinkSceneTreeChild(node);
+    for (SceneTreeNode* child = node->firstChild; child != nullptr;)
+    {
+        SceneTreeNode* next = child->nextSibling;
+        if (parent != nullptr)
+            appendSceneTreeChild(parent, child);
+        else
+            child->parentNode = child->previousSibling = child->nextSibling = nullptr;
+        child = next;
+    }
+    sceneTreeNodes.release(node);
+}
+
+// Forgets the whole hierarchy and index at once, without visiting the nodes. The models keep
+// their instances, this is for replacing the scene description, e.g. before loading another
+inline void clearSceneTree(SceneIndex& index){
+    sceneTreeNodes.clear();
+    index.clear();
+}
 
-void removeInstanceFromSceneTreeByName(SceneTreeNode& root, Model* model, unsigned int instanceIndex){}
+inline void removeInstanceFromSceneTreeByName(SceneIndex& index, const std::string& name){
+    unsigned int slot = index.findByName(name);
+    if (slot != SceneIndex::NONE)
+        removeInstanceFromSceneTree(index, index[slot].id);
+}
 
-Model* getInstacesInSceneTree(SceneTreeNode& root, Model* model, unsigned int instanceIndex){return nullptr;}
+inline SceneTreeNode* getInstanceInSceneTree(SceneIndex& index, size_t id){
+    unsigned int slot = index.find(id);
+    return slot != SceneIndex::NONE ? index[slot].node : nullptr;
+}
+
+inline SceneTreeNode* getInstanceInSceneTreeByName(SceneIndex& index, const std::string& name){
+    unsigned int slot = index.findByName(name);
+    return slot != SceneIndex::NONE ? index[slot].node : nullptr;
+}
 
-Model* getInstacesInSceneTreeByName(SceneTreeNode& root, const std::string& name){return nullptr;}
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,99 @@
+#include <lighting/deferredRenderer.hpp>
+#include <helpers/glState.hpp>
+#include <iostream>
+
+DeferredRenderer::DeferredRenderer(const char *lightingVertex, const char *lightingFragment)
+{
+    material = new Material(new ShaderPermutations(lightingVertex, lightingFragment));
+    material->setInt("gAlbedoSpec", GBUFFER_ALBEDO_SPEC_UNIT);
+    material->setInt("gNormal", GBUFFER_NORMAL_UNIT);
+    material->setInt("gDepth", GBUFFER_DEPTH_UNIT);
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+    release();
+    GLState::deleteVertexArrays(1, &emptyVAO);
+    delete material;
+}
+
+void DeferredRenderer::release()
+{
+    if (fbo == 0)
+        return;
+    GLuint textures[3] = {albedoSpec, normal, depth};
+    GLState::deleteTextures(3, textures);
+    glDeleteFramebuffers(1, &fbo);
+    fbo = 0;
+}
+
+void DeferredRenderer::allocate(unsigned int width, unsigned int height)
+{
+    release();
+    this->width = width;
+    this->height = height;
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    GLuint *textures[3] = {&albedoSpec, &normal, &depth};
+    GLenum internalFormats[3] = {GL_RGBA8, GL_RGBA16F, GL_DEPTH24_STENCIL8};
+    GLenum formats[3] = {GL_RGBA, GL_RGBA, GL_DEPTH_STENCIL};
+    GLenum types[3] = {GL_UNSIGNED_BYTE, GL_HALF_FLOAT, GL_UNSIGNED_INT_24_8};
+    GLenum attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_STENCIL_ATTACHMENT};
+    for (int i = 0; i < 3; i++)
+    {
+        glGenTextures(1, textures[i]);
+        GLState::bindTexture(GBUFFER_ALBEDO_SPEC_UNIT + i, GL_TEXTURE_2D, *textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, *textures[i], 0);
+    }
+
+    GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::DEFERRED::GBUFFER_INCOMPLETE: " << width << "x" << height << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::beginGeometryPass(unsigned int width, unsigned int height)
+{
+    if (fbo == 0 || width != this->width || height != this->height)
+        allocate(width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::lightingPass(const ShaderDefines &lightDefines, const glm::mat4 &projection, const glm::mat4 &view, GLuint target)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+    material->setMat4("view", view);
+    material->setMat4("inverseViewProjection", glm::inverse(projection * view));
+
+    GLState::bindTexture(GBUFFER_ALBEDO_SPEC_UNIT, GL_TEXTURE_2D, albedoSpec);
+    GLState::bindTexture(GBUFFER_NORMAL_UNIT, GL_TEXTURE_2D, normal);
+    GLState::bindTexture(GBUFFER_DEPTH_UNIT, GL_TEXTURE_2D, depth);
+
+    Shader *shader = material->shaders->get(lightDefines);
+    shader->use();
+    material->apply(*shader);
+
+    // sky pixels are discarded, so the cleared color shows through
+    GLState::disable(GL_DEPTH_TEST);
+    GLState::bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    GLState::enable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
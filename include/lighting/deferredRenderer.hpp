@@ -0,0 +1,43 @@
+#ifndef DEFERRED_RENDERER_HPP
+#define DEFERRED_RENDERER_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <shaders/material.hpp>
+
+// texture units the lighting pass reads the G-buffer from (clustered lights end at 18)
+#define GBUFFER_ALBEDO_SPEC_UNIT 19
+#define GBUFFER_NORMAL_UNIT 20
+#define GBUFFER_DEPTH_UNIT 21
+
+// Deferred shading. The geometry pass renders every deferred-capable model (shaders that know
+// GBUFFER_PASS) into the G-buffer: albedo + specular intensity, normal + shininess, depth. The
+// lighting pass is then one fullscreen triangle that rebuilds the position from depth and lights
+// it with the same lighting.glsl code as the forward path, using the light clusters as tiles.
+// Models that cannot go through the G-buffer are drawn forward afterwards on top of the blitted depth.
+class DeferredRenderer {
+public:
+    DeferredRenderer(const char *lightingVertex, const char *lightingFragment);
+    ~DeferredRenderer();
+
+    // Binds and clears the G-buffer, (re)allocating it when the size changed
+    void beginGeometryPass(unsigned int width, unsigned int height);
+    // Shades the G-buffer into target (0 for the window) and copies the depth over for forward passes
+    void lightingPass(const ShaderDefines &lightDefines, const glm::mat4 &projection, const glm::mat4 &view, GLuint target = 0);
+
+    Material *material; // lighting pass uniforms, set like any forward material
+
+private:
+    GLuint fbo = 0;
+    GLuint albedoSpec = 0;
+    GLuint normal = 0;
+    GLuint depth = 0;
+    GLuint emptyVAO = 0; // the fullscreen triangle is generated from gl_VertexID
+    unsigned int width = 0;
+    unsigned int height = 0;
+
+    void allocate(unsigned int width, unsigned int height);
+    void release();
+};
+
+#endif // DEFERRED_RENDERER_HPP
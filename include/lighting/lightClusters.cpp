@@ -0,0 +1,208 @@
+#include <lighting/lightClusters.hpp>
+#include <helpers/glState.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+LightClusters::LightClusters(JobSystem &jobs) : jobs(jobs)
+{
+    clusterLights.resize(CLUSTER_COUNT);
+    grid.resize(CLUSTER_COUNT * 2);
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+    glGenBuffers(1, &lightDataBuffer);
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glGenTextures(1, &lightDataTexture);
+    glGenTextures(1, &gridTexture);
+    glGenTextures(1, &indexTexture);
+
+    GLuint buffers[3] = {lightDataBuffer, gridBuffer, indexBuffer};
+    GLuint textures[3] = {lightDataTexture, gridTexture, indexTexture};
+    GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+    unsigned int units[3] = {CLUSTER_LIGHT_DATA_UNIT, CLUSTER_GRID_UNIT, CLUSTER_INDEX_UNIT};
+    for (int i = 0; i < 3; i++)
+    {
+        GLState::bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        GLState::bindTexture(units[i], GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+}
+
+LightClusters::~LightClusters()
+{
+    GLuint buffers[3] = {lightDataBuffer, gridBuffer, indexBuffer};
+    GLuint textures[3] = {lightDataTexture, gridTexture, indexTexture};
+    GLState::deleteBuffers(3, buffers);
+    GLState::deleteTextures(3, textures);
+}
+
+unsigned int LightClusters::sliceOf(float depth) const
+{
+    float slice = std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * GRID_Z;
+    return (unsigned int)std::min(std::max(slice, 0.0f), (float)(GRID_Z - 1));
+}
+
+void LightClusters::buildBounds(float fovY, float aspect, float nearPlane, float farPlane)
+{
+    boundsFovY = fovY;
+    boundsAspect = aspect;
+    boundsNear = nearPlane;
+    boundsFar = farPlane;
+    tanHalfFovY = std::tan(fovY * 0.5f);
+
+    bounds.resize(CLUSTER_COUNT);
+    for (unsigned int z = 0; z < GRID_Z; z++)
+    {
+        float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)z / GRID_Z);
+        float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / GRID_Z);
+        for (unsigned int y = 0; y < GRID_Y; y++)
+        {
+            for (unsigned int x = 0; x < GRID_X; x++)
+            {
+                float ndcX[2] = {-1.0f + 2.0f * x / GRID_X, -1.0f + 2.0f * (x + 1) / GRID_X};
+                float ndcY[2] = {-1.0f + 2.0f * y / GRID_Y, -1.0f + 2.0f * (y + 1) / GRID_Y};
+                ClusterBounds &box = bounds[x + GRID_X * (y + GRID_Y * z)];
+                box.min = glm::vec3(1e30f, 1e30f, -sliceFar);
+                box.max = glm::vec3(-1e30f, -1e30f, -sliceNear);
+                // the tile's side planes go through the eye, so the corners at both depths bound it
+                for (float depth : {sliceNear, sliceFar})
+                {
+                    for (int i = 0; i < 2; i++)
+                    {
+                        float vx = ndcX[i] * depth * tanHalfFovY * aspect;
+                        float vy = ndcY[i] * depth * tanHalfFovY;
+                        box.min.x = std::min(box.min.x, vx);
+                        box.max.x = std::max(box.max.x, vx);
+                        box.min.y = std::min(box.min.y, vy);
+                        box.max.y = std::max(box.max.y, vy);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void LightClusters::binSlices(unsigned int firstSlice, unsigned int lastSlice)
+{
+    for (unsigned int c = firstSlice * GRID_X * GRID_Y; c < (lastSlice + 1) * GRID_X * GRID_Y; c++)
+        clusterLights[c].clear();
+
+    float tanHalfFovX = tanHalfFovY * boundsAspect;
+    for (size_t i = 0; i < viewLights.size(); i++)
+    {
+        glm::vec3 center(viewLights[i]);
+        float radius = viewLights[i].w;
+
+        float minDepth = std::max(-center.z - radius, nearPlane);
+        float maxDepth = std::min(-center.z + radius, farPlane);
+        if (minDepth > maxDepth)
+            continue;
+        unsigned int z0 = std::max(sliceOf(minDepth), firstSlice);
+        unsigned int z1 = std::min(sliceOf(maxDepth), lastSlice);
+        if (z0 > z1)
+            continue;
+
+        // screen extent of the sphere's box, taking whichever depth widens each side
+        float minX = std::min((center.x - radius) / (minDepth * tanHalfFovX), (center.x - radius) / (maxDepth * tanHalfFovX));
+        float maxX = std::max((center.x + radius) / (minDepth * tanHalfFovX), (center.x + radius) / (maxDepth * tanHalfFovX));
+        float minY = std::min((center.y - radius) / (minDepth * tanHalfFovY), (center.y - radius) / (maxDepth * tanHalfFovY));
+        float maxY = std::max((center.y + radius) / (minDepth * tanHalfFovY), (center.y + radius) / (maxDepth * tanHalfFovY));
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+            continue;
+        int x0 = std::max(0, (int)std::floor((minX * 0.5f + 0.5f) * GRID_X));
+        int x1 = std::min((int)GRID_X - 1, (int)std::floor((maxX * 0.5f + 0.5f) * GRID_X));
+        int y0 = std::max(0, (int)std::floor((minY * 0.5f + 0.5f) * GRID_Y));
+        int y1 = std::min((int)GRID_Y - 1, (int)std::floor((maxY * 0.5f + 0.5f) * GRID_Y));
+
+        for (unsigned int z = z0; z <= z1; z++)
+        {
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    unsigned int cluster = x + GRID_X * (y + GRID_Y * z);
+                    const ClusterBounds &box = bounds[cluster];
+                    glm::vec3 closest = glm::clamp(center, box.min, box.max);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) <= radius * radius)
+                        clusterLights[cluster].push_back((GLuint)i);
+                }
+            }
+        }
+    }
+}
+
+void LightClusters::update(const std::vector<PointLight> &lights, const glm::mat4 &view, float fovY, float aspect, float nearPlane, float farPlane)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    this->nearPlane = nearPlane;
+    this->farPlane = farPlane;
+    if (fovY != boundsFovY || aspect != boundsAspect || nearPlane != boundsNear || farPlane != boundsFar)
+        buildBounds(fovY, aspect, nearPlane, farPlane);
+
+    // 4 texels per light, lights past the texture buffer limit are dropped
+    size_t lightCount = std::min(lights.size(), (size_t)maxTexels / 4);
+    viewLights.resize(lightCount);
+    lightData.resize(std::max<size_t>(lightCount * 4, 1));
+    for (size_t i = 0; i < lightCount; i++)
+    {
+        const PointLight &light = lights[i];
+        float radius = LightCulling::lightRadius(light);
+        viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(light.position, 1.0f)), radius);
+        lightData[i * 4 + 0] = glm::vec4(light.position, radius);
+        lightData[i * 4 + 1] = glm::vec4(light.ambient, light.constant);
+        lightData[i * 4 + 2] = glm::vec4(light.diffuse, light.linear);
+        lightData[i * 4 + 3] = glm::vec4(light.specular, light.quadratic);
+    }
+
+    // two depth slices per job, the calling thread bins some of them too
+    jobs.parallelFor(GRID_Z, 2, [this](unsigned int first, unsigned int end) { binSlices(first, end - 1); });
+
+    indices.clear();
+    stats = LightClusterStats();
+    std::vector<bool> touched(lightCount, false);
+    for (unsigned int c = 0; c < CLUSTER_COUNT; c++)
+    {
+        const std::vector<GLuint> &list = clusterLights[c];
+        size_t count = std::min(list.size(), (size_t)maxTexels - indices.size());
+        grid[c * 2] = (GLuint)indices.size();
+        grid[c * 2 + 1] = (GLuint)count;
+        indices.insert(indices.end(), list.begin(), list.begin() + count);
+        for (size_t i = 0; i < count; i++)
+            touched[list[i]] = true;
+        stats.maxPerCluster = std::max(stats.maxPerCluster, (unsigned int)count);
+    }
+    stats.indices = (unsigned int)indices.size();
+    stats.lights = (unsigned int)std::count(touched.begin(), touched.end(), true);
+    if (indices.empty())
+        indices.push_back(0);
+
+    GLState::bindBuffer(GL_TEXTURE_BUFFER, lightDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, lightData.size() * sizeof(glm::vec4), lightData.data(), GL_STREAM_DRAW);
+    GLState::bindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(GLuint), grid.data(), GL_STREAM_DRAW);
+    GLState::bindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STREAM_DRAW);
+
+    stats.binMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LightClusters::bind(Material *material, unsigned int viewportWidth, unsigned int viewportHeight)
+{
+    GLState::bindTexture(CLUSTER_LIGHT_DATA_UNIT, GL_TEXTURE_BUFFER, lightDataTexture);
+    GLState::bindTexture(CLUSTER_GRID_UNIT, GL_TEXTURE_BUFFER, gridTexture);
+    GLState::bindTexture(CLUSTER_INDEX_UNIT, GL_TEXTURE_BUFFER, indexTexture);
+
+    material->setInt("clusterLightData", CLUSTER_LIGHT_DATA_UNIT);
+    material->setInt("clusterGrid", CLUSTER_GRID_UNIT);
+    material->setInt("clusterIndices", CLUSTER_INDEX_UNIT);
+    material->setVec3("clusterGridSize", glm::vec3(GRID_X, GRID_Y, GRID_Z));
+    material->setVec2("clusterTileSize", glm::vec2((float)viewportWidth / GRID_X, (float)viewportHeight / GRID_Y));
+    // slice = log(depth) * scale - bias, the inverse of the exponential split in buildBounds
+    float logRange = std::log(farPlane / nearPlane);
+    material->setFloat("clusterScale", GRID_Z / logRange);
+    material->setFloat("clusterBias", GRID_Z * std::log(nearPlane) / logRange);
+}
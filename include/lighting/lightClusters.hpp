@@ -0,0 +1,75 @@
+#ifndef LIGHT_CLUSTERS_HPP
+#define LIGHT_CLUSTERS_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <lighting/lightCulling.hpp>
+#include <helpers/jobSystem.hpp>
+#include <shaders/material.hpp>
+#include <vector>
+
+// texture units used by the clustered lighting buffers (batched materials end at 15)
+#define CLUSTER_LIGHT_DATA_UNIT 16
+#define CLUSTER_GRID_UNIT 17
+#define CLUSTER_INDEX_UNIT 18
+
+// Binning stats of the last update()
+struct LightClusterStats {
+    unsigned int lights = 0;     // lights that touched at least one cluster
+    unsigned int indices = 0;    // total entries in the light index list
+    unsigned int maxPerCluster = 0;
+    float binMs = 0.0f;
+};
+
+// Clustered forward lighting. The view frustum is cut into GRID_X * GRID_Y screen tiles and
+// GRID_Z exponential depth slices; every frame the lights are binned into the clusters their
+// range (LightCulling::lightRadius) touches, and the fragment shader (clusteredLights.glsl)
+// only loops over the lights of its own cluster. Binning runs as jobs, each owning a band of depth
+// slices so no two jobs write the same cluster. The results go to three texture buffers,
+// which keeps the path on core 3.3.
+class LightClusters {
+public:
+    static const unsigned int GRID_X = 16;
+    static const unsigned int GRID_Y = 9;
+    static const unsigned int GRID_Z = 24;
+    static const unsigned int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+    explicit LightClusters(JobSystem &jobs);
+    ~LightClusters();
+
+    // Bins lights for a perspective camera and uploads the cluster buffers
+    void update(const std::vector<PointLight> &lights, const glm::mat4 &view, float fovY, float aspect, float nearPlane, float farPlane);
+    // Binds the buffers to their units and sets the lookup uniforms on material
+    void bind(Material *material, unsigned int viewportWidth, unsigned int viewportHeight);
+
+    LightClusterStats stats;
+
+private:
+    JobSystem &jobs;
+
+    struct ClusterBounds {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    std::vector<ClusterBounds> bounds; // view-space AABB per cluster
+    float boundsFovY = 0.0f, boundsAspect = 0.0f, boundsNear = 0.0f, boundsFar = 0.0f;
+    float nearPlane = 0.1f, farPlane = 100.0f;
+    float tanHalfFovY = 1.0f;
+
+    std::vector<glm::vec4> viewLights;               // view-space position + radius
+    std::vector<std::vector<GLuint>> clusterLights; // light indices per cluster
+    std::vector<glm::vec4> lightData;                // 4 texels per light
+    std::vector<GLuint> grid;                        // (offset, count) per cluster
+    std::vector<GLuint> indices;
+    GLint maxTexels = 65536;
+
+    GLuint lightDataBuffer = 0, gridBuffer = 0, indexBuffer = 0;
+    GLuint lightDataTexture = 0, gridTexture = 0, indexTexture = 0;
+
+    void buildBounds(float fovY, float aspect, float nearPlane, float farPlane);
+    void binSlices(unsigned int firstSlice, unsigned int lastSlice);
+    unsigned int sliceOf(float depth) const;
+};
+
+#endif // LIGHT_CLUSTERS_HPP
@@ -0,0 +1,168 @@
+#include <lighting/lightCulling.hpp>
+#include <helpers/glState.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <algorithm>
+#include <cmath>
+
+float LightCulling::threshold = 5.0f / 256.0f;
+
+static float lightLuminance(const glm::vec3 &color)
+{
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+LightCulling::LightCulling()
+{
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+    GLState::bindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    GLState::bindTexture(LIGHT_LIST_DATA_UNIT, GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+}
+
+LightCulling::~LightCulling()
+{
+    GLState::deleteTextures(1, &texture);
+    GLState::deleteBuffers(1, &buffer);
+}
+
+float LightCulling::lightRadius(const PointLight &light)
+{
+    // solve constant + linear * d + quadratic * d^2 = luminance / threshold
+    float c = light.constant - lightLuminance(light.diffuse) / threshold;
+    if (c >= 0.0f)
+        return 0.0f;
+    if (light.quadratic <= 0.0f)
+        return light.linear > 0.0f ? -c / light.linear : 1e30f;
+    float discriminant = light.linear * light.linear - 4.0f * light.quadratic * c;
+    return (-light.linear + std::sqrt(discriminant)) / (2.0f * light.quadratic);
+}
+
+void LightCulling::update(const std::vector<PointLight> &lights, const glm::mat4 &viewProjection, const SceneBVH *bvh)
+{
+    // frustum planes straight from the matrix rows, normalized so distances are in world units
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++)
+    {
+        glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[i * 2] = w + row;
+        planes[i * 2 + 1] = w - row;
+    }
+    for (glm::vec4 &plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    spheres.clear();
+    luminance.clear();
+    attenuation.clear();
+    lightData.clear();
+    for (const PointLight &light : lights)
+    {
+        float radius = lightRadius(light);
+        if (radius <= 0.0f)
+            continue;
+        bool inside = true;
+        for (const glm::vec4 &plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), light.position) + plane.w < -radius)
+            {
+                inside = false;
+                break;
+            }
+        }
+        if (!inside)
+            continue;
+
+        spheres.push_back(glm::vec4(light.position, radius));
+        luminance.push_back(lightLuminance(light.diffuse));
+        attenuation.push_back(glm::vec3(light.constant, light.linear, light.quadratic));
+        lightData.push_back(glm::vec4(light.position, radius));
+        lightData.push_back(glm::vec4(light.ambient, light.constant));
+        lightData.push_back(glm::vec4(light.diffuse, light.linear));
+        lightData.push_back(glm::vec4(light.specular, light.quadratic));
+    }
+
+    stats = LightCullingStats();
+    stats.lights = (unsigned int)lights.size();
+    stats.visible = (unsigned int)spheres.size();
+
+    this->bvh = bvh;
+    if (bvh != nullptr)
+    {
+        itemLights.resize(bvh->tree().size());
+        for (std::vector<int> &list : itemLights)
+            list.clear();
+        for (size_t i = 0; i < spheres.size(); i++)
+        {
+            reached.clear();
+            bvh->tree().overlap(glm::vec3(spheres[i]), spheres[i].w, reached);
+            for (unsigned int item : reached)
+                itemLights[item].push_back((int)i);
+        }
+    }
+
+    if (lightData.empty())
+        lightData.push_back(glm::vec4(0.0f));
+    GLState::bindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, lightData.size() * sizeof(glm::vec4), lightData.data(), GL_STREAM_DRAW);
+}
+
+void LightCulling::select(const Bounds &bounds, std::vector<int> &list, const std::vector<int> *candidates)
+{
+    list.clear();
+    if (bounds.empty())
+        return;
+
+    // strongest first: brightness after attenuation at the nearest point of the box
+    FrameVector<std::pair<float, int>> reaching;
+    size_t count = candidates != nullptr ? candidates->size() : spheres.size();
+    for (size_t c = 0; c < count; c++)
+    {
+        size_t i = candidates != nullptr ? (size_t)(*candidates)[c] : c;
+        glm::vec3 center(spheres[i]);
+        glm::vec3 offset = glm::clamp(center, bounds.min, bounds.max) - center;
+        float distanceSquared = glm::dot(offset, offset);
+        if (distanceSquared > spheres[i].w * spheres[i].w)
+            continue;
+        float distance = std::sqrt(distanceSquared);
+        float falloff = attenuation[i].x + attenuation[i].y * distance + attenuation[i].z * distanceSquared;
+        reaching.push_back({luminance[i] / falloff, (int)i});
+    }
+
+    count = std::min(reaching.size(), (size_t)MAX_OBJECT_LIGHTS);
+    std::partial_sort(reaching.begin(), reaching.begin() + count, reaching.end(),
+                      [](const std::pair<float, int> &a, const std::pair<float, int> &b) { return a.first > b.first; });
+    for (size_t i = 0; i < count; i++)
+        list.push_back(reaching[i].second);
+
+    stats.assigned += (unsigned int)count;
+    stats.longestList = std::max(stats.longestList, (unsigned int)count);
+}
+
+void LightCulling::assign(Model *model)
+{
+    model->updateModelMatrices();
+    model->lightLists.resize(model->modelMatrix.size());
+    Bounds all;
+    for (unsigned int i = 0; i < model->modelMatrix.size(); i++)
+    {
+        Bounds bounds = model->instanceBounds(i);
+        int item = bvh != nullptr ? bvh->item(model, i) : -1;
+        select(bounds, model->lightLists[i], item >= 0 ? &itemLights[item] : nullptr);
+        if (!bounds.empty())
+        {
+            all.add(bounds.min);
+            all.add(bounds.max);
+        }
+    }
+    // an instanced draw can only have one list, fitted to every instance at once
+    select(all, model->sharedLightList);
+}
+
+void LightCulling::bind(Material *material)
+{
+    GLState::bindTexture(LIGHT_LIST_DATA_UNIT, GL_TEXTURE_BUFFER, texture);
+    material->setInt("lightListData", LIGHT_LIST_DATA_UNIT);
+    material->setInt("visibleLightCount", (int)spheres.size());
+}
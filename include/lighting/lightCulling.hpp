@@ -0,0 +1,72 @@
+#ifndef LIGHT_CULLING_HPP
+#define LIGHT_CULLING_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <model/model.hpp>
+#include <culling/sceneBVH.hpp>
+#include <shaders/material.hpp>
+#include <vector>
+
+// texture unit of the visible light buffer (the shadow map is on 22)
+#define LIGHT_LIST_DATA_UNIT 23
+// longest per-object light list, lightLists.glsl has the same default
+#define MAX_OBJECT_LIGHTS 8
+
+// Same fields as PointLight in lighting.glsl
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float constant = 1.0f;
+    float linear = 0.09f;
+    float quadratic = 0.032f;
+};
+
+// Counters of the last update()/assign() calls
+struct LightCullingStats {
+    unsigned int lights = 0;   // handed to update()
+    unsigned int visible = 0;  // survived the frustum test
+    unsigned int assigned = 0; // entries over every object list
+    unsigned int longestList = 0;
+};
+
+// Range culling for the non-clustered path. Each light gets the radius where its attenuation
+// drops below threshold; update() keeps the lights whose sphere touches the view frustum and
+// uploads them to a texture buffer, assign() then gives every instance of a model the strongest
+// MAX_OBJECT_LIGHTS of those that reach its bounds. With a SceneBVH, update() finds the instances
+// each sphere reaches up front, so assign() only weighs those lights instead of every one.
+class LightCulling {
+public:
+    LightCulling();
+    ~LightCulling();
+
+    // Distance where the light's luminance, after attenuation, falls below threshold
+    static float lightRadius(const PointLight &light);
+    static float threshold;
+
+    void update(const std::vector<PointLight> &lights, const glm::mat4 &viewProjection, const SceneBVH *bvh = nullptr);
+    // Fills model->lightLists (one per instance) and model->sharedLightList (for instanced draws)
+    void assign(Model *model);
+    // Binds the visible light buffer and sets the uniforms lightLists.glsl reads
+    void bind(Material *material);
+
+    LightCullingStats stats;
+
+private:
+    std::vector<glm::vec4> spheres;   // visible lights, position + radius
+    std::vector<float> luminance;     // of each visible light's diffuse color
+    std::vector<glm::vec3> attenuation; // constant, linear, quadratic of each visible light
+    std::vector<glm::vec4> lightData; // 4 texels per visible light, see pointLightData.glsl
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    const SceneBVH *bvh = nullptr;
+    std::vector<std::vector<int>> itemLights; // visible lights reaching each BVH item
+    std::vector<unsigned int> reached;
+
+    // candidates null weighs every visible light
+    void select(const Bounds &bounds, std::vector<int> &list, const std::vector<int> *candidates = nullptr);
+};
+
+#endif // LIGHT_CULLING_HPP
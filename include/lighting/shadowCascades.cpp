@@ -0,0 +1,249 @@
+#include <lighting/shadowCascades.hpp>
+#include <helpers/glState.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// how far behind a cascade (towards the light) casters are still captured, depth clamping
+// flattens anything closer than that onto the near plane
+static const float CASTER_MARGIN = 50.0f;
+// fitted boxes are this much larger than the slice, so small camera moves keep the cached render
+static const float FIT_SLACK = 1.25f;
+
+ShadowCascades::ShadowCascades(unsigned int resolution) : resolution(resolution)
+{
+    glGenTextures(1, &depthArray);
+    GLState::bindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, depthArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // hardware 2x2 PCF through sampler2DArrayShadow
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::SHADOW::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowCascades::~ShadowCascades()
+{
+    glDeleteFramebuffers(1, &fbo);
+    GLState::deleteTextures(1, &depthArray);
+}
+
+void ShadowCascades::fit(Cascade &cascade, const glm::vec3 corners[8], const glm::vec3 &lightDirection, float splitFar)
+{
+    glm::vec3 center(0.0f);
+    for (int i = 0; i < 8; i++)
+        center += corners[i];
+    center /= 8.0f;
+    float radius = 0.0f;
+    for (int i = 0; i < 8; i++)
+        radius = std::max(radius, glm::length(corners[i] - center));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    float halfExtent = radius * FIT_SLACK;
+    glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+    // snap the center to whole shadow texels, so refits do not make the edges crawl
+    glm::mat4 rotation = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+    glm::vec3 lightCenter = glm::vec3(rotation * glm::vec4(center, 1.0f));
+    float texel = 2.0f * halfExtent / resolution;
+    lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+    lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+    center = glm::vec3(glm::inverse(rotation) * glm::vec4(lightCenter, 1.0f));
+
+    float depthRange = halfExtent + CASTER_MARGIN;
+    cascade.lightView = glm::lookAt(center - lightDirection * depthRange, center, up);
+    cascade.lightProjection = glm::ortho(-halfExtent, halfExtent, -halfExtent, halfExtent, 0.0f, depthRange + halfExtent);
+    cascade.viewProjection = cascade.lightProjection * cascade.lightView;
+    cascade.center = center;
+    cascade.halfExtent = halfExtent;
+    cascade.splitFar = splitFar;
+    cascade.lightDirection = lightDirection;
+    cascade.valid = true;
+}
+
+bool ShadowCascades::covers(const Cascade &cascade, const glm::vec3 &center, float radius) const
+{
+    glm::vec3 lightCenter = glm::vec3(cascade.lightView * glm::vec4(center, 1.0f));
+    float far = 2.0f * cascade.halfExtent + CASTER_MARGIN;
+    return std::abs(lightCenter.x) + radius <= cascade.halfExtent &&
+           std::abs(lightCenter.y) + radius <= cascade.halfExtent &&
+           -lightCenter.z - radius >= 0.0f && -lightCenter.z + radius <= far;
+}
+
+bool ShadowCascades::overlaps(const Cascade &cascade, const Bounds &bounds) const
+{
+    if (bounds.empty())
+        return false;
+    Bounds clip;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point((corner & 1) ? bounds.max.x : bounds.min.x,
+                        (corner & 2) ? bounds.max.y : bounds.min.y,
+                        (corner & 4) ? bounds.max.z : bounds.min.z);
+        clip.add(glm::vec3(cascade.viewProjection * glm::vec4(point, 1.0f)));
+    }
+    // anything in front of the near plane still casts thanks to depth clamping
+    return clip.max.x >= -1.0f && clip.min.x <= 1.0f && clip.max.y >= -1.0f && clip.min.y <= 1.0f && clip.min.z <= 1.0f;
+}
+
+void ShadowCascades::update(const std::vector<Model *> &casters, ShaderPermutations *depthShaders, const glm::mat4 &view,
+                            float fovY, float aspect, float nearPlane, const glm::vec3 &lightDirection,
+                            unsigned int viewportWidth, unsigned int viewportHeight)
+{
+    stats = ShadowStats();
+    frame++;
+    if (glm::length(lightDirection) < 1e-6f)
+        return;
+    glm::vec3 direction = glm::normalize(lightDirection);
+
+    // boxes of casters that moved, appeared or vanished since the last update
+    FrameVector<Bounds> moved;
+    FrameVector<FrameVector<Bounds>> casterBounds(casters.size());
+    for (size_t m = 0; m < casters.size(); m++)
+    {
+        Model *model = casters[m];
+        if (!model->castsShadows)
+            continue;
+        model->updateModelMatrices();
+        for (unsigned int i = 0; i < model->modelMatrix.size(); i++)
+            casterBounds[m].push_back(model->instanceBounds(i));
+
+        std::vector<Bounds> &last = lastBounds[model];
+        for (size_t i = 0; i < std::max(last.size(), casterBounds[m].size()); i++)
+        {
+            bool hadOld = i < last.size(), hasNew = i < casterBounds[m].size();
+            if (hadOld && hasNew && last[i].min == casterBounds[m][i].min && last[i].max == casterBounds[m][i].max)
+                continue;
+            if (hadOld)
+                moved.push_back(last[i]);
+            if (hasNew)
+                moved.push_back(casterBounds[m][i]);
+        }
+        last.assign(casterBounds[m].begin(), casterBounds[m].end());
+    }
+    // casters that were deleted or stopped casting: their shadows go, and so do their entries
+    FrameVector<const Model *> current;
+    for (const Model *model : casters)
+    {
+        if (model->castsShadows)
+            current.push_back(model);
+    }
+    std::sort(current.begin(), current.end());
+    for (auto entry = lastBounds.begin(); entry != lastBounds.end();)
+    {
+        if (std::binary_search(current.begin(), current.end(), entry->first))
+        {
+            ++entry;
+            continue;
+        }
+        moved.insert(moved.end(), entry->second.begin(), entry->second.end());
+        entry = lastBounds.erase(entry);
+    }
+
+    glm::mat4 inverseView = glm::inverse(view);
+    float tanHalfFovY = std::tan(fovY * 0.5f);
+    float tanHalfFovX = tanHalfFovY * aspect;
+    float farPlane = std::max(shadowDistance, nearPlane * 2.0f);
+
+    bool bound = false;
+    float splitNear = nearPlane;
+    for (int c = 0; c < CASCADES; c++)
+    {
+        // practical split scheme, blending uniform and logarithmic splits
+        float t = (float)(c + 1) / CASCADES;
+        float logSplit = nearPlane * std::pow(farPlane / nearPlane, t);
+        float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+        float splitFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+        {
+            float depth = (i & 4) ? splitFar : splitNear;
+            glm::vec4 viewCorner((i & 1 ? 1.0f : -1.0f) * depth * tanHalfFovX, (i & 2 ? 1.0f : -1.0f) * depth * tanHalfFovY, -depth, 1.0f);
+            corners[i] = glm::vec3(inverseView * viewCorner);
+        }
+        glm::vec3 center(0.0f);
+        for (int i = 0; i < 8; i++)
+            center += corners[i];
+        center /= 8.0f;
+        float radius = 0.0f;
+        for (int i = 0; i < 8; i++)
+            radius = std::max(radius, glm::length(corners[i] - center));
+        splitNear = splitFar;
+
+        Cascade &cascade = cascades[c];
+        bool refit = !cache || !cascade.valid || cascade.splitFar != splitFar || !covers(cascade, center, radius);
+        if (!refit && !cascade.dirty)
+        {
+            if (glm::dot(cascade.lightDirection, direction) < 0.99999f)
+                cascade.dirty = true;
+            for (const Bounds &bounds : moved)
+            {
+                if (cascade.dirty)
+                    break;
+                cascade.dirty = overlaps(cascade, bounds);
+            }
+        }
+        bool due = (frame % (1u << c)) == 0;
+        if (!refit && !(cascade.dirty && due))
+            continue;
+
+        fit(cascade, corners, direction, splitFar);
+        cascade.dirty = false;
+
+        if (!bound)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glViewport(0, 0, resolution, resolution);
+            GLState::enable(GL_DEPTH_CLAMP);
+            GLState::enable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.0f, 4.0f);
+            bound = true;
+        }
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, c);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        for (size_t m = 0; m < casters.size(); m++)
+        {
+            bool visible = false;
+            for (const Bounds &bounds : casterBounds[m])
+                visible = visible || overlaps(cascade, bounds);
+            if (visible)
+                stats.draws += casters[m]->DrawDepth(depthShaders, cascade.lightProjection, cascade.lightView);
+        }
+        stats.cascadesRendered++;
+    }
+
+    if (bound)
+    {
+        GLState::disable(GL_POLYGON_OFFSET_FILL);
+        GLState::disable(GL_DEPTH_CLAMP);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, viewportWidth, viewportHeight);
+    }
+}
+
+void ShadowCascades::bind(Material *material)
+{
+    GLState::bindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, depthArray);
+    material->setInt("shadowMap", SHADOW_MAP_UNIT);
+    glm::vec4 splits;
+    for (int c = 0; c < CASCADES; c++)
+    {
+        material->setMat4(FrameAllocator::frame.format("cascadeMatrices[%d]", c), cascades[c].viewProjection);
+        splits[c] = cascades[c].splitFar;
+    }
+    material->setVec4("cascadeSplits", splits);
+}
@@ -0,0 +1,73 @@
+#ifndef SHADOW_CASCADES_HPP
+#define SHADOW_CASCADES_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <model/model.hpp>
+#include <shaders/material.hpp>
+#include <unordered_map>
+#include <vector>
+
+// texture unit of the cascade depth array (the G-buffer ends at 21)
+#define SHADOW_MAP_UNIT 22
+
+// Shadow pass counters of the last update()
+struct ShadowStats {
+    unsigned int cascadesRendered = 0;
+    unsigned int draws = 0;
+};
+
+// Cascaded shadow maps for the directional light. The camera frustum up to shadowDistance is
+// split into CASCADES slices, each covered by an orthographic light view fitted around the
+// slice's bounding sphere with some slack. A cascade keeps its last render until
+//  - the slice leaves the fitted box (refit, rendered right away),
+//  - the light direction changes, or
+//  - a caster inside the box moved or changed;
+// the last two only refresh cascade i every 2^i frames, so far cascades update at a lower rate.
+class ShadowCascades {
+public:
+    static const int CASCADES = 4;
+
+    ShadowCascades(unsigned int resolution = 2048);
+    ~ShadowCascades();
+
+    // Refits and re-renders whichever cascades need it, casters are drawn with depthShaders.
+    // Leaves the default framebuffer bound with a viewportWidth x viewportHeight viewport.
+    void update(const std::vector<Model *> &casters, ShaderPermutations *depthShaders, const glm::mat4 &view,
+                float fovY, float aspect, float nearPlane, const glm::vec3 &lightDirection,
+                unsigned int viewportWidth, unsigned int viewportHeight);
+    // Binds the depth array and sets the cascade uniforms shadows.glsl reads
+    void bind(Material *material);
+
+    float shadowDistance = 60.0f;
+    float splitLambda = 0.75f; // 0 uniform splits, 1 logarithmic
+    bool cache = true;         // false re-renders every cascade every frame
+    ShadowStats stats;
+
+private:
+    struct Cascade {
+        glm::mat4 lightView;
+        glm::mat4 lightProjection;
+        glm::mat4 viewProjection;
+        glm::vec3 center;          // of the fitted box, world space
+        float halfExtent = 0.0f;   // of the fitted box, light space
+        float splitFar = 0.0f;     // view distance the cascade covers up to
+        glm::vec3 lightDirection;  // direction it was rendered with
+        bool valid = false;
+        bool dirty = true;
+    };
+
+    Cascade cascades[CASCADES];
+    unsigned int resolution;
+    GLuint depthArray = 0;
+    GLuint fbo = 0;
+    unsigned int frame = 0;
+    // caster boxes at the previous update, of the casters passed to it (deleted models drop out there)
+    std::unordered_map<const Model *, std::vector<Bounds>> lastBounds;
+
+    void fit(Cascade &cascade, const glm::vec3 corners[8], const glm::vec3 &lightDirection, float splitFar);
+    bool covers(const Cascade &cascade, const glm::vec3 &center, float radius) const;
+    bool overlaps(const Cascade &cascade, const Bounds &bounds) const;
+};
+
+#endif // SHADOW_CASCADES_HPP
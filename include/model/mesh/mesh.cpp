@@ -1,39 +1,167 @@
 #include "mesh.hpp"
+#include <helpers/glState.hpp>
+#include <cmath>
+#include <utility>
 
-void Mesh::Draw(Shader &shader, glm::mat4 modelMatrix, glm::mat4 projection, glm::mat4 viewMatrix)
+const char *Mesh::textureTypes[4] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+
+Mesh::Mesh(Mesh &&other) noexcept
+    : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+      VAO(std::exchange(other.VAO, 0)), VBO(std::exchange(other.VBO, 0)), EBO(std::exchange(other.EBO, 0)),
+      depthVAO(std::exchange(other.depthVAO, 0)), positionVBO(std::exchange(other.positionVBO, 0)),
+      textureUnits(std::move(other.textureUnits)), emptyUnits(std::move(other.emptyUnits)), triangleBVH(std::move(other.triangleBVH))
+{
+}
+
+Mesh::~Mesh()
+{
+    // the textures are the model's, its meshes share them
+    GLuint buffers[3] = {VBO, EBO, positionVBO};
+    GLState::deleteBuffers(3, buffers);
+    GLuint arrays[2] = {VAO, depthVAO};
+    GLState::deleteVertexArrays(2, arrays);
+}
+
+void Mesh::Draw()
 {
-    unsigned int diffuseNr = 1;
-    unsigned int specularNr = 1;
-    unsigned int normalNr = 1;
-    unsigned int heightNr = 1;
+    bindTextures();
+
+    GLState::bindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+}
+
+void Mesh::DrawInstanced(unsigned int instanceCount)
+{
+    bindTextures();
+
+    GLState::bindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, instanceCount);
+}
 
+void Mesh::DrawDepth(unsigned int instanceCount)
+{
+    GLState::bindVertexArray(depthVAO);
+    if (instanceCount == 0)
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+    else
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, instanceCount);
+}
 
-    
-    for(unsigned int i = 0; i < textures.size(); i++)
+bool Mesh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance)
+{
+    unsigned int triangles = (unsigned int)(indices.size() / 3);
+    if (triangles == 0)
+        return false;
+    if (triangleBVH.size() != triangles)
     {
-        glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
-
-        string number;
-        string name = textures[i].type;
-        if(name == "texture_diffuse")
-            number = to_string(diffuseNr++);
-        else if(name == "texture_specular")
-            number = to_string(specularNr++);
-        else if(name == "texture_normal")
-            number = to_string(normalNr++);
-        else if(name == "texture_height")
-            number = to_string(heightNr++);
-
-        // now set the sampler to the correct texture unit
-        glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-        // and finally bind the texture
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        vector<Bounds> boxes(triangles);
+        for (unsigned int i = 0; i < triangles; i++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+                boxes[i].add(vertices[indices[i * 3 + corner]].Position);
+        }
+        triangleBVH.build(boxes);
     }
 
+    // Moller-Trumbore against the triangles whose boxes the ray enters, nearest first
+    float hitDistance;
+    int hit = triangleBVH.raycast(origin, direction, distance, hitDistance, [&](unsigned int triangle, float &t) {
+        const glm::vec3 &a = vertices[indices[triangle * 3]].Position;
+        glm::vec3 edge1 = vertices[indices[triangle * 3 + 1]].Position - a;
+        glm::vec3 edge2 = vertices[indices[triangle * 3 + 2]].Position - a;
+        glm::vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-12f)
+            return false;
+        float inverse = 1.0f / determinant;
+        glm::vec3 offset = origin - a;
+        float u = glm::dot(offset, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(offset, edge1);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        t = glm::dot(edge2, q) * inverse;
+        return t >= 0.0f;
+    });
+    if (hit < 0)
+        return false;
+    distance = hitDistance;
+    return true;
+}
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+bool Mesh::hasTexture(const string &type) const
+{
+    for (const Texture &texture : textures)
+    {
+        if (texture.type == type)
+            return true;
+    }
+    return false;
+}
+
+int Mesh::textureUnit(const string &type, unsigned int number)
+{
+    if (number < 1 || number > MAX_TEXTURES_PER_TYPE)
+        return -1;
+    for (int i = 0; i < 4; i++)
+    {
+        if (type == textureTypes[i])
+            return i * MAX_TEXTURES_PER_TYPE + (int)number - 1;
+    }
+    return -1;
+}
+
+void Mesh::setupTextureUnits()
+{
+    unsigned int counts[4] = {0, 0, 0, 0};
+    textureUnits.clear();
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        int unit = -1;
+        for (int type = 0; type < 4; type++)
+        {
+            if (textures[i].type == textureTypes[type])
+                unit = textureUnit(textures[i].type, ++counts[type]);
+        }
+        textureUnits.push_back(unit);
+    }
+    // unbound samplers would otherwise read whatever the previous mesh left on that unit
+    emptyUnits.clear();
+    for (int type = 0; type < 4; type++)
+    {
+        if (counts[type] == 0)
+            emptyUnits.push_back(type * MAX_TEXTURES_PER_TYPE);
+    }
+}
+
+void Mesh::bindTextures()
+{
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        if (textureUnits[i] >= 0)
+            GLState::bindTexture(textureUnits[i], GL_TEXTURE_2D, textures[i].id);
+    }
+    for (unsigned int unit : emptyUnits)
+        GLState::bindTexture(unit, GL_TEXTURE_2D, 0);
+}
+
+void Mesh::setupInstancing(unsigned int instanceVBO)
+{
+    for (unsigned int vao : {VAO, depthVAO})
+    {
+        GLState::bindVertexArray(vao);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        // a mat4 attribute takes four consecutive locations, one per column
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(7 + i);
+            glVertexAttribPointer(7 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * i));
+            glVertexAttribDivisor(7 + i, 1);
+        }
+    }
+    GLState::bindVertexArray(0);
 }
 
 void Mesh::setupMesh()
@@ -43,17 +171,39 @@ void Mesh::setupMesh()
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    setupTextureUnits();
+
+    GLState::bindVertexArray(VAO);
     // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
     // A great thing about structs is that their memory layout is sequential for all its items.
     // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
     // again translates to 3/2 floats which translates to a byte array.
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
+    setupVertexAttributes();
+
+    // position stream for the depth pre-pass, sharing the index buffer
+    vector<glm::vec3> positions;
+    positions.reserve(vertices.size());
+    for (const Vertex &vertex : vertices)
+        positions.push_back(vertex.Position);
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &positionVBO);
+    GLState::bindVertexArray(depthVAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+    GLState::bindVertexArray(0);
+}
+
+void Mesh::setupVertexAttributes()
+{
     // set the vertex attribute pointers
     // vertex Positions
     glEnableVertexAttribArray(0);
@@ -77,5 +227,4 @@ void Mesh::setupMesh()
     // weights
     glEnableVertexAttribArray(6);
     glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, m_Weights));
-    glBindVertexArray(0);
-}
\ No newline at end of file
+}
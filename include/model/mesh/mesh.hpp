@@ -6,10 +6,14 @@
 #include <string>
 #include <vector>
 #include <shaders/shader.hpp>
+#include <model/textureArrayPool.hpp>
+#include <culling/bvh.hpp>
 
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
+// every texture type gets a fixed range of units, so sampler uniforms never change between meshes
+#define MAX_TEXTURES_PER_TYPE 3
 
 struct Vertex {
     glm::vec3 Position;
@@ -24,9 +28,10 @@ struct Vertex {
 };
 
 struct Texture{
-    unsigned int id;
+    unsigned int id; // 0 when the model is batched, the image is only in its layer then
     string type;
     string path;
+    TextureLayer layer; // inside the texture array pool, for batched drawing
 };
 
 class Mesh{
@@ -35,10 +40,38 @@ class Mesh{
         vector<unsigned int> indices;
         vector<Texture> textures;
         Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures) : vertices(vertices), indices(indices), textures(textures) {setupMesh();};
-        void Draw(Shader &shader, glm::mat4 modelMatrix, glm::mat4 projection, glm::mat4 viewMatrix);
+        // owns its GL objects: moves hand them over, copies are not allowed
+        Mesh(Mesh &&other) noexcept;
+        Mesh(const Mesh &) = delete;
+        Mesh &operator=(const Mesh &) = delete;
+        ~Mesh();
+        // draws once with the program in use, the caller sets its uniforms
+        void Draw();
+        // draws instanceCount copies, taking the model matrix from the buffer given to setupInstancing
+        void DrawInstanced(unsigned int instanceCount);
+        // position-only draw for the depth pre-pass, instanceCount 0 draws once without instancing
+        void DrawDepth(unsigned int instanceCount = 0);
+        // points attributes 7-10 (one mat4 per instance) at instanceVBO
+        void setupInstancing(unsigned int instanceVBO);
+        bool hasTexture(const string &type) const;
+        // nearest triangle hit in mesh space, both faces; distance is the limit going in and the hit
+        // (in units of direction) coming out. The triangle BVH is built on the first call
+        bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance);
+
+        static const char *textureTypes[4];
+        // texture unit for the number-th (1-based) texture of a type, -1 when out of range
+        static int textureUnit(const string &type, unsigned int number);
+        // attributes 0-6 for a Vertex buffer bound to GL_ARRAY_BUFFER, into the bound VAO
+        static void setupVertexAttributes();
     private:
-        unsigned int VAO, VBO, EBO;
+        unsigned int VAO = 0, VBO = 0, EBO = 0;
+        unsigned int depthVAO = 0, positionVBO = 0; // tightly packed positions, 12 bytes a vertex instead of sizeof(Vertex)
+        vector<int> textureUnits;       // unit per entry of textures
+        vector<unsigned int> emptyUnits; // first unit of each type this mesh has no texture for
+        BVH triangleBVH;                 // one item per triangle, empty until the first raycast
         void setupMesh();
+        void setupTextureUnits();
+        void bindTextures();
 };
 
 #endif // MESH_HPP
\ No newline at end of file
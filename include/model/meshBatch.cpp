@@ -0,0 +1,268 @@
+#include <model/meshBatch.hpp>
+#include <helpers/glExtensions.hpp>
+#include <helpers/glState.hpp>
+
+// std430 layout of MaterialEntry in materialTable.glsl
+struct BindlessMaterial {
+    GLuint64 diffusePage;
+    GLuint64 specularPage;
+    GLuint64 normalPage;
+    GLuint64 unused;
+    GLint layers[4];
+};
+
+MeshBatch *MeshBatch::build(const vector<Mesh> &meshes, unsigned int instanceVBO)
+{
+    static const char *types[3] = {"texture_diffuse", "texture_specular", "texture_normal"};
+
+    vector<TextureLayer> materials; // three per mesh
+    for (const Mesh &mesh : meshes)
+    {
+        for (const char *type : types)
+        {
+            TextureLayer layer;
+            for (const Texture &texture : mesh.textures)
+            {
+                if (texture.type == type)
+                {
+                    if (texture.layer.page < 0)
+                        return nullptr;
+                    layer = texture.layer;
+                    break;
+                }
+            }
+            materials.push_back(layer);
+        }
+    }
+
+    MeshBatch *batch = new MeshBatch();
+    batch->bindless = GLExtensions::bindlessTexture;
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<GLint> materialIndices;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        const Mesh &mesh = meshes[i];
+        int pages[3];
+        for (int t = 0; t < 3; t++)
+            pages[t] = batch->bindless ? -1 : materials[i * 3 + t].page;
+
+        DrawGroup *group = nullptr;
+        for (DrawGroup &candidate : batch->groups)
+        {
+            if (candidate.pages[0] == pages[0] && candidate.pages[1] == pages[1] && candidate.pages[2] == pages[2])
+                group = &candidate;
+        }
+        if (group == nullptr)
+        {
+            batch->groups.push_back(DrawGroup{{pages[0], pages[1], pages[2]}, {}, {}, {}});
+            group = &batch->groups.back();
+        }
+        group->counts.push_back((GLsizei)mesh.indices.size());
+        group->offsets.push_back((const void *)(indices.size() * sizeof(unsigned int)));
+        group->baseVertices.push_back((GLint)vertices.size());
+        batch->all.counts.push_back(group->counts.back());
+        batch->all.offsets.push_back(group->offsets.back());
+        batch->all.baseVertices.push_back(group->baseVertices.back());
+
+        vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        materialIndices.insert(materialIndices.end(), mesh.vertices.size(), (GLint)i);
+    }
+
+    glGenVertexArrays(1, &batch->VAO);
+    glGenBuffers(1, &batch->VBO);
+    glGenBuffers(1, &batch->EBO);
+    glGenBuffers(1, &batch->materialVBO);
+
+    GLState::bindVertexArray(batch->VAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, batch->VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    Mesh::setupVertexAttributes();
+
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        glEnableVertexAttribArray(7 + i);
+        glVertexAttribPointer(7 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * i));
+        glVertexAttribDivisor(7 + i, 1);
+    }
+
+    // material index
+    GLState::bindBuffer(GL_ARRAY_BUFFER, batch->materialVBO);
+    glBufferData(GL_ARRAY_BUFFER, materialIndices.size() * sizeof(GLint), materialIndices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(11);
+    glVertexAttribIPointer(11, 1, GL_INT, sizeof(GLint), (void *)0);
+
+    // position stream for the depth pre-pass
+    vector<glm::vec3> positions;
+    positions.reserve(vertices.size());
+    for (const Vertex &vertex : vertices)
+        positions.push_back(vertex.Position);
+    glGenVertexArrays(1, &batch->depthVAO);
+    glGenBuffers(1, &batch->positionVBO);
+    GLState::bindVertexArray(batch->depthVAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, batch->positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->EBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        glEnableVertexAttribArray(7 + i);
+        glVertexAttribPointer(7 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * i));
+        glVertexAttribDivisor(7 + i, 1);
+    }
+    GLState::bindVertexArray(0);
+
+    TextureArrayPool::generateMipmaps();
+
+    glGenBuffers(1, &batch->materialTable);
+    if (batch->bindless)
+    {
+        vector<BindlessMaterial> table(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            GLuint64 *handles[3] = {&table[i].diffusePage, &table[i].specularPage, &table[i].normalPage};
+            for (int t = 0; t < 3; t++)
+            {
+                const TextureLayer &layer = materials[i * 3 + t];
+                *handles[t] = layer.page >= 0 ? TextureArrayPool::pageHandle(layer.page) : 0;
+                table[i].layers[t] = layer.layer;
+            }
+            table[i].unused = 0;
+            table[i].layers[3] = 0;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch->materialTable);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, table.size() * sizeof(BindlessMaterial), table.data(), GL_STATIC_DRAW);
+        batch->materialTableTexture = 0;
+    }
+    else
+    {
+        vector<GLint> table;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            for (int t = 0; t < 3; t++)
+                table.push_back(materials[i * 3 + t].layer);
+            table.push_back(0);
+        }
+        GLState::bindBuffer(GL_TEXTURE_BUFFER, batch->materialTable);
+        glBufferData(GL_TEXTURE_BUFFER, table.size() * sizeof(GLint), table.data(), GL_STATIC_DRAW);
+        glGenTextures(1, &batch->materialTableTexture);
+        GLState::bindTexture(BATCH_MATERIAL_TABLE_UNIT, GL_TEXTURE_BUFFER, batch->materialTableTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, batch->materialTable);
+    }
+
+    if (GLExtensions::computeShader)
+    {
+        for (const DrawGroup &group : batch->groups)
+        {
+            for (size_t i = 0; i < group.counts.size(); i++)
+            {
+                GLuint firstIndex = (GLuint)((size_t)group.offsets[i] / sizeof(unsigned int));
+                batch->commands.push_back(IndirectCommand{(GLuint)group.counts[i], 0, firstIndex, group.baseVertices[i], 0});
+            }
+        }
+        batch->commandCount = (unsigned int)batch->commands.size();
+        glGenBuffers(1, &batch->commandBuffer);
+        GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, batch->commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, batch->commands.size() * sizeof(IndirectCommand), batch->commands.data(), GL_DYNAMIC_DRAW);
+    }
+
+    return batch;
+}
+
+MeshBatch::~MeshBatch()
+{
+    GLuint buffers[6] = {VBO, EBO, materialVBO, positionVBO, materialTable, commandBuffer};
+    GLState::deleteBuffers(6, buffers);
+    GLuint arrays[2] = {VAO, depthVAO};
+    GLState::deleteVertexArrays(2, arrays);
+    GLState::deleteTextures(1, &materialTableTexture);
+}
+
+void MeshBatch::bindMaterialTable()
+{
+    if (bindless)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, materialTable);
+    else
+        GLState::bindTexture(BATCH_MATERIAL_TABLE_UNIT, GL_TEXTURE_BUFFER, materialTableTexture);
+}
+
+void MeshBatch::bindPages(const DrawGroup &group)
+{
+    if (bindless)
+        return;
+    GLState::bindTexture(BATCH_DIFFUSE_PAGES_UNIT, GL_TEXTURE_2D_ARRAY, group.pages[0] >= 0 ? TextureArrayPool::page(group.pages[0]) : 0);
+    GLState::bindTexture(BATCH_SPECULAR_PAGES_UNIT, GL_TEXTURE_2D_ARRAY, group.pages[1] >= 0 ? TextureArrayPool::page(group.pages[1]) : 0);
+    GLState::bindTexture(BATCH_NORMAL_PAGES_UNIT, GL_TEXTURE_2D_ARRAY, group.pages[2] >= 0 ? TextureArrayPool::page(group.pages[2]) : 0);
+}
+
+void MeshBatch::Draw(unsigned int instanceCount, bool instanced, const std::function<void(unsigned int)> &setInstance)
+{
+    GLState::bindVertexArray(VAO);
+    bindMaterialTable();
+
+    for (const DrawGroup &group : groups)
+    {
+        bindPages(group);
+
+        if (instanced)
+        {
+            // core 3.3 has no instanced multi-draw, but the textures stay bound for the whole group
+            for (size_t i = 0; i < group.counts.size(); i++)
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, group.counts[i], GL_UNSIGNED_INT, group.offsets[i], (GLsizei)instanceCount, group.baseVertices[i]);
+            continue;
+        }
+
+        for (unsigned int instance = 0; instance < instanceCount; instance++)
+        {
+            setInstance(instance);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, group.counts.data(), GL_UNSIGNED_INT, group.offsets.data(), (GLsizei)group.counts.size(), group.baseVertices.data());
+        }
+    }
+}
+
+unsigned int MeshBatch::DrawDepth(Shader &shader, const vector<glm::mat4> &modelMatrix, bool instanced)
+{
+    GLState::bindVertexArray(depthVAO);
+    if (instanced)
+    {
+        for (size_t i = 0; i < all.counts.size(); i++)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, all.counts[i], GL_UNSIGNED_INT, all.offsets[i], (GLsizei)modelMatrix.size(), all.baseVertices[i]);
+        return (unsigned int)all.counts.size();
+    }
+
+    for (const glm::mat4 &matrix : modelMatrix)
+    {
+        shader.setMat4("model", matrix);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, all.counts.data(), GL_UNSIGNED_INT, all.offsets.data(), (GLsizei)all.counts.size(), all.baseVertices.data());
+    }
+    return (unsigned int)modelMatrix.size();
+}
+
+void MeshBatch::resetCommands()
+{
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(IndirectCommand), commands.data());
+}
+
+void MeshBatch::DrawIndirect()
+{
+    GLState::bindVertexArray(VAO);
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    bindMaterialTable();
+
+    size_t first = 0;
+    for (const DrawGroup &group : groups)
+    {
+        bindPages(group);
+        glextMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)(first * sizeof(IndirectCommand)), (GLsizei)group.counts.size(), 0);
+        first += group.counts.size();
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef MESH_BATCH_HPP
+#define MESH_BATCH_HPP
+
+#include <model/mesh/mesh.hpp>
+#include <functional>
+#include <vector>
+
+// texture units used by the batched path (the per-mesh path uses 0-11, see Mesh::textureUnit)
+#define BATCH_DIFFUSE_PAGES_UNIT 12
+#define BATCH_SPECULAR_PAGES_UNIT 13
+#define BATCH_NORMAL_PAGES_UNIT 14
+#define BATCH_MATERIAL_TABLE_UNIT 15
+
+// All meshes of a model merged into one vertex/index buffer, with a per-vertex material index
+// that the shader uses to find its texture layers. Meshes whose textures live in the same array
+// pages are drawn with one glMultiDrawElementsBaseVertex; with bindless textures the material
+// table holds page handles and every mesh goes into a single multi-draw.
+class MeshBatch {
+public:
+    // Returns nullptr when a mesh has a texture that did not make it into the TextureArrayPool
+    static MeshBatch *build(const vector<Mesh> &meshes, unsigned int instanceVBO);
+    // deletes the merged buffers, the material table and the command buffer; the texture pages stay in the pool
+    ~MeshBatch();
+
+    // Draws every mesh once per instance, calling setInstance(i) first to set that instance's uniforms;
+    // instanced: one draw for all, the matrices are already in instanceVBO and setInstance is not called
+    void Draw(unsigned int instanceCount, bool instanced, const std::function<void(unsigned int)> &setInstance);
+    // Positions only for depth passes; materials do not matter, so every mesh goes in one multi-draw.
+    // Returns the number of draw calls
+    unsigned int DrawDepth(Shader &shader, const vector<glm::mat4> &modelMatrix, bool instanced);
+
+    // GPU culled path (GLExtensions::computeShader): commandBuffer holds one indirect command per mesh,
+    // in group order. resetCommands() zeroes their instance counts, GPUCuller then counts the surviving
+    // instances into them and DrawIndirect() issues one glMultiDrawElementsIndirect per group
+    void resetCommands();
+    void DrawIndirect();
+
+    bool bindless;
+    unsigned int commandBuffer = 0; // 0 without compute support
+    unsigned int commandCount = 0;
+
+private:
+    struct DrawGroup {
+        int pages[3]; // diffuse, specular, normal page, -1 when unused
+        vector<GLsizei> counts;
+        vector<const void *> offsets;
+        vector<GLint> baseVertices;
+    };
+
+    unsigned int VAO, VBO, EBO, materialVBO;
+    unsigned int depthVAO, positionVBO;
+    unsigned int materialTable;        // TBO buffer or SSBO
+    unsigned int materialTableTexture; // TBO texture, 0 with bindless
+    // DrawElementsIndirectCommand, also declared in instanceCull_compute.glsl
+    struct IndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    vector<DrawGroup> groups;
+    DrawGroup all; // every mesh, for DrawDepth
+    vector<IndirectCommand> commands;
+
+    MeshBatch() {}
+    MeshBatch(const MeshBatch &) = delete;
+    MeshBatch &operator=(const MeshBatch &) = delete;
+    void bindMaterialTable();
+    void bindPages(const DrawGroup &group);
+};
+
+#endif // MESH_BATCH_HPP
@@ -1,68 +1,393 @@
 
 #include <model/model.hpp>
+#include <algorithm>
+#include <helpers/glState.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <scene/systems.hpp>
+
+bool Model::useTextureArrays = true;
+GPUCuller *Model::gpuCuller = nullptr;
+EntityStore Model::entities;
+
+// every instance entity has all of them
+static const ComponentMask INSTANCE_COMPONENTS = COMPONENT_BIT(TRANSFORM) | COMPONENT_BIT(WORLD_MATRIX) | COMPONENT_BIT(WORLD_BOUNDS) |
+                                                 COMPONENT_BIT(RENDER_HANDLE) | COMPONENT_BIT(NAME_ID) | COMPONENT_BIT(STABLE_ID);
 
 Model::Model(const char *path, const char *vertexShader, const char *fragShader, string name, bool gammaCorrection)
+    : Model(import(path), vertexShader, fragShader, name, gammaCorrection)
+{
+}
+
+Model::Model(const char *path, const char *vertexShader, const char *fragShader, string name, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, bool gammaCorrection)
 {
     this->gammaCorrection = gammaCorrection;
-    shader = new Shader(vertexShader, fragShader);
-    loadModel(path);
+    setup(import(path), vertexShader, fragShader);
+    addInstance(position, rotation, scale, name);
+}
 
-    std::filesystem::path relativePath(path);
-    std::filesystem::path absolutePath = std::filesystem::absolute(relativePath);
+Model::Model(const ModelImport &imported, const char *vertexShader, const char *fragShader, string name, bool gammaCorrection)
+{
+    this->gammaCorrection = gammaCorrection;
+    setup(imported, vertexShader, fragShader);
+    addInstance(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f), name);
+}
+
+void Model::setup(const ModelImport &imported, const char *vertexShader, const char *fragShader)
+{
+    material = new Material(new ShaderPermutations(vertexShader, fragShader));
+    setupSamplers();
 
+    // each image once, the meshes get copies of the entries that name them. Batched models keep
+    // their images in array pages only, the others as plain textures made once batching is out
+    for (const ModelImport::Image &image : imported.images)
+    {
+        Texture texture;
+        texture.id = 0;
+        if (useTextureArrays && image.pixels)
+            texture.layer = TextureArrayPool::add(image.pixels.get(), image.width, image.height, image.components);
+        texture.path = image.path;
+        textures_loaded.push_back(texture);
+    }
+    for (const ModelImport::MeshData &data : imported.meshes)
+    {
+        vector<Texture> textures;
+        for (const std::pair<string, unsigned int> &used : data.textures)
+        {
+            textures.push_back(textures_loaded[used.second]);
+            textures.back().type = used.first;
+        }
+        meshes.push_back(Mesh(data.vertices, data.indices, textures));
+    }
+
+    setupInstancing();
+    batch = useTextureArrays ? MeshBatch::build(meshes, instanceVBO) : nullptr;
+    if (batch == nullptr)
+    {
+        for (Texture &texture : textures_loaded)
+        {
+            TextureArrayPool::release(texture.layer);
+            texture.layer = TextureLayer();
+        }
+        for (unsigned int i = 0; i < imported.images.size(); i++)
+            textures_loaded[i].id = TextureFromImage(imported.images[i]);
+        for (unsigned int m = 0; m < meshes.size(); m++)
+        {
+            for (unsigned int t = 0; t < meshes[m].textures.size(); t++)
+            {
+                const Texture &loaded = textures_loaded[imported.meshes[m].textures[t].second];
+                meshes[m].textures[t].id = loaded.id;
+                meshes[m].textures[t].layer = loaded.layer;
+            }
+        }
+    }
+    computeBounds();
+    buildOccluder();
+    bytes = imported.bytes();
+
+    std::filesystem::path relativePath(imported.path);
+    std::filesystem::path absolutePath = std::filesystem::absolute(relativePath);
     directory = absolutePath.string();
-    if (instanceCount == 0)
+}
+
+Model::~Model(){
+    for (Entity entity : instanceEntities)
+        entities.destroy(entity);
+    entities.releaseGroup(this);
+    // the meshes delete their own buffers, the textures are shared between them so they go here
+    delete batch;
+    meshes.clear();
+    GLState::deleteBuffers(1, &instanceVBO);
+    for (Texture &texture : textures_loaded)
     {
-        addInstance(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f), name);
+        GLState::deleteTextures(1, &texture.id);
+        TextureArrayPool::release(texture.layer);
     }
+    // with its shader permutations, whose programs drop out of every material's records
+    delete material;
 }
 
-Model::Model(const char *path, const char *vertexShader, const char *fragShader, string name, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, bool gammaCorrection)
-{
-    this->gammaCorrection = gammaCorrection;
-    shader = new Shader(vertexShader, fragShader);
-    loadModel(path);
+void Model::Draw(glm::mat4 projection, glm::mat4 viewMatrix){
+    if (batched() ? batchShader == nullptr : meshShaders.size() != meshes.size())
+        selectShaders(lightDefines);
 
-    std::filesystem::path relativePath(path);
-    std::filesystem::path absolutePath = std::filesystem::absolute(relativePath);
+    updateModelMatrices();
+    material->setMat4("projection", projection);
+    material->setMat4("view", viewMatrix);
 
-    directory = absolutePath.string();
+    if (gpuCulled())
+    {
+        // the compute pass fills instanceVBO with the survivors and the commands with their count
+        GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, modelMatrix.size() * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+        instancesUploaded = false;
+        batch->resetCommands();
+        gpuCuller->cull(modelMatrix, localBounds, instanceVBO, batch->commandBuffer, batch->commandCount);
+
+        batchShader->use();
+        material->apply(*batchShader);
+        setInstanceUniforms(*batchShader, -1);
+        batch->DrawIndirect();
+        return;
+    }
 
-    this->transforms.push_back(Transform{position, rotation, scale});
+    visibleInstances.clear();
+    for (unsigned int j = 0; j < modelMatrix.size(); j++)
+    {
+        if (instanceVisible.size() != modelMatrix.size() || instanceVisible[j])
+            visibleInstances.push_back(j);
+    }
+    bool reuseUpload = instancesUploaded && visibleInstances.size() == modelMatrix.size();
+    instancesUploaded = false;
+    if (visibleInstances.empty())
+        return;
+    if (instanced && !reuseUpload)
+        uploadVisibleInstances();
+
+    if (batched())
+    {
+        batchShader->use();
+        material->apply(*batchShader);
+        if (instanced)
+            setInstanceUniforms(*batchShader, -1);
+        batch->Draw(static_cast<unsigned int>(visibleInstances.size()), instanced,
+                    [this](unsigned int instance) { setInstanceUniforms(*batchShader, visibleInstances[instance]); });
+        return;
+    }
 
+    if (instanced)
+    {
+        // one draw per mesh for all instances, the matrices come from the instance buffer
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Shader *shader = meshShaders[i];
+            shader->use();
+            material->apply(*shader);
+            setInstanceUniforms(*shader, -1);
+            meshes[i].DrawInstanced(static_cast<unsigned int>(visibleInstances.size()));
+        }
+        return;
+    }
 
-    if (instanceCount == 0)
+    for (unsigned int i = 0; i < meshes.size(); i++)
     {
-        addInstance(position, rotation, scale, name);
+        Shader *shader = meshShaders[i];
+        shader->use();
+        material->apply(*shader);
+        for (unsigned int j : visibleInstances)
+        {
+            setInstanceUniforms(*shader, j);
+            meshes[i].Draw();
+        }
     }
 }
 
-void Model::Draw(glm::mat4 projection, glm::mat4 viewMatrix){
+unsigned int Model::DrawDepth(ShaderPermutations *depthShaders, glm::mat4 projection, glm::mat4 viewMatrix){
+    updateModelMatrices();
+    instanced = modelMatrix.size() > 1;
+
+    ShaderDefines defines;
+    if (instanced)
+    {
+        defines["USE_INSTANCING"] = "";
+        uploadInstances();
+        instancesUploaded = true;
+    }
+    Shader *shader = depthShaders->get(defines);
+    shader->use();
+    shader->setMat4("projection", projection);
+    shader->setMat4("view", viewMatrix);
+
+    if (batched())
+        return batch->DrawDepth(*shader, modelMatrix, instanced);
+
+    unsigned int draws = 0;
     for (unsigned int i = 0; i < meshes.size(); i++)
     {
+        if (instanced)
+        {
+            meshes[i].DrawDepth(static_cast<unsigned int>(modelMatrix.size()));
+            draws++;
+            continue;
+        }
         for (unsigned int j = 0; j < modelMatrix.size(); j++)
         {
-            shader->use();
-            modelMatrix[j] = glm::mat4(1.0f);
-            modelMatrix[j] = glm::translate(modelMatrix[j], transforms[j].position);
-            modelMatrix[j] = glm::scale(modelMatrix[j], transforms[j].scale);
-            modelMatrix[j] = glm::rotate(modelMatrix[j], glm::radians(transforms[j].rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-            modelMatrix[j] = glm::rotate(modelMatrix[j], glm::radians(transforms[j].rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-            modelMatrix[j] = glm::rotate(modelMatrix[j], glm::radians(transforms[j].rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-            shader->setMat4("projection", projection);
-            shader->setMat4("view", viewMatrix);
             shader->setMat4("model", modelMatrix[j]);
-            meshes[i].Draw(*shader, modelMatrix[j], projection, viewMatrix);
+            meshes[i].DrawDepth();
+            draws++;
         }
     }
+    return draws;
 }
 
-int Model::addInstance(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, string name){
-    this->transforms.push_back(Transform{position, rotation, scale});
-    names.push_back(name);
+Bounds Model::instanceBounds(unsigned int instance) const{
+    if (instance >= instanceEntities.size())
+        return Bounds();
+    return *entities.get<Bounds>(instanceEntities[instance]);
+}
 
-    glm::mat4 modelMat(1.0f);
-    modelMatrix.push_back(modelMat);
+bool Model::raycast(unsigned int instance, const glm::vec3 &origin, const glm::vec3 &direction, float &distance){
+    if (instance >= instanceCount)
+        return false;
+    // the ray goes into model space unnormalized, so distances along it stay world space ones.
+    // The matrix comes from the entity store, modelMatrix is only as new as the last draw
+    glm::mat4 inverse = glm::inverse(*entities.get<glm::mat4>(instanceEntities[instance]));
+    glm::vec3 localOrigin(inverse * glm::vec4(origin, 1.0f));
+    glm::vec3 localDirection(inverse * glm::vec4(direction, 0.0f));
+    bool hit = false;
+    for (Mesh &mesh : meshes)
+        hit = mesh.raycast(localOrigin, localDirection, distance) || hit;
+    return hit;
+}
+
+void Model::computeBounds(){
+    localBounds = Bounds();
+    for (const Mesh &mesh : meshes)
+    {
+        for (const Vertex &vertex : mesh.vertices)
+            localBounds.add(vertex.Position);
+    }
+}
+
+void Model::buildOccluder(){
+    vector<glm::vec3> positions;
+    vector<unsigned int> indices;
+    for (const Mesh &mesh : meshes)
+    {
+        unsigned int base = static_cast<unsigned int>(positions.size());
+        for (const Vertex &vertex : mesh.vertices)
+            positions.push_back(vertex.Position);
+        for (unsigned int index : mesh.indices)
+            indices.push_back(base + index);
+    }
+    occluder = OccluderMesh::simplify(positions, indices, localBounds, 1024);
+}
+
+void Model::setInstanceUniforms(Shader &shader, int instance){
+    // per-draw values change on every draw, so they bypass the material
+    if (instance >= 0)
+        shader.setMat4("model", modelMatrix[instance]);
+    if (lightLists.size() != modelMatrix.size())
+        return;
+    const vector<int> &lights = instance >= 0 ? lightLists[instance] : sharedLightList;
+    shader.setInt("objectLightCount", (int)lights.size());
+    if (!lights.empty())
+        shader.setIntArray("objectLights", lights.data(), (int)lights.size());
+}
+
+void Model::uploadInstances(){
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, modelMatrix.size() * sizeof(glm::mat4), modelMatrix.data(), GL_STREAM_DRAW);
+}
+
+void Model::uploadVisibleInstances(){
+    if (visibleInstances.size() == modelMatrix.size())
+    {
+        uploadInstances();
+        return;
+    }
+    FrameVector<glm::mat4> visible;
+    visible.reserve(visibleInstances.size());
+    for (unsigned int j : visibleInstances)
+        visible.push_back(modelMatrix[j]);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, visible.size() * sizeof(glm::mat4), visible.data(), GL_STREAM_DRAW);
+}
+
+void Model::updateModelMatrices(){
+    gatherWorldMatrices(entities, this, modelMatrix);
+}
+
+void Model::selectShaders(const ShaderDefines &lightDefines){
+    bool nowInstanced = modelMatrix.size() > 1;
+    bool nowBatched = batched();
+
+    // the define sets only change with the light state, so they are built then and reused every other frame
+    if (variantDefines.empty() || lightDefines != this->lightDefines || nowInstanced != instanced || nowBatched != definesBatched)
+    {
+        this->lightDefines = lightDefines;
+        instanced = nowInstanced;
+        definesBatched = nowBatched;
+        variantDefines.clear();
+        if (nowBatched)
+        {
+            // one variant for every mesh, the material table replaces the per-mesh defines
+            ShaderDefines defines = lightDefines;
+            defines["USE_TEXTURE_ARRAY"] = "";
+            if (batch->bindless)
+            {
+                defines["USE_BINDLESS"] = "";
+                defines["GLSL_VERSION"] = "430 core";
+            }
+            if (instanced)
+                defines["USE_INSTANCING"] = "";
+            variantDefines.push_back(defines);
+        }
+        else
+        {
+            for (unsigned int i = 0; i < meshes.size(); i++)
+            {
+                ShaderDefines defines = lightDefines;
+                if (meshes[i].hasTexture("texture_normal"))
+                    defines["USE_NORMAL_MAP"] = "";
+                if (instanced)
+                    defines["USE_INSTANCING"] = "";
+                variantDefines.push_back(defines);
+            }
+        }
+    }
+
+    activeShaders.clear();
+    if (nowBatched)
+    {
+        batchShader = material->shaders->get(variantDefines[0]);
+        activeShaders.push_back(batchShader);
+        meshShaders.clear();
+        return;
+    }
+
+    batchShader = nullptr;
+    meshShaders.resize(meshes.size());
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        meshShaders[i] = material->shaders->get(variantDefines[i]);
+        if (std::find(activeShaders.begin(), activeShaders.end(), meshShaders[i]) == activeShaders.end())
+            activeShaders.push_back(meshShaders[i]);
+    }
+}
+
+void Model::setupSamplers(){
+    // texture units are fixed per type and number (see Mesh::textureUnit), so this is set once
+    for (const char *type : Mesh::textureTypes)
+    {
+        for (unsigned int number = 1; number <= MAX_TEXTURES_PER_TYPE; number++)
+            material->setInt("material." + string(type) + to_string(number), Mesh::textureUnit(type, number));
+    }
+    material->setInt("diffusePages", BATCH_DIFFUSE_PAGES_UNIT);
+    material->setInt("specularPages", BATCH_SPECULAR_PAGES_UNIT);
+    material->setInt("normalPages", BATCH_NORMAL_PAGES_UNIT);
+    material->setInt("materialTable", BATCH_MATERIAL_TABLE_UNIT);
+}
+
+void Model::setupInstancing(){
+    glGenBuffers(1, &instanceVBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i].setupInstancing(instanceVBO);
+}
+
+int Model::addInstance(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, string name){
+    // world matrix and bounds are filled right away, the per-frame passes keep them current after that
+    Entity entity = entities.create(INSTANCE_COMPONENTS, this);
+    Transform transform{position, rotation, scale};
+    *entities.get<Transform>(entity) = transform;
+    glm::mat4 matrix = worldMatrix(transform);
+    *entities.get<glm::mat4>(entity) = matrix;
+    *entities.get<Bounds>(entity) = transformBounds(localBounds, matrix);
+    *entities.get<RenderHandle>(entity) = RenderHandle{this, instanceCount};
+    entities.get<NameId>(entity)->value = entities.intern(name);
+    instanceEntities.push_back(entity);
+    modelMatrix.push_back(matrix);
 
     std::hash<std::string> str_hash;
     std::hash<float> float_hash;
@@ -71,50 +396,78 @@ int Model::addInstance(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale,
     h ^= float_hash(position.x) + 0x9e3779b9 + (h << 6) + (h >> 2);
     h ^= float_hash(position.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
     h ^= float_hash(position.z) + 0x9e3779b9 + (h << 6) + (h >> 2);
-    h ^= float_hash(instanceCount) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= float_hash(spawnCount) + 0x9e3779b9 + (h << 6) + (h >> 2);
 
-    Hash_ID.push_back(h);
+    entities.get<StableId>(entity)->value = h;
+    spawnCount++;
     instanceCount++;
     return instanceCount - 1;
 }
 
-void Model::loadModel(string const &path) {
+void Model::removeInstance(unsigned int instance){
+    if (instance >= instanceCount)
+        return;
+    entities.destroy(instanceEntities[instance]);
+    unsigned int last = instanceCount - 1;
+    if (instance != last)
+    {
+        instanceEntities[instance] = instanceEntities[last];
+        entities.get<RenderHandle>(instanceEntities[instance])->instance = instance;
+        if (modelMatrix.size() == instanceCount)
+            modelMatrix[instance] = modelMatrix[last];
+        if (instanceVisible.size() == instanceCount)
+            instanceVisible[instance] = instanceVisible[last];
+        if (lightLists.size() == instanceCount)
+            lightLists[instance].swap(lightLists[last]);
+    }
+    instanceEntities.pop_back();
+    if (modelMatrix.size() == instanceCount)
+        modelMatrix.pop_back();
+    if (instanceVisible.size() == instanceCount)
+        instanceVisible.pop_back();
+    if (lightLists.size() == instanceCount)
+        lightLists.pop_back();
+    instanceCount--;
+}
+
+ModelImport Model::import(const string &path) {
+    ModelImport imported;
+    imported.path = path;
     Assimp::Importer importer;
     const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
     // check for errors
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
         cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-        return;
+        return imported;
     }
-    // retrieve the directory path of the filepath
-    this->directory = path.substr(0, path.find_last_of('/'));
 
     // process ASSIMP's root node recursively
-    processNode(scene->mRootNode, scene);
+    importNode(scene->mRootNode, scene, imported);
+    return imported;
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene)
+void Model::importNode(aiNode *node, const aiScene *scene, ModelImport &imported)
 {
     for(unsigned int i = 0; i < node->mNumMeshes; i++){
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        importMesh(mesh, scene, imported);
     }
     for(unsigned int i = 0; i < node->mNumChildren; i++){
-        processNode(node->mChildren[i], scene);
+        importNode(node->mChildren[i], scene, imported);
     }
 }
 
 void Model::reloadShader() {
-    string vertexPath = shader->vertex;
-    string fragmentPath = shader->fragment;
-    shader = new Shader(vertexPath.c_str(), fragmentPath.c_str());
+    // variants are recompiled from disk the next time they are selected
+    material->shaders->reload();
+    selectShaders(lightDefines);
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene){
-    vector<Vertex> vertices;
-    vector<unsigned int> indices;
-    vector<Texture> textures;
+void Model::importMesh(aiMesh *mesh, const aiScene *scene, ModelImport &imported){
+    ModelImport::MeshData data;
+    vector<Vertex> &vertices = data.vertices;
+    vector<unsigned int> &indices = data.indices;
 
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -167,89 +520,76 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene){
 
     aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
 
-    vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    importTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data, imported);
+    importTextures(material, aiTextureType_SPECULAR, "texture_specular", data, imported);
+    importTextures(material, aiTextureType_HEIGHT, "texture_normal", data, imported);
+    importTextures(material, aiTextureType_AMBIENT, "texture_height", data, imported);
 
-    vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-
-    vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-
-    vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-    return Mesh(vertices, indices, textures);
+    imported.meshes.push_back(std::move(data));
 }
 
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName){
-    vector<Texture> textures;
-
+void Model::importTextures(aiMaterial *mat, aiTextureType type, string typeName, ModelImport::MeshData &mesh, ModelImport &imported){
     for(unsigned int i = 0; i < mat->GetTextureCount(type); i++){
         aiString str;
         mat->GetTexture(type, i, &str);
-        bool skip = false;
-        for(unsigned int j = 0; j < textures_loaded.size(); j++){
-            if (std::strcmp(textures_loaded[i].path.data(), str.C_Str()) == 0){
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-        if (!skip)
+        unsigned int image = 0;
+        while (image < imported.images.size() && imported.images[image].path != str.C_Str())
+            image++;
+        if (image == imported.images.size())
         {
-            Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory, false);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture);
+            // paths are used as they are, relative to the working directory
+            ModelImport::Image decoded;
+            decoded.path = str.C_Str();
+            decoded.pixels.reset(stbi_load(decoded.path.c_str(), &decoded.width, &decoded.height, &decoded.components, 0));
+            if (!decoded.pixels)
+                std::cout << "Texture failed to load at path: " << decoded.path << std::endl;
+            imported.images.push_back(std::move(decoded));
         }
+        mesh.textures.push_back({typeName, image});
     }
-
-    return textures;
 }
 
-unsigned int Model::TextureFromFile(const char *path, const string &directory, bool gamma){
-    
-    //cout << path << endl;
-    string filename = string(path);
-    filename = directory + '/' + filename;
-    filename = path;
-
-    //cout << filename << endl;
-
+unsigned int Model::TextureFromImage(const ModelImport::Image &image){
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.pixels)
     {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.components == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.components == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.components == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        GLState::bindTexture(0, GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
 
-        stbi_image_free(data);
+    return textureID;
+}
+
+size_t ModelImport::bytes() const
+{
+    size_t total = 0;
+    for (const MeshData &mesh : meshes)
+    {
+        // per-mesh buffers plus the batch's merged copy with its material index, each with a position stream
+        size_t vertexBytes = mesh.vertices.size() * (sizeof(Vertex) + sizeof(glm::vec3));
+        total += 2 * (vertexBytes + mesh.indices.size() * sizeof(unsigned int)) + mesh.vertices.size() * sizeof(GLint);
     }
-    else
+    for (const Image &image : images)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        // the texture or its array layer, with a mip chain and RGBA8 at worst
+        if (image.pixels)
+            total += (size_t)image.width * (size_t)image.height * 4 * 4 / 3;
     }
-
-    return textureID;
-}
\ No newline at end of file
+    return total;
+}
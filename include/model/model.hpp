@@ -2,47 +2,142 @@
 #define MODEL_H
 #include <glm/gtc/matrix_transform.hpp>
 #include <model/mesh/mesh.hpp>
+#include <model/meshBatch.hpp>
+#include <helpers/bounds.hpp>
+#include <scene/entityStore.hpp>
+#include <culling/occlusionCuller.hpp>
+#include <culling/gpuCuller.hpp>
+#include <shaders/material.hpp>
 #include <assimp/Importer.hpp>      // for Assimp::Importer
 #include <assimp/scene.h>           // for aiScene
 #include <assimp/postprocess.h>     // for post-processing flags
 #include <loaders/stb_image.h>
 #include <filesystem>
 #include <functional>
+#include <memory>
 #include <string>
 #include <iostream>
 
-struct Transform{
-    glm::vec3 position;
-    glm::vec3 rotation;
-    glm::vec3 scale;
+// CPU half of loading a model file: the Assimp scene flattened into meshes, and the decoded images.
+// Model::import() makes it without touching GL, so it can run on any thread; the Model constructor
+// taking it only uploads
+struct ModelImport {
+    struct FreeImage {
+        void operator()(unsigned char *pixels) const { stbi_image_free(pixels); }
+    };
+    struct Image {
+        string path;
+        int width = 0, height = 0, components = 0;
+        std::unique_ptr<unsigned char, FreeImage> pixels; // null when it failed to load
+    };
+    struct MeshData {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        vector<std::pair<string, unsigned int>> textures; // type and index into images
+    };
+
+    string path;
+    vector<MeshData> meshes;
+    vector<Image> images; // each file once, meshes share them
+    // GPU memory the model will take: meshes, the batched copy and textures with mips, all rough
+    size_t bytes() const;
 };
 
 class Model{
     public:
         Model (const char* path, const char* vertexShader, const char* fragShader, string name, bool gammaCorrection = false);
         Model (const char* path, const char* vertexShader, const char* fragShader, string name, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, bool gammaCorrection = false);
+        // uploads a model imported beforehand (possibly on another thread), with one instance at the origin
+        Model (const ModelImport &imported, const char* vertexShader, const char* fragShader, string name, bool gammaCorrection = false);
+        static ModelImport import(const string &path);
+        ~Model();
+        Model(const Model &) = delete;
+        Model &operator=(const Model &) = delete;
         int addInstance(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, string name = "empty");
+        // swap and pop: the last instance takes the removed one's index (its handle stays valid)
+        void removeInstance(unsigned int instance);
         void Draw(glm::mat4 projection, glm::mat4 viewMatrix);
+        // depth-only draw from the position streams, with a variant of depthShaders (depthOnly_*.glsl)
+        // returns the number of draw calls issued
+        unsigned int DrawDepth(ShaderPermutations *depthShaders, glm::mat4 projection, glm::mat4 viewMatrix);
+        // copies the instances' world matrices out of the entity store into modelMatrix, Draw does this itself
+        void updateModelMatrices();
+        // world space box of one instance, as of the last updateWorldBounds() pass
+        Bounds instanceBounds(unsigned int instance) const;
+        // nearest hit of a world space ray with the instance's triangles, placed by the world matrix of
+        // the last updateWorldMatrices() pass; distance is the limit going in and the hit coming out
+        bool raycast(unsigned int instance, const glm::vec3 &origin, const glm::vec3 &direction, float &distance);
         void reloadShader();
+        // picks the cheapest permutation per mesh for the given light state, adding the
+        // mesh's own material defines (normal map) and instancing when there is more than one instance
+        void selectShaders(const ShaderDefines &lightDefines);
+
+        // models loaded while this is set draw through MeshBatch (texture arrays or bindless) when their
+        // textures allow it; their images then live in the array pages only, so it does not change them later
+        static bool useTextureArrays;
+        // when set, instanced batched models cull on the GPU and draw indirect; instanceVisible is ignored for them
+        static GPUCuller *gpuCuller;
+        bool gpuCulled() const { return gpuCuller != nullptr && batched() && batch->commandBuffer != 0 && modelMatrix.size() > 1; }
 
-        Shader *shader;
-        vector<size_t> Hash_ID;
+        Material *material; // owns the shader permutations and their uniform values
+        vector<Shader *> activeShaders; // distinct variants picked by the last selectShaders()
+        Bounds localBounds;             // of every mesh, in model space
+        // point lights reaching each instance (indices into LightCulling's buffer), and the list
+        // shared by an instanced draw; empty when lights are not culled per object
+        vector<vector<int>> lightLists;
+        vector<int> sharedLightList;
+        bool castsShadows = true;
+        // simplified copy of every mesh for OcclusionCuller, occludes others when isOccluder
+        OccluderMesh occluder;
+        bool isOccluder = true;
+        // per instance, cleared entries are skipped by Draw; empty draws everything
+        vector<bool> instanceVisible;
+
+        // Instance state lives in the entity store, one entity per instance (grouped by model, see systems.hpp)
+        static EntityStore entities;
+        vector<Entity> instanceEntities;
         unsigned int instanceCount = 0;
-        vector<string> names;
-        vector<Transform> transforms;
+        unsigned int spawnCount = 0; // instances ever added, salts the stable ID so it never repeats
+        Transform &transform(unsigned int instance) { return *entities.get<Transform>(instanceEntities[instance]); }
+        size_t id(unsigned int instance) const { return entities.get<StableId>(instanceEntities[instance])->value; }
+        const string &name(unsigned int instance) const { return entities.nameOf(entities.get<NameId>(instanceEntities[instance])->value); }
+        // draw list built by updateModelMatrices(), in instance order, the layout of instanceVBO
         vector<glm::mat4> modelMatrix;
         string directory;
+        size_t bytes = 0; // ModelImport::bytes() of what it was made from
     private:
         bool gammaCorrection;
         vector<Texture> textures_loaded;
         vector<Mesh> meshes;
+        vector<Shader *> meshShaders;
+        MeshBatch *batch = nullptr;
+        Shader *batchShader = nullptr;
+        ShaderDefines lightDefines;
+        bool instanced = false;
+        vector<ShaderDefines> variantDefines; // of each mesh (one when batched), for lightDefines and instanced
+        bool definesBatched = false;
+        bool instancesUploaded = false; // DrawDepth already filled instanceVBO for the coming Draw
+        vector<unsigned int> visibleInstances; // instances Draw submits, in instanceVBO order
+        unsigned int instanceVBO = 0;
+
+        // everything but the first instance
+        void setup(const ModelImport &imported, const char *vertexShader, const char *fragShader);
+        void setupSamplers();
+        void setupInstancing();
+        void uploadInstances();
+        // uploads only the instances in visibleInstances
+        void uploadVisibleInstances();
+        // per-draw uniforms: instance >= 0 its model matrix and light list, -1 the shared list
+        void setInstanceUniforms(Shader &shader, int instance);
+        void computeBounds();
+        void buildOccluder();
+        bool batched() const { return batch != nullptr; }
 
-        void loadModel(string const &path);
-        void processNode(aiNode *node, const aiScene *scene);
-        Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+        static void importNode(aiNode *node, const aiScene *scene, ModelImport &imported);
+        static void importMesh(aiMesh *mesh, const aiScene *scene, ModelImport &imported);
+        static void importTextures(aiMaterial *mat, aiTextureType type, string typeName, ModelImport::MeshData &mesh, ModelImport &imported);
 
-        vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName);
-        unsigned int TextureFromFile(const char *path, const string &directory, bool gamma);
+        unsigned int TextureFromImage(const ModelImport::Image &image);
 };
 
 #endif
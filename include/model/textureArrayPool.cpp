@@ -0,0 +1,152 @@
+#include <model/textureArrayPool.hpp>
+#include <helpers/glExtensions.hpp>
+#include <helpers/glState.hpp>
+#include <algorithm>
+
+std::vector<TextureArrayPool::Page> TextureArrayPool::pages;
+size_t TextureArrayPool::pageBytesBudget = 64 * 1024 * 1024;
+
+TextureLayer TextureArrayPool::add(const unsigned char *data, int width, int height, int components)
+{
+    GLenum internalFormat, format;
+    if (components == 1)
+    {
+        internalFormat = GL_R8;
+        format = GL_RED;
+    }
+    else if (components == 3)
+    {
+        internalFormat = GL_RGB8;
+        format = GL_RGB;
+    }
+    else if (components == 4)
+    {
+        internalFormat = GL_RGBA8;
+        format = GL_RGBA;
+    }
+    else
+    {
+        return TextureLayer();
+    }
+
+    int index = -1;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        const Page &page = pages[i];
+        if (page.width == width && page.height == height && page.internalFormat == internalFormat &&
+            (page.used < page.capacity || !page.freed.empty()) && page.handle == 0)
+        {
+            index = (int)i;
+            break;
+        }
+    }
+    if (index < 0)
+        index = createPage(width, height, internalFormat, format);
+
+    Page &page = pages[index];
+    GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, page.texture);
+    // rows of RGB/R8 images are not 4-byte aligned in general
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    TextureLayer result;
+    result.page = index;
+    if (page.freed.empty())
+    {
+        result.layer = page.used++;
+    }
+    else
+    {
+        result.layer = page.freed.back();
+        page.freed.pop_back();
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, result.layer, width, height, 1, format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    page.dirty = true;
+    return result;
+}
+
+void TextureArrayPool::release(TextureLayer layer)
+{
+    if (layer.page < 0 || layer.page >= (int)pages.size() || pages[layer.page].texture == 0)
+        return;
+    Page &page = pages[layer.page];
+    page.freed.push_back(layer.layer);
+    if ((int)page.freed.size() < page.used)
+        return;
+    if (page.handle != 0)
+        glextMakeTextureHandleNonResident(page.handle);
+    GLState::deleteTextures(1, &page.texture);
+    page = Page();
+}
+
+int TextureArrayPool::createPage(int width, int height, GLenum internalFormat, GLenum format)
+{
+    GLint maxLayers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+    size_t layerBytes = (size_t)width * (size_t)height * 4 * 4 / 3; // RGBA8 with mips, worst case
+    int capacity = (int)std::min<size_t>(std::max<size_t>(pageBytesBudget / layerBytes, 1), (size_t)std::min(maxLayers, 256));
+
+    Page page{};
+    page.width = width;
+    page.height = height;
+    page.internalFormat = internalFormat;
+    page.format = format;
+    page.capacity = capacity;
+    page.used = 0;
+    page.dirty = false;
+    page.handle = 0;
+
+    glGenTextures(1, &page.texture);
+    GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, page.texture);
+    // every level is allocated up front so filling layers later never respecifies the texture
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2)
+        levels++;
+    for (int level = 0; level < levels; level++)
+    {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, std::max(width >> level, 1), std::max(height >> level, 1),
+                     capacity, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        if (pages[i].texture == 0)
+        {
+            pages[i] = page;
+            return (int)i;
+        }
+    }
+    pages.push_back(page);
+    return (int)pages.size() - 1;
+}
+
+void TextureArrayPool::generateMipmaps()
+{
+    for (Page &page : pages)
+    {
+        if (!page.dirty)
+            continue;
+        GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, page.texture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        page.dirty = false;
+    }
+}
+
+GLuint64 TextureArrayPool::pageHandle(int index)
+{
+    if (!GLExtensions::bindlessTexture)
+        return 0;
+    Page &page = pages[index];
+    if (page.handle == 0)
+    {
+        if (page.dirty)
+            generateMipmaps();
+        page.handle = glextGetTextureHandle(page.texture);
+        glextMakeTextureHandleResident(page.handle);
+    }
+    return page.handle;
+}
@@ -0,0 +1,55 @@
+#ifndef TEXTURE_ARRAY_POOL_HPP
+#define TEXTURE_ARRAY_POOL_HPP
+
+#include <glad/glad.h>
+#include <vector>
+#include <cstddef>
+
+// Where an image ended up inside the pool
+struct TextureLayer {
+    int page = -1;
+    int layer = -1;
+};
+
+// Packs images of the same size and format into the layers of GL_TEXTURE_2D_ARRAY pages, so
+// meshes whose textures share pages can be drawn together and pick their layer in the shader.
+// With ARB_bindless_texture each page also gets a resident handle; a page is sealed (no new
+// layers) once its handle exists, because a texture with a handle may no longer be respecified.
+// Released layers are refilled by later images; a page whose layers are all released is deleted.
+class TextureArrayPool {
+public:
+    // Copies a tightly packed 8-bit image with 1, 3 or 4 components into a free layer
+    static TextureLayer add(const unsigned char *data, int width, int height, int components);
+    // Gives a layer back, deleting its page once no layer of it is in use
+    static void release(TextureLayer layer);
+    // Rebuilds the mip chains of the pages that received layers since the last call
+    static void generateMipmaps();
+
+    static GLuint page(int index) { return pages[index].texture; }
+    // Resident bindless handle of a page, 0 without ARB_bindless_texture
+    static GLuint64 pageHandle(int index);
+    static size_t pageCount() { return pages.size(); }
+
+    static size_t pageBytesBudget; // rough upper bound for one page, decides how many layers it gets
+
+private:
+    struct Page {
+        GLuint texture;
+        int width;
+        int height;
+        GLenum internalFormat;
+        GLenum format;
+        int capacity;
+        int used;               // layers handed out so far, released ones included
+        std::vector<int> freed; // released layers below used
+        bool dirty;
+        GLuint64 handle;
+    };
+
+    static std::vector<Page> pages;
+
+    // slots of deleted pages have texture 0, they are reused so page indices stay put
+    static int createPage(int width, int height, GLenum internalFormat, GLenum format);
+};
+
+#endif // TEXTURE_ARRAY_POOL_HPP
@@ -0,0 +1,81 @@
+#ifndef BINARY_STREAM_HPP
+#define BINARY_STREAM_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Raw little helpers for the scene file and journal: values go out in the machine's byte order
+inline void putBytes(std::vector<unsigned char> &out, const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+template <typename T> void put(std::vector<unsigned char> &out, const T &value) { putBytes(out, &value, sizeof(T)); }
+
+template <typename T> void putArray(std::vector<unsigned char> &out, const std::vector<T> &values)
+{
+    if (!values.empty())
+        putBytes(out, values.data(), values.size() * sizeof(T));
+}
+
+// length, then the characters
+inline void putString(std::vector<unsigned char> &out, const std::string &text)
+{
+    put(out, (unsigned int)text.size());
+    putBytes(out, text.data(), text.size());
+}
+
+// Bounds checked cursor over bytes in memory; once a read runs past the end, ok stays false
+// and every later read returns zeros
+struct ByteReader {
+    const unsigned char *at;
+    const unsigned char *end;
+    bool ok = true;
+
+    size_t remaining() const { return (size_t)(end - at); }
+
+    void bytes(void *destination, size_t size)
+    {
+        if (!ok || remaining() < size)
+        {
+            ok = false;
+            return;
+        }
+        std::memcpy(destination, at, size);
+        at += size;
+    }
+    template <typename T> T read()
+    {
+        T value{};
+        bytes(&value, sizeof(T));
+        return value;
+    }
+    template <typename T> void array(std::vector<T> &values, size_t count)
+    {
+        if (!ok || count > remaining() / sizeof(T))
+        {
+            ok = false;
+            return;
+        }
+        values.resize(count);
+        if (count > 0)
+            bytes(values.data(), count * sizeof(T));
+    }
+    std::string string()
+    {
+        unsigned int length = read<unsigned int>();
+        if (!ok || length > remaining())
+        {
+            ok = false;
+            return std::string();
+        }
+        std::string text(reinterpret_cast<const char *>(at), length);
+        at += length;
+        return text;
+    }
+};
+
+#endif // BINARY_STREAM_HPP
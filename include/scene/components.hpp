@@ -0,0 +1,57 @@
+#ifndef COMPONENTS_HPP
+#define COMPONENTS_HPP
+
+#include <glm/glm.hpp>
+#include <helpers/bounds.hpp>
+#include <cstddef>
+
+class Model;
+
+// Component types of the entity store. Each one is plain data (chunks move them with memcpy)
+struct Transform{
+    glm::vec3 position;
+    glm::vec3 rotation; // degrees, applied x, y then z
+    glm::vec3 scale;
+};
+
+// world matrix is a plain glm::mat4, world bounds a plain Bounds
+
+// which model draws the entity, and its index in that model's instance arrays
+struct RenderHandle {
+    Model *model;
+    unsigned int instance;
+};
+
+// interned by EntityStore::intern, so an instance carries no string of its own
+struct NameId {
+    unsigned int value;
+};
+
+// survives save and load, SceneIndex looks instances up by it
+struct StableId {
+    size_t value;
+};
+
+enum ComponentType {
+    TRANSFORM,
+    WORLD_MATRIX,
+    WORLD_BOUNDS,
+    RENDER_HANDLE,
+    NAME_ID,
+    STABLE_ID,
+    COMPONENT_TYPES
+};
+
+typedef unsigned int ComponentMask;
+#define COMPONENT_BIT(type) (1u << (type))
+
+// type of a component struct, for EntityStore::get and Chunk::array
+template <typename T> struct Component;
+template <> struct Component<Transform> { static const ComponentType type = TRANSFORM; };
+template <> struct Component<glm::mat4> { static const ComponentType type = WORLD_MATRIX; };
+template <> struct Component<Bounds> { static const ComponentType type = WORLD_BOUNDS; };
+template <> struct Component<RenderHandle> { static const ComponentType type = RENDER_HANDLE; };
+template <> struct Component<NameId> { static const ComponentType type = NAME_ID; };
+template <> struct Component<StableId> { static const ComponentType type = STABLE_ID; };
+
+#endif // COMPONENTS_HPP
@@ -0,0 +1,187 @@
+#include <scene/entityStore.hpp>
+#include <algorithm>
+#include <cstring>
+
+static const size_t componentSizes[COMPONENT_TYPES] = {
+    sizeof(Transform), sizeof(glm::mat4), sizeof(Bounds), sizeof(RenderHandle), sizeof(NameId), sizeof(StableId),
+};
+
+// component arrays start on this boundary inside a chunk
+static const size_t ARRAY_ALIGNMENT = 16;
+
+EntityStore::Archetype &EntityStore::archetype(ComponentMask mask)
+{
+    for (Archetype &existing : archetypes)
+    {
+        if (existing.mask == mask)
+            return existing;
+    }
+
+    archetypes.emplace_back();
+    Archetype &created = archetypes.back();
+    created.mask = mask;
+    size_t rowBytes = 0;
+    for (int type = 0; type < COMPONENT_TYPES; type++)
+    {
+        if (mask & COMPONENT_BIT(type))
+            rowBytes += componentSizes[type];
+    }
+    // padding of every array is taken off the chunk first, so capacity rows always fit
+    size_t usable = CHUNK_BYTES - ARRAY_ALIGNMENT * COMPONENT_TYPES;
+    created.capacity = rowBytes == 0 ? 1024 : (unsigned int)std::max<size_t>(1, usable / rowBytes);
+    size_t offset = 0;
+    for (int type = 0; type < COMPONENT_TYPES; type++)
+    {
+        created.offsets[type] = offset;
+        if (mask & COMPONENT_BIT(type))
+            offset = (offset + componentSizes[type] * created.capacity + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+    }
+    return created;
+}
+
+Chunk *EntityStore::chunkWithRoom(Archetype &archetype, const void *group)
+{
+    std::vector<unsigned int> *open = archetype.openChunks.find(group);
+    if (open == nullptr)
+    {
+        archetype.openChunks.insert(group, std::vector<unsigned int>());
+        open = archetype.openChunks.find(group);
+    }
+    if (!open->empty())
+        return archetype.chunks[open->back()].get();
+
+    std::unique_ptr<Chunk> chunk(new Chunk());
+    chunk->mask = archetype.mask;
+    chunk->group = group;
+    chunk->index = (unsigned int)archetype.chunks.size();
+    chunk->capacity = archetype.capacity;
+    std::memcpy(chunk->offsets, archetype.offsets, sizeof(chunk->offsets));
+    chunk->entities.resize(archetype.capacity);
+    chunk->data.resize(CHUNK_BYTES);
+    open->push_back(chunk->index);
+    archetype.chunks.push_back(std::move(chunk));
+    return archetype.chunks.back().get();
+}
+
+Entity EntityStore::create(ComponentMask mask, const void *group)
+{
+    Archetype &owner = archetype(mask);
+    Chunk *chunk = chunkWithRoom(owner, group);
+    unsigned int index;
+    if (!freeIndices.empty())
+    {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    }
+    else
+    {
+        index = (unsigned int)records.size();
+        records.emplace_back();
+    }
+    Entity entity = ((Entity)records[index].generation << 32) | index;
+
+    unsigned int row = chunk->count++;
+    if (chunk->count == chunk->capacity)
+        owner.openChunks.find(group)->pop_back();
+    for (int type = 0; type < COMPONENT_TYPES; type++)
+    {
+        if (chunk->has((ComponentType)type))
+            std::memset(chunk->data.data() + chunk->offsets[type] + row * componentSizes[type], 0, componentSizes[type]);
+    }
+    chunk->entities[row] = entity;
+    records[index].chunk = chunk;
+    records[index].row = row;
+    entityCount++;
+    return entity;
+}
+
+void EntityStore::destroy(Entity entity)
+{
+    if (!alive(entity))
+        return;
+    unsigned int index = entityIndex(entity);
+    Chunk *chunk = records[index].chunk;
+    unsigned int row = records[index].row;
+    unsigned int last = --chunk->count;
+    if (row != last)
+    {
+        for (int type = 0; type < COMPONENT_TYPES; type++)
+        {
+            if (!chunk->has((ComponentType)type))
+                continue;
+            unsigned char *array = chunk->data.data() + chunk->offsets[type];
+            std::memcpy(array + row * componentSizes[type], array + last * componentSizes[type], componentSizes[type]);
+        }
+        Entity moved = chunk->entities[last];
+        chunk->entities[row] = moved;
+        records[entityIndex(moved)].row = row;
+    }
+    if (chunk->count + 1 == chunk->capacity)
+        archetype(chunk->mask).openChunks.find(chunk->group)->push_back(chunk->index);
+    records[index].chunk = nullptr;
+    records[index].generation++;
+    freeIndices.push_back(index);
+    entityCount--;
+}
+
+void EntityStore::releaseGroup(const void *group)
+{
+    for (Archetype &archetype : archetypes)
+    {
+        std::vector<unsigned int> *open = archetype.openChunks.find(group);
+        if (open == nullptr)
+            continue;
+        bool inUse = false;
+        for (size_t c = archetype.chunks.size(); c-- > 0;)
+        {
+            if (archetype.chunks[c]->group != group)
+                continue;
+            if (archetype.chunks[c]->count > 0)
+                inUse = true;
+            else
+                removeChunk(archetype, (unsigned int)c);
+        }
+        if (!inUse)
+            archetype.openChunks.erase(group);
+    }
+}
+
+void EntityStore::removeChunk(Archetype &archetype, unsigned int index)
+{
+    Chunk *removed = archetype.chunks[index].get();
+    std::vector<unsigned int> &open = *archetype.openChunks.find(removed->group);
+    open.erase(std::find(open.begin(), open.end(), index));
+
+    unsigned int last = (unsigned int)archetype.chunks.size() - 1;
+    if (index != last)
+    {
+        Chunk *moved = archetype.chunks[last].get();
+        // a full chunk is in no open list
+        std::vector<unsigned int> &movedOpen = *archetype.openChunks.find(moved->group);
+        auto at = std::find(movedOpen.begin(), movedOpen.end(), last);
+        if (at != movedOpen.end())
+            *at = index;
+        moved->index = index;
+        std::swap(archetype.chunks[index], archetype.chunks[last]);
+    }
+    archetype.chunks.pop_back();
+}
+
+unsigned int EntityStore::intern(const std::string &name)
+{
+    const unsigned int *found = nameIds.find(name);
+    if (found != nullptr)
+        return *found;
+    unsigned int id = (unsigned int)names.size();
+    names.push_back(name);
+    nameIds.insert(name, id);
+    return id;
+}
+
+size_t EntityStore::chunkCount() const
+{
+    size_t count = 0;
+    for (const Archetype &archetype : archetypes)
+        count += archetype.chunks.size();
+    return count;
+}
@@ -0,0 +1,124 @@
+#ifndef ENTITY_STORE_HPP
+#define ENTITY_STORE_HPP
+
+#include <scene/components.hpp>
+#include <helpers/openHashMap.hpp>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Generational handle: record index in the low 32 bits, generation in the high 32. Destroying an
+// entity bumps its record's generation, so handles kept past that no longer match
+typedef uint64_t Entity;
+
+inline unsigned int entityIndex(Entity entity) { return (unsigned int)(entity & 0xFFFFFFFFu); }
+inline unsigned int entityGeneration(Entity entity) { return (unsigned int)(entity >> 32); }
+
+// Up to capacity entities of one archetype and render group, every component in its own array
+// (structure of arrays), so a pass over one component walks contiguous memory
+struct Chunk {
+    ComponentMask mask;
+    const void *group;
+    unsigned int index; // in its archetype
+    unsigned int count = 0;
+    unsigned int capacity;
+    size_t offsets[COMPONENT_TYPES];
+    std::vector<Entity> entities; // of each row
+    std::vector<unsigned char> data;
+
+    bool has(ComponentType type) const { return (mask & COMPONENT_BIT(type)) != 0; }
+    template <typename T> T *array() { return reinterpret_cast<T *>(data.data() + offsets[Component<T>::type]); }
+    template <typename T> const T *array() const { return reinterpret_cast<const T *>(data.data() + offsets[Component<T>::type]); }
+};
+
+// Archetype storage: entities with the same set of components share fixed size chunks. Chunks are
+// also split by a render group (the Model drawing them), so one model's instances can be gathered
+// without looking at anybody else's. Removing an entity moves its chunk's last row into the hole,
+// so chunks stay dense; an entity keeps its handle however often it moves. Freed records are
+// reused with the next generation, spawning and despawning does not grow anything.
+class EntityStore {
+public:
+    static const size_t CHUNK_BYTES = 16 * 1024;
+    static const Entity NONE = ~(Entity)0;
+
+    // New entity with zeroed components
+    Entity create(ComponentMask mask, const void *group = nullptr);
+    void destroy(Entity entity);
+    // Frees the chunks of a render group that is going away (a deleted model), and its record of them.
+    // Its entities have to be destroyed first; chunks that still hold any are kept
+    void releaseGroup(const void *group);
+    bool alive(Entity entity) const
+    {
+        unsigned int index = entityIndex(entity);
+        return index < records.size() && records[index].chunk != nullptr && records[index].generation == entityGeneration(entity);
+    }
+
+    // Null when the entity does not have the component. Valid until the next create or destroy.
+    // Debug builds also return null (and say so) for a stale handle, release builds trust it
+    template <typename T> T *get(Entity entity)
+    {
+#ifndef NDEBUG
+        if (!alive(entity))
+        {
+            std::cout << "ERROR::ENTITY_STORE::STALE_HANDLE: index " << entityIndex(entity) << " generation " << entityGeneration(entity) << std::endl;
+            return nullptr;
+        }
+#endif
+        const Record &record = records[entityIndex(entity)];
+        return record.chunk->has(Component<T>::type) ? &record.chunk->array<T>()[record.row] : nullptr;
+    }
+
+    // function(Chunk &) for every non-empty chunk holding at least the components in mask,
+    // only those of group unless it is null
+    template <typename F> void forEachChunk(ComponentMask mask, const void *group, F function)
+    {
+        for (Archetype &archetype : archetypes)
+        {
+            if ((archetype.mask & mask) != mask)
+                continue;
+            for (std::unique_ptr<Chunk> &chunk : archetype.chunks)
+            {
+                if (chunk->count > 0 && (group == nullptr || chunk->group == group))
+                    function(*chunk);
+            }
+        }
+    }
+
+    // Name table behind NameId. Interned names never move or go away, background saves keep pointers to them
+    unsigned int intern(const std::string &name);
+    const std::string &nameOf(unsigned int name) const { return names[name]; }
+
+    size_t size() const { return entityCount; }
+    size_t chunkCount() const;
+
+private:
+    struct Archetype {
+        ComponentMask mask;
+        unsigned int capacity;
+        size_t offsets[COMPONENT_TYPES];
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        OpenHashMap<const void *, std::vector<unsigned int>> openChunks; // per group, the chunks with free rows
+    };
+    struct Record {
+        Chunk *chunk = nullptr;
+        unsigned int row = 0;
+        unsigned int generation = 0;
+    };
+
+    std::vector<Archetype> archetypes;
+    std::vector<Record> records;
+    std::vector<unsigned int> freeIndices;
+    size_t entityCount = 0;
+    OpenHashMap<std::string, unsigned int> nameIds;
+    std::deque<std::string> names;
+
+    Archetype &archetype(ComponentMask mask);
+    Chunk *chunkWithRoom(Archetype &archetype, const void *group);
+    // the archetype's last chunk takes the removed one's index
+    void removeChunk(Archetype &archetype, unsigned int index);
+};
+
+#endif // ENTITY_STORE_HPP
@@ -0,0 +1,455 @@
+#include <scene/sceneFile.hpp>
+#include <scene/binaryStream.hpp>
+#include <scene/sceneSaver.hpp>
+#include <helpers/openHashMap.hpp>
+#include <helpers/sceneTree.hpp>
+#include <model/model.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const uint32_t TAG_STRINGS = 0x47525453;   // "STRG"
+static const uint32_t TAG_MODELS = 0x4C444F4D;    // "MODL"
+static const uint32_t TAG_INSTANCES = 0x54534E49; // "INST"
+static const uint32_t TAG_HIERARCHY = 0x52454948; // "HIER"
+static const uint32_t CHUNK_VERSION = 1;
+
+static const uint32_t MODEL_CASTS_SHADOWS = 1;
+static const uint32_t MODEL_IS_OCCLUDER = 2;
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "instance arrays are written as packed vec3");
+
+namespace {
+
+struct ModelEntry {
+    uint32_t path;
+    uint32_t vertexShader;
+    uint32_t fragmentShader;
+    uint32_t flags;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+struct HierarchyEntry {
+    uint32_t instance;
+    int32_t parent; // instance, -1 for a root
+};
+
+// Everything a scene file holds, the same in memory as on disk
+struct SceneData {
+    std::vector<std::string> strings;
+    std::vector<ModelEntry> models;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<uint64_t> ids;
+    std::vector<uint32_t> names;
+    std::vector<HierarchyEntry> hierarchy;
+
+    OpenHashMap<std::string, uint32_t> stringIds; // writing only
+
+    uint32_t intern(const std::string &text)
+    {
+        const uint32_t *found = stringIds.find(text);
+        if (found != nullptr)
+            return *found;
+        uint32_t id = (uint32_t)strings.size();
+        strings.push_back(text);
+        stringIds.insert(text, id);
+        return id;
+    }
+
+    void addModel(const SceneModelRecord &record)
+    {
+        uint32_t flags = (record.castsShadows ? MODEL_CASTS_SHADOWS : 0) | (record.isOccluder ? MODEL_IS_OCCLUDER : 0);
+        models.push_back(ModelEntry{intern(record.path), intern(record.vertexShader), intern(record.fragmentShader), flags,
+                                    (uint32_t)ids.size(), 0});
+    }
+
+    void addInstance(const Transform &transform, uint64_t id, const std::string &name)
+    {
+        positions.push_back(transform.position);
+        rotations.push_back(transform.rotation);
+        scales.push_back(transform.scale);
+        ids.push_back(id);
+        names.push_back(intern(name));
+        models.back().instanceCount++;
+    }
+};
+
+// returns where the size goes, endChunk fills it in
+size_t beginChunk(std::vector<unsigned char> &out, uint32_t tag)
+{
+    put(out, tag);
+    put(out, CHUNK_VERSION);
+    size_t at = out.size();
+    put(out, (uint64_t)0);
+    return at;
+}
+
+void endChunk(std::vector<unsigned char> &out, size_t at)
+{
+    uint64_t size = out.size() - at - sizeof(uint64_t);
+    std::memcpy(&out[at], &size, sizeof(size));
+}
+
+void encodeScene(const SceneData &scene, std::vector<unsigned char> &out)
+{
+    out.clear();
+    put(out, SCENE_FILE_MAGIC);
+    put(out, SCENE_FILE_VERSION);
+    put(out, (uint32_t)4); // chunks
+
+    size_t chunk = beginChunk(out, TAG_STRINGS);
+    put(out, (uint32_t)scene.strings.size());
+    for (const std::string &text : scene.strings)
+        putString(out, text);
+    endChunk(out, chunk);
+
+    chunk = beginChunk(out, TAG_MODELS);
+    put(out, (uint32_t)scene.models.size());
+    putArray(out, scene.models);
+    endChunk(out, chunk);
+
+    chunk = beginChunk(out, TAG_INSTANCES);
+    put(out, (uint32_t)scene.ids.size());
+    putArray(out, scene.positions);
+    putArray(out, scene.rotations);
+    putArray(out, scene.scales);
+    putArray(out, scene.ids);
+    putArray(out, scene.names);
+    endChunk(out, chunk);
+
+    chunk = beginChunk(out, TAG_HIERARCHY);
+    put(out, (uint32_t)scene.hierarchy.size());
+    putArray(out, scene.hierarchy);
+    endChunk(out, chunk);
+}
+
+bool parseScene(const std::vector<unsigned char> &data, SceneData &scene)
+{
+    ByteReader file{data.data(), data.data() + data.size()};
+    if (file.read<uint32_t>() != SCENE_FILE_MAGIC)
+        return false;
+    uint32_t version = file.read<uint32_t>();
+    if (version > SCENE_FILE_VERSION)
+    {
+        std::cout << "ERROR::SCENE_FILE::NEWER_VERSION: " << version << std::endl;
+        return false;
+    }
+    uint32_t chunks = file.read<uint32_t>();
+
+    for (uint32_t c = 0; c < chunks && file.ok; c++)
+    {
+        uint32_t tag = file.read<uint32_t>();
+        file.read<uint32_t>(); // chunk version, all of them are still at 1
+        uint64_t size = file.read<uint64_t>();
+        if (!file.ok || size > (uint64_t)(file.end - file.at))
+            return false;
+        ByteReader chunk{file.at, file.at + size};
+        file.at += size;
+
+        if (tag == TAG_STRINGS)
+        {
+            uint32_t count = chunk.read<uint32_t>();
+            for (uint32_t i = 0; i < count && chunk.ok; i++)
+                scene.strings.push_back(chunk.string());
+        }
+        else if (tag == TAG_MODELS)
+        {
+            chunk.array(scene.models, chunk.read<uint32_t>());
+        }
+        else if (tag == TAG_INSTANCES)
+        {
+            uint32_t count = chunk.read<uint32_t>();
+            chunk.array(scene.positions, count);
+            chunk.array(scene.rotations, count);
+            chunk.array(scene.scales, count);
+            chunk.array(scene.ids, count);
+            chunk.array(scene.names, count);
+        }
+        else if (tag == TAG_HIERARCHY)
+        {
+            chunk.array(scene.hierarchy, chunk.read<uint32_t>());
+        }
+        if (!chunk.ok)
+            return false;
+    }
+    if (!file.ok)
+        return false;
+
+    // every index has to point inside the file, the loader trusts them after this
+    size_t stringCount = scene.strings.size(), instanceCount = scene.ids.size();
+    for (const ModelEntry &model : scene.models)
+    {
+        if (model.path >= stringCount || model.vertexShader >= stringCount || model.fragmentShader >= stringCount ||
+            (uint64_t)model.firstInstance + model.instanceCount > instanceCount)
+            return false;
+    }
+    for (uint32_t name : scene.names)
+    {
+        if (name >= stringCount)
+            return false;
+    }
+    for (const HierarchyEntry &entry : scene.hierarchy)
+    {
+        if (entry.instance >= instanceCount || (entry.parent >= 0 && (size_t)entry.parent >= instanceCount))
+            return false;
+    }
+    return true;
+}
+
+bool readFile(const std::string &path, std::vector<unsigned char> &data)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+    std::streamsize size = file.tellg();
+    if (size < 0)
+        return false;
+    data.resize((size_t)size);
+    file.seekg(0);
+    return file.read(reinterpret_cast<char *>(data.data()), size).good() || size == 0;
+}
+
+} // namespace
+
+void captureScene(const std::vector<Model *> &models, const SceneIndex &index, SceneSnapshot &snapshot)
+{
+    snapshot.models.clear();
+    snapshot.transforms.clear();
+    snapshot.ids.clear();
+    snapshot.names.clear();
+    snapshot.hierarchy.clear();
+    OpenHashMap<Entity, uint32_t> instanceOf; // entity -> instance in the snapshot
+    for (Model *model : models)
+    {
+        SceneSnapshot::ModelRange range;
+        range.record.path = model->directory;
+        range.record.vertexShader = model->material->shaders->vertex;
+        range.record.fragmentShader = model->material->shaders->fragment;
+        range.record.castsShadows = model->castsShadows;
+        range.record.isOccluder = model->isOccluder;
+        range.instanceCount = model->instanceCount;
+        snapshot.models.push_back(range);
+        for (unsigned int i = 0; i < model->instanceCount; i++)
+        {
+            instanceOf.insert(model->instanceEntities[i], (uint32_t)snapshot.ids.size());
+            snapshot.transforms.push_back(model->transform(i));
+            snapshot.ids.push_back(model->id(i));
+            snapshot.names.push_back(&model->name(i));
+        }
+    }
+
+    // roots in instance order, each followed by its subtree, so a parent is always loaded first
+    std::vector<std::pair<const SceneTreeNode *, int32_t>> stack;
+    for (uint32_t instance = 0; instance < (uint32_t)snapshot.ids.size(); instance++)
+    {
+        unsigned int slot = index.find((size_t)snapshot.ids[instance]);
+        const SceneTreeNode *node = slot != SceneIndex::NONE ? index[slot].node : nullptr;
+        if (node == nullptr)
+        {
+            snapshot.hierarchy.push_back({instance, -1});
+            continue;
+        }
+        if (node->parentNode != nullptr)
+            continue;
+        stack.assign(1, {node, -1});
+        while (!stack.empty())
+        {
+            const SceneTreeNode *current = stack.back().first;
+            int32_t parent = stack.back().second;
+            stack.pop_back();
+            // nodes of models that are not saved are left out, their children move up
+            const uint32_t *saved = instanceOf.find(current->entity);
+            if (saved != nullptr)
+            {
+                snapshot.hierarchy.push_back({*saved, parent});
+                parent = (int32_t)*saved;
+            }
+            for (const SceneTreeNode *child = current->lastChild; child != nullptr; child = child->previousSibling)
+                stack.push_back({child, parent});
+        }
+    }
+}
+
+void encodeSceneSnapshot(const SceneSnapshot &snapshot, std::vector<unsigned char> &bytes)
+{
+    SceneData scene;
+    uint32_t instance = 0;
+    for (const SceneSnapshot::ModelRange &range : snapshot.models)
+    {
+        scene.addModel(range.record);
+        for (uint32_t i = 0; i < range.instanceCount; i++, instance++)
+            scene.addInstance(snapshot.transforms[instance], snapshot.ids[instance], *snapshot.names[instance]);
+    }
+    for (const std::pair<uint32_t, int32_t> &entry : snapshot.hierarchy)
+        scene.hierarchy.push_back(HierarchyEntry{entry.first, entry.second});
+    encodeScene(scene, bytes);
+}
+
+bool saveSceneFile(const std::string &path, const std::vector<Model *> &models, const SceneIndex &index)
+{
+    SceneSnapshot snapshot;
+    captureScene(models, index, snapshot);
+    std::vector<unsigned char> bytes;
+    encodeSceneSnapshot(snapshot, bytes);
+    return writeFileAtomically(path, bytes);
+}
+
+bool readSceneFile(const std::string &path, SceneSnapshot &snapshot)
+{
+    std::vector<unsigned char> data;
+    if (!readFile(path, data))
+        return false;
+    SceneData scene;
+    if (!parseScene(data, scene))
+    {
+        std::cout << "ERROR::SCENE_FILE::CORRUPT: " << path << std::endl;
+        return false;
+    }
+
+    snapshot = SceneSnapshot();
+    for (const std::string &text : scene.strings)
+        snapshot.strings.push_back(text);
+    // the file's models may list their instance ranges in any order, the snapshot's follow each other
+    std::vector<int32_t> remap(scene.ids.size(), -1);
+    for (const ModelEntry &entry : scene.models)
+    {
+        SceneSnapshot::ModelRange range;
+        range.record.path = scene.strings[entry.path];
+        range.record.vertexShader = scene.strings[entry.vertexShader];
+        range.record.fragmentShader = scene.strings[entry.fragmentShader];
+        range.record.castsShadows = (entry.flags & MODEL_CASTS_SHADOWS) != 0;
+        range.record.isOccluder = (entry.flags & MODEL_IS_OCCLUDER) != 0;
+        range.instanceCount = 0;
+        for (uint32_t i = entry.firstInstance; i < entry.firstInstance + entry.instanceCount; i++)
+        {
+            if (remap[i] >= 0)
+                continue;
+            remap[i] = (int32_t)snapshot.ids.size();
+            snapshot.transforms.push_back(Transform{scene.positions[i], scene.rotations[i], scene.scales[i]});
+            snapshot.ids.push_back(scene.ids[i]);
+            snapshot.names.push_back(&snapshot.strings[scene.names[i]]);
+            range.instanceCount++;
+        }
+        snapshot.models.push_back(range);
+    }
+    for (const HierarchyEntry &entry : scene.hierarchy)
+    {
+        if (remap[entry.instance] >= 0)
+            snapshot.hierarchy.push_back({(uint32_t)remap[entry.instance], entry.parent >= 0 ? remap[entry.parent] : -1});
+    }
+    return true;
+}
+
+bool loadSceneFile(const std::string &path, std::vector<Model *> &models, SceneIndex &index, std::vector<SceneTreeNode *> &roots)
+{
+    std::vector<unsigned char> data;
+    if (!readFile(path, data))
+        return false;
+    SceneData scene;
+    if (!parseScene(data, scene))
+    {
+        std::cout << "ERROR::SCENE_FILE::CORRUPT: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<Model *> instanceModel(scene.ids.size(), nullptr);
+    std::vector<unsigned int> instanceIndex(scene.ids.size(), 0);
+    for (const ModelEntry &entry : scene.models)
+    {
+        if (entry.instanceCount == 0)
+            continue;
+        uint32_t first = entry.firstInstance;
+        Model *model = new Model(scene.strings[entry.path].c_str(), scene.strings[entry.vertexShader].c_str(),
+                                 scene.strings[entry.fragmentShader].c_str(), scene.strings[scene.names[first]],
+                                 scene.positions[first], scene.rotations[first], scene.scales[first]);
+        model->castsShadows = (entry.flags & MODEL_CASTS_SHADOWS) != 0;
+        model->isOccluder = (entry.flags & MODEL_IS_OCCLUDER) != 0;
+        for (uint32_t i = first + 1; i < first + entry.instanceCount; i++)
+            model->addInstance(scene.positions[i], scene.rotations[i], scene.scales[i], scene.strings[scene.names[i]]);
+        for (uint32_t i = 0; i < entry.instanceCount; i++)
+        {
+            // the saved IDs replace the freshly hashed ones before anything indexes them
+            Model::entities.get<StableId>(model->instanceEntities[i])->value = (size_t)scene.ids[first + i];
+            instanceModel[first + i] = model;
+            instanceIndex[first + i] = i;
+        }
+        models.push_back(model);
+    }
+
+    std::vector<SceneTreeNode *> nodes(scene.ids.size(), nullptr);
+    for (const HierarchyEntry &entry : scene.hierarchy)
+    {
+        if (instanceModel[entry.instance] == nullptr || nodes[entry.instance] != nullptr)
+            continue;
+        SceneTreeNode *parent = entry.parent >= 0 ? nodes[entry.parent] : nullptr;
+        nodes[entry.instance] = insertInstanceToSceneTree(index, parent, instanceModel[entry.instance], instanceIndex[entry.instance]);
+        if (parent == nullptr && nodes[entry.instance] != nullptr)
+            roots.push_back(nodes[entry.instance]);
+    }
+    // instances the hierarchy does not mention still get a node
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i] == nullptr && instanceModel[i] != nullptr)
+        {
+            nodes[i] = insertInstanceToSceneTree(index, nullptr, instanceModel[i], instanceIndex[i]);
+            if (nodes[i] != nullptr)
+                roots.push_back(nodes[i]);
+        }
+    }
+    return true;
+}
+
+bool isBinarySceneFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    uint32_t magic = 0;
+    file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    return file.good() && magic == SCENE_FILE_MAGIC;
+}
+
+bool convertTextScene(const std::string &textPath, const std::string &binaryPath, const std::function<void(SceneModelRecord &)> &describe)
+{
+    std::ifstream file(textPath);
+    if (!file.is_open())
+        return false;
+
+    SceneData scene;
+    std::string modelPath;
+    // the path has a line of its own (it may contain spaces), everything else is whitespace separated
+    while (std::getline(file >> std::ws, modelPath))
+    {
+        unsigned int count = 0;
+        if (!(file >> count))
+            break;
+        SceneModelRecord record;
+        record.path = modelPath;
+        describe(record);
+        scene.addModel(record);
+        std::string name = std::filesystem::path(modelPath).stem().string();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            uint64_t id;
+            Transform transform;
+            file >> id;
+            file >> transform.position.x >> transform.position.y >> transform.position.z;
+            file >> transform.rotation.x >> transform.rotation.y >> transform.rotation.z;
+            file >> transform.scale.x >> transform.scale.y >> transform.scale.z;
+            if (!file)
+            {
+                std::cout << "ERROR::SCENE_FILE::BAD_TEXT_SCENE: " << textPath << std::endl;
+                return false;
+            }
+            scene.addInstance(transform, id, name);
+        }
+    }
+
+    for (uint32_t instance = 0; instance < (uint32_t)scene.ids.size(); instance++)
+        scene.hierarchy.push_back(HierarchyEntry{instance, instance == 0 ? -1 : 0});
+    std::vector<unsigned char> bytes;
+    encodeScene(scene, bytes);
+    return writeFileAtomically(binaryPath, bytes);
+}
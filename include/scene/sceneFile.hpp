@@ -0,0 +1,71 @@
+#ifndef SCENE_FILE_HPP
+#define SCENE_FILE_HPP
+
+#include <scene/components.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Model;
+class SceneIndex;
+struct SceneTreeNode;
+
+// Binary scene file (.sn). A header, then chunks that each start with a tag, a version and their
+// byte size, so readers skip chunks they do not know and old files stay readable:
+//   STRG  string table (model and shader paths, instance names), everything else refers to it by index
+//   MODL  model table: model path, vertex and fragment shader, flags, its range of instances
+//   INST  instances as structure of arrays: positions, rotations, scales, stable IDs, names
+//   HIER  (instance, parent instance) pairs, parents before their children
+// Values are stored in the machine's byte order, the file is a cache of this program's state.
+// The whole file is read with one call and parsed from memory.
+static const uint32_t SCENE_FILE_MAGIC = 0x424E4353; // "SCNB"
+static const uint32_t SCENE_FILE_VERSION = 1;
+
+// What a scene file says about one model
+struct SceneModelRecord {
+    std::string path;
+    std::string vertexShader;
+    std::string fragmentShader;
+    bool castsShadows = true;
+    bool isOccluder = true;
+};
+
+// What a scene file will hold, copied out of the scene so another thread can encode it while the
+// scene keeps changing. Instance names point at the names interned in Model::entities, which never
+// move, so they are not copied; a snapshot read from a file keeps its names in strings instead
+struct SceneSnapshot {
+    struct ModelRange {
+        SceneModelRecord record;
+        uint32_t instanceCount; // the model's instances follow the previous model's
+    };
+    std::vector<ModelRange> models;
+    std::vector<Transform> transforms;
+    std::vector<uint64_t> ids;
+    std::vector<const std::string *> names;
+    std::vector<std::pair<uint32_t, int32_t>> hierarchy; // instance, parent instance (-1 for a root), parents first
+    std::deque<std::string> strings;
+};
+
+// Writes every instance of models, with the hierarchy the index's tree nodes form
+bool saveSceneFile(const std::string &path, const std::vector<Model *> &models, const SceneIndex &index);
+// The halves of saveSceneFile: capturing touches the scene and belongs to the main thread, encoding
+// only reads the snapshot and can run anywhere
+void captureScene(const std::vector<Model *> &models, const SceneIndex &index, SceneSnapshot &snapshot);
+void encodeSceneSnapshot(const SceneSnapshot &snapshot, std::vector<unsigned char> &bytes);
+// Reads a scene file without creating anything: no GL needed, any thread can do it
+bool readSceneFile(const std::string &path, SceneSnapshot &snapshot);
+// Creates the file's models (appended to models, in file order), their instances with the saved
+// transforms, names and stable IDs, and their scene tree nodes; the root nodes go to roots.
+// Needs a GL context, the models load their meshes and shaders
+bool loadSceneFile(const std::string &path, std::vector<Model *> &models, SceneIndex &index, std::vector<SceneTreeNode *> &roots);
+// True when the file starts like a binary scene, false for the old text format or no file
+bool isBinarySceneFile(const std::string &path);
+// Rewrites an old text scene (path, instance count, then ID and transform per instance) as a binary
+// one. The text has no shaders and no hierarchy: describe fills in each model's record (it gets
+// the path), and the first instance becomes the parent of all the others. No GL needed
+bool convertTextScene(const std::string &textPath, const std::string &binaryPath, const std::function<void(SceneModelRecord &)> &describe);
+
+#endif // SCENE_FILE_HPP
@@ -0,0 +1,340 @@
+#include <scene/sceneJournal.hpp>
+#include <scene/sceneSaver.hpp>
+#include <scene/binaryStream.hpp>
+#include <helpers/sceneTree.hpp>
+#include <model/model.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const uint32_t RECORD_TRANSFORM = 0x4E415254; // "TRAN"
+static const uint32_t RECORD_SPAWN = 0x4E575053;     // "SPWN"
+static const uint32_t RECORD_DELETE = 0x454C4544;    // "DELE"
+static const size_t HEADER_BYTES = 2 * sizeof(uint32_t);
+
+static const uint32_t MODEL_CASTS_SHADOWS = 1;
+static const uint32_t MODEL_IS_OCCLUDER = 2;
+
+static_assert(sizeof(Transform) == 9 * sizeof(float), "transforms are written as they are in memory");
+
+namespace {
+
+bool readJournal(const std::string &path, std::vector<unsigned char> &data)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+    std::streamsize size = file.tellg();
+    if (size < 0)
+        return false;
+    data.resize((size_t)size);
+    file.seekg(0);
+    return file.read(reinterpret_cast<char *>(data.data()), size).good() || size == 0;
+}
+
+bool applyTransform(ByteReader &record, SceneIndex &index)
+{
+    uint64_t id = record.read<uint64_t>();
+    Transform transform = record.read<Transform>();
+    unsigned int slot = index.find((size_t)id);
+    if (!record.ok || slot == SceneIndex::NONE || !Model::entities.alive(index[slot].entity))
+        return false;
+    *Model::entities.get<Transform>(index[slot].entity) = transform;
+    return true;
+}
+
+bool applySpawn(ByteReader &record, std::vector<Model *> &models, SceneIndex &index, SceneTreeNode *root)
+{
+    uint64_t id = record.read<uint64_t>();
+    uint64_t parentId = record.read<uint64_t>();
+    Transform transform = record.read<Transform>();
+    uint32_t flags = record.read<uint32_t>();
+    std::string path = record.string();
+    std::string vertexShader = record.string();
+    std::string fragmentShader = record.string();
+    std::string name = record.string();
+    // already in the scene file, or spawned by an earlier record
+    if (!record.ok || index.find((size_t)id) != SceneIndex::NONE)
+        return false;
+
+    Model *model = nullptr;
+    for (Model *candidate : models)
+    {
+        if (candidate->directory == path)
+        {
+            model = candidate;
+            break;
+        }
+    }
+    unsigned int instance = 0;
+    if (model == nullptr)
+    {
+        model = new Model(path.c_str(), vertexShader.c_str(), fragmentShader.c_str(), name, transform.position,
+                          transform.rotation, transform.scale);
+        model->castsShadows = (flags & MODEL_CASTS_SHADOWS) != 0;
+        model->isOccluder = (flags & MODEL_IS_OCCLUDER) != 0;
+        models.push_back(model);
+    }
+    else
+    {
+        instance = model->addInstance(transform.position, transform.rotation, transform.scale, name);
+    }
+    Model::entities.get<StableId>(model->instanceEntities[instance])->value = (size_t)id;
+
+    SceneTreeNode *parent = parentId != 0 ? getInstanceInSceneTree(index, (size_t)parentId) : nullptr;
+    return insertInstanceToSceneTree(index, parent != nullptr ? parent : root, model, instance) != nullptr;
+}
+
+bool applyDelete(ByteReader &record, SceneIndex &index)
+{
+    uint64_t id = record.read<uint64_t>();
+    if (!record.ok || index.find((size_t)id) == SceneIndex::NONE)
+        return false;
+    removeInstanceFromSceneTree(index, (size_t)id);
+    return true;
+}
+
+} // namespace
+
+SceneJournal::SceneJournal(const std::string &journalPath, const std::string &scenePath, SceneSaver &saver)
+    : journalPath(journalPath), scenePath(scenePath), saver(saver)
+{
+    std::ifstream file(journalPath, std::ios::binary | std::ios::ate);
+    uint32_t magic = 0, version = 0;
+    std::streamsize size = file.is_open() ? (std::streamsize)file.tellg() : 0;
+    if (size >= (std::streamsize)HEADER_BYTES)
+    {
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+        file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    }
+    if (magic == SCENE_JOURNAL_MAGIC && version <= SCENE_JOURNAL_VERSION)
+    {
+        fileBytes = (size_t)size;
+        return;
+    }
+    if (size > 0)
+        std::cout << "ERROR::SCENE_JOURNAL::NOT_A_JOURNAL: " << journalPath << ", starting a new one" << std::endl;
+    file.close();
+    restart();
+}
+
+SceneJournal::~SceneJournal()
+{
+    flush();
+    wait();
+}
+
+size_t SceneJournal::replay(std::vector<Model *> &models, SceneIndex &index, SceneTreeNode *root)
+{
+    stats.replayed = 0;
+    std::vector<unsigned char> data;
+    if (!readJournal(journalPath, data) || data.size() < HEADER_BYTES)
+        return 0;
+
+    ByteReader file{data.data() + HEADER_BYTES, data.data() + data.size()};
+    const unsigned char *complete = file.at;
+    while (file.remaining() > 0)
+    {
+        uint32_t type = file.read<uint32_t>();
+        uint32_t size = file.read<uint32_t>();
+        if (!file.ok || size > file.remaining())
+            break;
+        ByteReader record{file.at, file.at + size};
+        file.at += size;
+        complete = file.at;
+
+        bool applied = false;
+        if (type == RECORD_TRANSFORM)
+            applied = applyTransform(record, index);
+        else if (type == RECORD_SPAWN)
+            applied = applySpawn(record, models, index, root);
+        else if (type == RECORD_DELETE)
+            applied = applyDelete(record, index);
+        if (applied)
+            stats.replayed++;
+    }
+
+    fileBytes = (size_t)(complete - data.data());
+    if (fileBytes < data.size())
+    {
+        // new records go right after the last whole one
+        std::cout << "ERROR::SCENE_JOURNAL::TRUNCATED_RECORD: dropping the last " << data.size() - fileBytes << " bytes of " << journalPath << std::endl;
+        std::error_code error;
+        std::filesystem::resize_file(journalPath, fileBytes, error);
+        if (error)
+            restart();
+    }
+    if (fileBytes > HEADER_BYTES)
+    {
+        // the scene file does not have these yet
+        edited = true;
+        firstEdit = std::chrono::steady_clock::now();
+    }
+    return stats.replayed;
+}
+
+size_t SceneJournal::beginRecord(uint32_t type)
+{
+    if (!edited)
+    {
+        edited = true;
+        firstEdit = std::chrono::steady_clock::now();
+    }
+    stats.records++;
+    put(pending, type);
+    size_t at = pending.size();
+    put(pending, (uint32_t)0);
+    return at;
+}
+
+void SceneJournal::endRecord(size_t at)
+{
+    uint32_t size = (uint32_t)(pending.size() - at - sizeof(uint32_t));
+    std::memcpy(&pending[at], &size, sizeof(size));
+}
+
+void SceneJournal::recordTransform(size_t id, const Transform &transform)
+{
+    size_t at = beginRecord(RECORD_TRANSFORM);
+    put(pending, (uint64_t)id);
+    put(pending, transform);
+    endRecord(at);
+}
+
+void SceneJournal::recordSpawn(const Model *model, unsigned int instance, size_t parentId)
+{
+    uint32_t flags = (model->castsShadows ? MODEL_CASTS_SHADOWS : 0) | (model->isOccluder ? MODEL_IS_OCCLUDER : 0);
+    size_t at = beginRecord(RECORD_SPAWN);
+    put(pending, (uint64_t)model->id(instance));
+    put(pending, (uint64_t)parentId);
+    put(pending, *Model::entities.get<Transform>(model->instanceEntities[instance]));
+    put(pending, flags);
+    putString(pending, model->directory);
+    putString(pending, model->material->shaders->vertex);
+    putString(pending, model->material->shaders->fragment);
+    putString(pending, model->name(instance));
+    endRecord(at);
+}
+
+void SceneJournal::recordDelete(size_t id)
+{
+    size_t at = beginRecord(RECORD_DELETE);
+    put(pending, (uint64_t)id);
+    endRecord(at);
+}
+
+void SceneJournal::flush()
+{
+    if (pending.empty())
+        return;
+    std::ofstream file(journalPath, std::ios::binary | std::ios::app);
+    file.write(reinterpret_cast<const char *>(pending.data()), (std::streamsize)pending.size());
+    if (!file.good())
+    {
+        // kept for the next frame; the scene file still gets everything at the next compaction
+        std::cout << "ERROR::SCENE_JOURNAL::CANNOT_APPEND: " << journalPath << std::endl;
+        return;
+    }
+    fileBytes += pending.size();
+    pending.clear();
+}
+
+void SceneJournal::update(const std::vector<Model *> &models, const SceneIndex &index)
+{
+    flush();
+    if (compaction != nullptr && compaction->done.load(std::memory_order_acquire))
+        finishCompaction();
+    if (compaction != nullptr || !edited)
+        return;
+    float age = std::chrono::duration<float>(std::chrono::steady_clock::now() - firstEdit).count();
+    if (fileBytes >= compactBytes || age >= compactSeconds)
+        compact(models, index);
+}
+
+void SceneJournal::compact(const std::vector<Model *> &models, const SceneIndex &index)
+{
+    if (compaction != nullptr)
+        return;
+    flush();
+    compaction = saver.saveScene(scenePath, models, index);
+    snapshotCovers = fileBytes;
+    edited = false;
+}
+
+void SceneJournal::wait()
+{
+    if (compaction == nullptr)
+        return;
+    saver.wait();
+    finishCompaction();
+}
+
+void SceneJournal::finishCompaction()
+{
+    std::shared_ptr<const SaveResult> result = std::move(compaction);
+    compaction = nullptr;
+    if (!result->saved)
+    {
+        // the journal still has everything, the next compaction tries again
+        std::cout << "ERROR::SCENE_JOURNAL::COMPACTION_FAILED: " << scenePath << std::endl;
+        edited = true;
+        firstEdit = std::chrono::steady_clock::now();
+        return;
+    }
+    stats.compactions++;
+    stats.lastCompactMs = result->ms;
+    dropRecords(snapshotCovers);
+}
+
+void SceneJournal::dropRecords(size_t offset)
+{
+    if (offset <= HEADER_BYTES)
+        return;
+    // only what was appended while the snapshot was written is left, usually nothing
+    std::vector<unsigned char> kept;
+    put(kept, SCENE_JOURNAL_MAGIC);
+    put(kept, SCENE_JOURNAL_VERSION);
+    if (fileBytes > offset)
+    {
+        std::ifstream file(journalPath, std::ios::binary);
+        kept.resize(HEADER_BYTES + fileBytes - offset);
+        file.seekg((std::streamoff)offset);
+        if (!file.read(reinterpret_cast<char *>(kept.data() + HEADER_BYTES), (std::streamsize)(fileBytes - offset)))
+            return;
+    }
+
+    // replaced in one rename: a crash keeps the longer journal, which replays to the same scene
+    std::string temporary = journalPath + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(kept.data()), (std::streamsize)kept.size());
+        if (!file.good())
+            return;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, journalPath, error);
+    if (error)
+    {
+        std::cout << "ERROR::SCENE_JOURNAL::CANNOT_REPLACE: " << journalPath << " (" << error.message() << ")" << std::endl;
+        return;
+    }
+    fileBytes = kept.size();
+}
+
+bool SceneJournal::restart()
+{
+    std::vector<unsigned char> header;
+    put(header, SCENE_JOURNAL_MAGIC);
+    put(header, SCENE_JOURNAL_VERSION);
+    std::ofstream file(journalPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(header.data()), (std::streamsize)header.size());
+    if (!file.good())
+    {
+        std::cout << "ERROR::SCENE_JOURNAL::CANNOT_WRITE: " << journalPath << std::endl;
+        return false;
+    }
+    fileBytes = header.size();
+    return true;
+}
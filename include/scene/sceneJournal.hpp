@@ -0,0 +1,91 @@
+#ifndef SCENE_JOURNAL_HPP
+#define SCENE_JOURNAL_HPP
+
+#include <scene/components.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Model;
+class SceneIndex;
+struct SceneTreeNode;
+class SceneSaver;
+struct SaveResult;
+
+// Journal file (.snj): a header, then records of { u32 type, u32 payload size, payload }
+//   TRAN  stable ID, transform
+//   SPWN  stable ID, parent ID (0 for none), transform, model flags, model path, shaders, name
+//   DELE  stable ID
+// Records only ever get appended, the edits of a frame with a single write. A crash can only cut off
+// the last record, which replay ignores. Replay is idempotent (spawns of IDs that exist are skipped,
+// transforms overwrite), so records the scene file already holds do no harm.
+static const uint32_t SCENE_JOURNAL_MAGIC = 0x4A4E4353; // "SCNJ"
+static const uint32_t SCENE_JOURNAL_VERSION = 1;
+
+struct SceneJournalStats {
+    size_t records = 0;      // appended since startup
+    size_t replayed = 0;     // applied by the last replay
+    size_t compactions = 0;
+    float lastCompactMs = 0.0f; // the saver's encoding and writing of the snapshot
+};
+
+// Edits of the scene between two saves of the scene file. Every so often (compactBytes of journal,
+// or compactSeconds after an edit) the scene goes to the saver as a snapshot; once the saver has
+// written it, the journal drops the records the snapshot covers.
+class SceneJournal {
+public:
+    SceneJournal(const std::string &journalPath, const std::string &scenePath, SceneSaver &saver);
+    // waits for a compaction that is still writing
+    ~SceneJournal();
+
+    // Re-applies the journal to the loaded scene; call it before recording, it also cuts off a record
+    // a crash left half written. Spawned instances get loaded (their model too, when models has none
+    // with that path) under their parent or root, transforms overwritten, deleted instances removed.
+    // Returns the records applied
+    size_t replay(std::vector<Model *> &models, SceneIndex &index, SceneTreeNode *root);
+
+    void recordTransform(size_t id, const Transform &transform);
+    void recordSpawn(const Model *model, unsigned int instance, size_t parentId);
+    void recordDelete(size_t id);
+
+    // Once per frame: appends the frame's records, finishes a compaction that has been written and
+    // starts one when the journal has grown or aged enough
+    void update(const std::vector<Model *> &models, const SceneIndex &index);
+    // Saves the scene through the saver; nothing when a compaction is still being written
+    void compact(const std::vector<Model *> &models, const SceneIndex &index);
+    // blocks until a compaction in flight is written and the journal trimmed
+    void wait();
+
+    bool compacting() const { return compaction != nullptr; }
+    size_t size() const { return fileBytes + pending.size(); } // bytes, header included
+
+    size_t compactBytes = 256 * 1024;
+    float compactSeconds = 30.0f;
+    SceneJournalStats stats;
+
+private:
+    std::string journalPath;
+    std::string scenePath;
+    std::vector<unsigned char> pending; // records of this frame
+    size_t fileBytes = 0;
+    std::chrono::steady_clock::time_point firstEdit; // oldest record not in the scene file
+    bool edited = false;
+
+    SceneSaver &saver;
+    std::shared_ptr<const SaveResult> compaction; // the save in flight
+    size_t snapshotCovers = 0; // journal bytes that save includes
+
+    // returns where the payload size goes, endRecord fills it in
+    size_t beginRecord(uint32_t type);
+    void endRecord(size_t at);
+    void flush();
+    void finishCompaction();
+    // keeps the records after offset, in a fresh journal that replaces the file
+    void dropRecords(size_t offset);
+    // a journal with only the header
+    bool restart();
+};
+
+#endif // SCENE_JOURNAL_HPP
@@ -0,0 +1,156 @@
+#include <scene/sceneSaver.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// written in slices so progress moves while a large scene goes out
+static const size_t WRITE_SLICE = 256 * 1024;
+
+const char *const SceneSaver::phaseText[3] = {"idle", "encoding", "writing"};
+
+static bool syncFile(std::FILE *file)
+{
+    if (std::fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool writeFileAtomically(const std::string &path, const std::vector<unsigned char> &bytes, std::atomic<size_t> *written)
+{
+    std::string temporary = path + ".tmp";
+    std::FILE *file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR::SAVE::CANNOT_WRITE: " << temporary << std::endl;
+        return false;
+    }
+    bool ok = true;
+    for (size_t at = 0; at < bytes.size() && ok; at += WRITE_SLICE)
+    {
+        size_t size = std::min(WRITE_SLICE, bytes.size() - at);
+        ok = std::fwrite(bytes.data() + at, 1, size, file) == size;
+        if (written != nullptr)
+            written->store(at + size, std::memory_order_relaxed);
+    }
+    // on disk before the rename makes it the file, or a power loss could leave an empty one in its place
+    ok = syncFile(file) && ok;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        std::cout << "ERROR::SAVE::WRITE_FAILED: " << temporary << std::endl;
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::cout << "ERROR::SAVE::CANNOT_REPLACE: " << path << " (" << error.message() << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+SceneSaver::SceneSaver() : worker(&SceneSaver::run, this) {}
+
+SceneSaver::~SceneSaver()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+std::shared_ptr<const SaveResult> SceneSaver::saveScene(const std::string &path, const std::vector<Model *> &models, const SceneIndex &index)
+{
+    auto start = std::chrono::steady_clock::now();
+    Job job;
+    job.path = path;
+    job.snapshot = std::make_unique<SceneSnapshot>();
+    captureScene(models, index, *job.snapshot);
+    captureMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return queue(std::move(job));
+}
+
+std::shared_ptr<const SaveResult> SceneSaver::saveBytes(const std::string &path, std::vector<unsigned char> bytes)
+{
+    Job job;
+    job.path = path;
+    job.bytes = std::move(bytes);
+    return queue(std::move(job));
+}
+
+std::shared_ptr<const SaveResult> SceneSaver::queue(Job job)
+{
+    job.result = std::make_shared<SaveResult>();
+    std::shared_ptr<const SaveResult> result = job.result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        outstanding++;
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+    return result;
+}
+
+void SceneSaver::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return outstanding.load() == 0; });
+}
+
+float SceneSaver::progress() const
+{
+    size_t size = total.load(std::memory_order_relaxed);
+    if (phaseIndex.load() != WRITING || size == 0)
+        return 0.0f;
+    return std::min(1.0f, (float)written.load(std::memory_order_relaxed) / (float)size);
+}
+
+void SceneSaver::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+        // queued saves still go out when stopping, the program is closing and wants them
+        if (jobs.empty())
+            return;
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        if (job.snapshot != nullptr)
+        {
+            phaseIndex = ENCODING;
+            encodeSceneSnapshot(*job.snapshot, job.bytes);
+            job.snapshot.reset();
+        }
+        written = 0;
+        total = job.bytes.size();
+        phaseIndex = WRITING;
+        job.result->saved = writeFileAtomically(job.path, job.bytes, &written);
+        job.result->bytes = job.bytes.size();
+        job.result->ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        phaseIndex = IDLE;
+        job.result->done.store(true, std::memory_order_release);
+
+        lock.lock();
+        outstanding--;
+        if (outstanding.load() == 0)
+            idle.notify_all();
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SCENE_SAVER_HPP
+#define SCENE_SAVER_HPP
+
+#include <scene/sceneFile.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Model;
+class SceneIndex;
+
+// Writes bytes to path.tmp, flushes them to the disk and renames the file over path, so a crash
+// leaves either the old file or the new one. written, when given, follows the bytes written so far
+bool writeFileAtomically(const std::string &path, const std::vector<unsigned char> &bytes, std::atomic<size_t> *written = nullptr);
+
+// Outcome of one queued save, filled in by the worker
+struct SaveResult {
+    std::atomic<bool> done{false};
+    bool saved = false; // valid once done
+    size_t bytes = 0;
+    float ms = 0.0f;    // encoding and writing on the worker
+};
+
+// Saves without stalling the frame: the main thread only copies what gets saved (captureScene for a
+// scene, the finished bytes for small files), one worker thread encodes, writes and syncs, in the
+// order the saves were queued
+class SceneSaver {
+public:
+    SceneSaver();
+    // finishes every queued save
+    ~SceneSaver();
+
+    std::shared_ptr<const SaveResult> saveScene(const std::string &path, const std::vector<Model *> &models, const SceneIndex &index);
+    std::shared_ptr<const SaveResult> saveBytes(const std::string &path, std::vector<unsigned char> bytes);
+    // blocks until every queued save is done
+    void wait();
+
+    bool busy() const { return outstanding.load() > 0; }
+    // of the save being written, 0 to 1
+    float progress() const;
+    // what the worker does right now, for the UI
+    const char *phase() const { return phaseText[phaseIndex.load()]; }
+    float captureMs = 0.0f; // of the last saveScene, on the calling thread
+
+private:
+    struct Job {
+        std::string path;
+        std::unique_ptr<SceneSnapshot> snapshot; // encoded by the worker, null for saveBytes
+        std::vector<unsigned char> bytes;
+        std::shared_ptr<SaveResult> result;
+    };
+
+    static const char *const phaseText[3];
+    enum Phase { IDLE, ENCODING, WRITING };
+
+    std::mutex mutex;
+    std::condition_variable wake; // a job was queued, or stopping
+    std::condition_variable idle; // outstanding reached zero
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::atomic<unsigned int> outstanding{0}; // queued plus running
+    std::atomic<int> phaseIndex{IDLE};
+    std::atomic<size_t> written{0};
+    std::atomic<size_t> total{0};
+    std::thread worker; // last, it starts running once everything above exists
+
+    std::shared_ptr<const SaveResult> queue(Job job);
+    void run();
+};
+
+#endif // SCENE_SAVER_HPP
@@ -0,0 +1,75 @@
+#include <scene/systems.hpp>
+#include <model/model.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+glm::mat4 worldMatrix(const Transform &transform)
+{
+    glm::mat4 matrix = glm::translate(glm::mat4(1.0f), transform.position);
+    matrix = glm::scale(matrix, transform.scale);
+    matrix = glm::rotate(matrix, glm::radians(transform.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    matrix = glm::rotate(matrix, glm::radians(transform.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    matrix = glm::rotate(matrix, glm::radians(transform.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    return matrix;
+}
+
+Bounds transformBounds(const Bounds &local, const glm::mat4 &matrix)
+{
+    Bounds bounds;
+    if (local.empty())
+        return bounds;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point((corner & 1) ? local.max.x : local.min.x,
+                        (corner & 2) ? local.max.y : local.min.y,
+                        (corner & 4) ? local.max.z : local.min.z);
+        bounds.add(glm::vec3(matrix * glm::vec4(point, 1.0f)));
+    }
+    return bounds;
+}
+
+// chunks a job works through, some hundred entities
+static const unsigned int CHUNKS_PER_JOB = 2;
+
+// Runs function over every chunk with mask, spread over jobs; chunks never share rows, so jobs do not overlap
+template <typename F> static void forEachChunkInJobs(EntityStore &store, ComponentMask mask, JobSystem &jobs, const F &function)
+{
+    FrameVector<Chunk *> chunks;
+    store.forEachChunk(mask, nullptr, [&](Chunk &chunk) { chunks.push_back(&chunk); });
+    jobs.parallelFor((unsigned int)chunks.size(), CHUNKS_PER_JOB, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++)
+            function(*chunks[i]);
+    });
+}
+
+void updateWorldMatrices(EntityStore &store, JobSystem &jobs)
+{
+    forEachChunkInJobs(store, COMPONENT_BIT(TRANSFORM) | COMPONENT_BIT(WORLD_MATRIX), jobs, [](Chunk &chunk) {
+        const Transform *transforms = chunk.array<Transform>();
+        glm::mat4 *matrices = chunk.array<glm::mat4>();
+        for (unsigned int row = 0; row < chunk.count; row++)
+            matrices[row] = worldMatrix(transforms[row]);
+    });
+}
+
+void updateWorldBounds(EntityStore &store, JobSystem &jobs)
+{
+    forEachChunkInJobs(store, COMPONENT_BIT(WORLD_MATRIX) | COMPONENT_BIT(WORLD_BOUNDS) | COMPONENT_BIT(RENDER_HANDLE), jobs, [](Chunk &chunk) {
+        const glm::mat4 *matrices = chunk.array<glm::mat4>();
+        const RenderHandle *handles = chunk.array<RenderHandle>();
+        Bounds *bounds = chunk.array<Bounds>();
+        for (unsigned int row = 0; row < chunk.count; row++)
+            bounds[row] = transformBounds(handles[row].model->localBounds, matrices[row]);
+    });
+}
+
+void gatherWorldMatrices(EntityStore &store, const Model *model, std::vector<glm::mat4> &matrices)
+{
+    matrices.resize(model->instanceCount);
+    store.forEachChunk(COMPONENT_BIT(WORLD_MATRIX) | COMPONENT_BIT(RENDER_HANDLE), model, [&](Chunk &chunk) {
+        const glm::mat4 *world = chunk.array<glm::mat4>();
+        const RenderHandle *handles = chunk.array<RenderHandle>();
+        for (unsigned int row = 0; row < chunk.count; row++)
+            matrices[handles[row].instance] = world[row];
+    });
+}
@@ -0,0 +1,23 @@
+#ifndef SYSTEMS_HPP
+#define SYSTEMS_HPP
+
+#include <scene/entityStore.hpp>
+#include <helpers/jobSystem.hpp>
+#include <vector>
+
+// Passes over the entity store, each one a linear walk over the chunks that have its components;
+// the per frame ones hand the chunks out to jobs
+
+// translate * scale * rotate x, y, z, the order Model always used
+glm::mat4 worldMatrix(const Transform &transform);
+// world box of a model space box under a matrix
+Bounds transformBounds(const Bounds &local, const glm::mat4 &matrix);
+
+// Transform -> world matrix, for every entity with both
+void updateWorldMatrices(EntityStore &store, JobSystem &jobs);
+// World matrix and the render handle's model bounds -> world bounds
+void updateWorldBounds(EntityStore &store, JobSystem &jobs);
+// Draw list of one model: its instances' world matrices, in instance order
+void gatherWorldMatrices(EntityStore &store, const Model *model, std::vector<glm::mat4> &matrices);
+
+#endif // SYSTEMS_HPP
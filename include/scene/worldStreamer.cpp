@@ -0,0 +1,595 @@
+#include <scene/worldStreamer.hpp>
+#include <scene/binaryStream.hpp>
+#include <scene/sceneSaver.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <helpers/sceneTree.hpp>
+#include <model/model.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+static const uint32_t MODEL_CASTS_SHADOWS = 1;
+static const uint32_t MODEL_IS_OCCLUDER = 2;
+// a streamed instance: its entity, draw list and instance buffer entries and its scene tree node, roughly
+static const size_t INSTANCE_BYTES = 512;
+
+static uint64_t cellKey(int x, int z) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z; }
+
+static std::string cellFile(int x, int z) { return "cell_" + std::to_string(x) + "_" + std::to_string(z) + ".sn"; }
+
+bool writeWorld(const std::string &directory, float cellSize, const std::vector<Model *> &models, const SceneIndex &index)
+{
+    if (cellSize <= 0.0f)
+        return false;
+    SceneSnapshot scene;
+    captureScene(models, index, scene);
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        std::cout << "ERROR::WORLD::CANNOT_CREATE: " << directory << " (" << error.message() << ")" << std::endl;
+        return false;
+    }
+
+    // instances of each model, per cell
+    struct CellInstances {
+        int x, z;
+        std::vector<std::vector<uint32_t>> ofModel;
+        uint32_t count = 0;
+    };
+    std::vector<CellInstances> grid;
+    OpenHashMap<uint64_t, unsigned int> cellOf;
+    uint32_t instance = 0;
+    for (size_t m = 0; m < scene.models.size(); m++)
+    {
+        for (uint32_t i = 0; i < scene.models[m].instanceCount; i++, instance++)
+        {
+            const glm::vec3 &position = scene.transforms[instance].position;
+            int x = (int)std::floor(position.x / cellSize), z = (int)std::floor(position.z / cellSize);
+            const unsigned int *found = cellOf.find(cellKey(x, z));
+            unsigned int cell = found != nullptr ? *found : (unsigned int)grid.size();
+            if (found == nullptr)
+            {
+                cellOf.insert(cellKey(x, z), cell);
+                grid.push_back(CellInstances{x, z, std::vector<std::vector<uint32_t>>(scene.models.size())});
+            }
+            grid[cell].ofModel[m].push_back(instance);
+            grid[cell].count++;
+        }
+    }
+
+    std::vector<unsigned char> world, bytes;
+    put(world, WORLD_FILE_MAGIC);
+    put(world, WORLD_FILE_VERSION);
+    put(world, cellSize);
+    put(world, (uint32_t)scene.models.size());
+    for (const SceneSnapshot::ModelRange &range : scene.models)
+    {
+        putString(world, range.record.path);
+        putString(world, range.record.vertexShader);
+        putString(world, range.record.fragmentShader);
+        put(world, (uint32_t)((range.record.castsShadows ? MODEL_CASTS_SHADOWS : 0) | (range.record.isOccluder ? MODEL_IS_OCCLUDER : 0)));
+    }
+    put(world, (uint32_t)grid.size());
+    for (const CellInstances &cell : grid)
+    {
+        SceneSnapshot part;
+        std::vector<uint32_t> needs;
+        for (uint32_t m = 0; m < (uint32_t)cell.ofModel.size(); m++)
+        {
+            if (cell.ofModel[m].empty())
+                continue;
+            needs.push_back(m);
+            part.models.push_back(SceneSnapshot::ModelRange{scene.models[m].record, (uint32_t)cell.ofModel[m].size()});
+            for (uint32_t i : cell.ofModel[m])
+            {
+                part.hierarchy.push_back({(uint32_t)part.ids.size(), -1});
+                part.transforms.push_back(scene.transforms[i]);
+                part.ids.push_back(scene.ids[i]);
+                part.names.push_back(scene.names[i]);
+            }
+        }
+        encodeSceneSnapshot(part, bytes);
+        if (!writeFileAtomically((std::filesystem::path(directory) / cellFile(cell.x, cell.z)).string(), bytes))
+            return false;
+
+        put(world, (int32_t)cell.x);
+        put(world, (int32_t)cell.z);
+        put(world, cell.count);
+        put(world, (uint32_t)needs.size());
+        putArray(world, needs);
+    }
+    // last, so a world file only ever lists cells that are on disk
+    return writeFileAtomically((std::filesystem::path(directory) / "world.wld").string(), world);
+}
+
+WorldStreamer::WorldStreamer(SceneIndex &index, SceneTreeNode *parent)
+    : index(index), parent(parent), reader(&WorldStreamer::read, this), importer(&WorldStreamer::importModels, this)
+{
+}
+
+WorldStreamer::~WorldStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    importWake.notify_one();
+    reader.join();
+    importer.join();
+    close();
+}
+
+bool WorldStreamer::open(const std::string &worldPath)
+{
+    close();
+    std::ifstream file(worldPath, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+    std::vector<unsigned char> data((size_t)std::max<std::streamoff>(0, file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(data.data()), (std::streamsize)data.size()))
+        return false;
+
+    ByteReader in{data.data(), data.data() + data.size()};
+    if (in.read<uint32_t>() != WORLD_FILE_MAGIC || in.read<uint32_t>() > WORLD_FILE_VERSION)
+    {
+        std::cout << "ERROR::WORLD::NOT_A_WORLD: " << worldPath << std::endl;
+        return false;
+    }
+    cellSize = in.read<float>();
+    uint32_t modelCount = in.read<uint32_t>();
+    for (uint32_t m = 0; m < modelCount && in.ok; m++)
+    {
+        WorldModel model;
+        model.record.path = in.string();
+        model.record.vertexShader = in.string();
+        model.record.fragmentShader = in.string();
+        uint32_t flags = in.read<uint32_t>();
+        model.record.castsShadows = (flags & MODEL_CASTS_SHADOWS) != 0;
+        model.record.isOccluder = (flags & MODEL_IS_OCCLUDER) != 0;
+        std::error_code error;
+        model.bytes = (size_t)std::filesystem::file_size(model.record.path, error);
+        if (error)
+            model.bytes = 0;
+        worldModels.push_back(std::move(model));
+    }
+    uint32_t cellCount = in.read<uint32_t>();
+    directory = std::filesystem::path(worldPath).parent_path().string();
+    for (uint32_t c = 0; c < cellCount && in.ok; c++)
+    {
+        Cell cell;
+        cell.x = in.read<int32_t>();
+        cell.z = in.read<int32_t>();
+        cell.instanceCount = in.read<uint32_t>();
+        in.array(cell.models, in.read<uint32_t>());
+        cell.file = (std::filesystem::path(directory) / cellFile(cell.x, cell.z)).string();
+        for (unsigned int m : cell.models)
+            in.ok = in.ok && m < worldModels.size();
+        if (in.ok && cellAt.insert(cellKey(cell.x, cell.z), (unsigned int)cells.size()))
+            cells.push_back(std::move(cell));
+    }
+    if (!in.ok || !(cellSize > 0.0f))
+    {
+        std::cout << "ERROR::WORLD::CORRUPT: " << worldPath << std::endl;
+        close();
+        return false;
+    }
+    stats.cells = (unsigned int)cells.size();
+    return true;
+}
+
+void WorldStreamer::close()
+{
+    for (unsigned int cell : std::vector<unsigned int>(active))
+    {
+        if (cells[cell].state == LOADED)
+            unloadCell(cell);
+        else
+            dropCell(cell);
+    }
+    for (WorldModel &world : worldModels)
+        delete world.model;
+    worldModels.clear();
+    loadedModels.clear();
+    cells.clear();
+    cellAt = OpenHashMap<uint64_t, unsigned int>();
+    active.clear();
+    streamedInstances = loadedBytes = pendingBytes = 0;
+    generation++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.clear();
+        imports.clear();
+    }
+    stats = WorldStreamerStats();
+}
+
+float WorldStreamer::distance(const Cell &cell, const glm::vec3 &camera) const
+{
+    float x0 = cell.x * cellSize, z0 = cell.z * cellSize;
+    float dx = std::max({x0 - camera.x, 0.0f, camera.x - (x0 + cellSize)});
+    float dz = std::max({z0 - camera.z, 0.0f, camera.z - (z0 + cellSize)});
+    return std::sqrt(dx * dx + dz * dz);
+}
+
+void WorldStreamer::update(const glm::vec3 &camera)
+{
+    if (cells.empty())
+        return;
+    auto start = std::chrono::steady_clock::now();
+    collectReads();
+    collectImports();
+
+    // out of range first, it frees budget for what comes in
+    unsigned int instancesLeft = instancesPerFrame;
+    for (size_t a = active.size(); a-- > 0;)
+    {
+        unsigned int cell = active[a];
+        if (distance(cells[cell], camera) <= unloadRadius)
+            continue;
+        if (cells[cell].state == READING)
+            cells[cell].wanted = false; // dropped when the read comes back
+        else if (cells[cell].state == READ)
+            dropCell(cell);
+        else if (instancesLeft == instancesPerFrame || cells[cell].ids.size() <= instancesLeft)
+        {
+            instancesLeft -= (unsigned int)std::min<size_t>(instancesLeft, cells[cell].ids.size());
+            unloadCell(cell);
+        }
+    }
+
+    // cells in range that are not loaded yet, nearest on top
+    FrameVector<std::pair<float, unsigned int>> queue;
+    int x0 = (int)std::floor((camera.x - loadRadius) / cellSize), x1 = (int)std::floor((camera.x + loadRadius) / cellSize);
+    int z0 = (int)std::floor((camera.z - loadRadius) / cellSize), z1 = (int)std::floor((camera.z + loadRadius) / cellSize);
+    for (int x = x0; x <= x1; x++)
+    {
+        for (int z = z0; z <= z1; z++)
+        {
+            const unsigned int *cell = cellAt.find(cellKey(x, z));
+            if (cell == nullptr || cells[*cell].state == LOADED || cells[*cell].corrupt)
+                continue;
+            float d = distance(cells[*cell], camera);
+            if (d <= loadRadius)
+                queue.push_back({d, *cell});
+        }
+    }
+    std::greater<std::pair<float, unsigned int>> farther;
+    std::make_heap(queue.begin(), queue.end(), farther);
+
+    modelLoadsLeft = modelLoadsPerFrame;
+    unsigned int reads = 0;
+    for (unsigned int cell : active)
+        reads += cells[cell].state == READING ? 1 : 0;
+    while (!queue.empty())
+    {
+        std::pop_heap(queue.begin(), queue.end(), farther);
+        float d = queue.back().first;
+        unsigned int c = queue.back().second;
+        queue.pop_back();
+        Cell &cell = cells[c];
+
+        if (cell.state == READING)
+        {
+            cell.wanted = true;
+            loadModels(cell); // meanwhile
+        }
+        else if (cell.state == READ)
+        {
+            loadCell(c, instancesLeft);
+        }
+        else if (reads < readsInFlight)
+        {
+            // models no cell needs go first, they were only kept in case their cells came back
+            if (residentBytes() + pendingBytes + cellBytes(cell) > memoryBudget)
+                evictModels(true);
+            if (residentBytes() + pendingBytes + cellBytes(cell) > memoryBudget)
+            {
+                // nearer cells win: the farthest loaded one makes room when it is farther than this one
+                int farthest = -1;
+                float farthestDistance = d;
+                for (unsigned int other : active)
+                {
+                    float o = distance(cells[other], camera);
+                    if (cells[other].state == LOADED && o > farthestDistance)
+                    {
+                        farthest = (int)other;
+                        farthestDistance = o;
+                    }
+                }
+                if (farthest < 0 || (instancesLeft != instancesPerFrame && cells[farthest].ids.size() > instancesLeft))
+                    continue;
+                instancesLeft -= (unsigned int)std::min<size_t>(instancesLeft, cells[farthest].ids.size());
+                unloadCell((unsigned int)farthest);
+                evictModels(true);
+                if (residentBytes() + pendingBytes + cellBytes(cell) > memoryBudget)
+                    continue;
+            }
+            requestRead(c);
+            reads++;
+        }
+    }
+    evictModels();
+
+    stats.loaded = stats.reading = stats.waiting = stats.importing = 0;
+    for (unsigned int cell : active)
+    {
+        stats.loaded += cells[cell].state == LOADED ? 1 : 0;
+        stats.reading += cells[cell].state == READING ? 1 : 0;
+        stats.waiting += cells[cell].state == READ ? 1 : 0;
+    }
+    for (const WorldModel &world : worldModels)
+        stats.importing += world.importing ? 1 : 0;
+    stats.instances = streamedInstances;
+    stats.models = (unsigned int)loadedModels.size();
+    stats.bytes = residentBytes();
+    stats.updateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void WorldStreamer::collectReads()
+{
+    std::vector<ReadJob> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(finished);
+    }
+    for (ReadJob &job : done)
+    {
+        if (job.generation != generation)
+            continue;
+        Cell &cell = cells[job.cell];
+        if (job.contents != nullptr && job.contents->models.size() != cell.models.size())
+        {
+            // not retried, it would come back the same
+            std::cout << "ERROR::WORLD::CELL_MISMATCH: " << cell.file << std::endl;
+            cell.corrupt = true;
+            job.contents.reset();
+        }
+        if (!cell.wanted || job.contents == nullptr)
+        {
+            dropCell(job.cell);
+            continue;
+        }
+        cell.contents = std::move(job.contents);
+        cell.state = READ;
+    }
+}
+
+void WorldStreamer::requestRead(unsigned int c)
+{
+    Cell &cell = cells[c];
+    cell.state = READING;
+    cell.wanted = true;
+    active.push_back(c);
+    cell.reservedBytes = cellBytes(cell);
+    pendingBytes += cell.reservedBytes;
+    for (unsigned int m : cell.models)
+        worldModels[m].cells++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(ReadJob{generation, c, cell.file, nullptr});
+    }
+    wake.notify_one();
+}
+
+void WorldStreamer::collectImports()
+{
+    std::vector<ImportJob> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(importsDone);
+    }
+    for (ImportJob &job : done)
+    {
+        if (job.generation != generation)
+            continue;
+        WorldModel &world = worldModels[job.model];
+        world.importing = false;
+        world.bytes = job.imported->bytes();
+        world.imported = std::move(job.imported);
+    }
+}
+
+void WorldStreamer::requestImport(unsigned int m)
+{
+    WorldModel &world = worldModels[m];
+    world.importing = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        imports.push_back(ImportJob{generation, m, world.record.path, nullptr});
+    }
+    importWake.notify_one();
+}
+
+size_t WorldStreamer::residentBytes() const
+{
+    return loadedBytes + streamedInstances * INSTANCE_BYTES;
+}
+
+size_t WorldStreamer::cellBytes(const Cell &cell) const
+{
+    size_t bytes = cell.instanceCount * INSTANCE_BYTES;
+    // models another cell already loads or holds are paid for
+    for (unsigned int m : cell.models)
+    {
+        const WorldModel &world = worldModels[m];
+        if (world.model == nullptr && world.cells == 0)
+            bytes += world.bytes;
+    }
+    return bytes;
+}
+
+bool WorldStreamer::loadModels(const Cell &cell)
+{
+    bool ready = true;
+    for (unsigned int m : cell.models)
+    {
+        WorldModel &world = worldModels[m];
+        if (world.model != nullptr)
+            continue;
+        if (world.imported == nullptr)
+        {
+            if (!world.importing)
+                requestImport(m);
+            ready = false;
+            continue;
+        }
+        if (modelLoadsLeft == 0)
+        {
+            ready = false;
+            continue;
+        }
+        modelLoadsLeft--;
+        std::string name = std::filesystem::path(world.record.path).stem().string();
+        world.model = new Model(*world.imported, world.record.vertexShader.c_str(), world.record.fragmentShader.c_str(), name);
+        world.imported.reset();
+        // the constructor makes a first instance, the cells bring their own
+        world.model->removeInstance(0);
+        world.model->castsShadows = world.record.castsShadows;
+        world.model->isOccluder = world.record.isOccluder;
+        loadedModels.push_back(world.model);
+        loadedBytes += world.model->bytes;
+        stats.modelLoads++;
+    }
+    return ready;
+}
+
+bool WorldStreamer::loadCell(unsigned int c, unsigned int &instancesLeft)
+{
+    Cell &cell = cells[c];
+    if (!loadModels(cell))
+        return false;
+    size_t count = cell.contents->ids.size();
+    if (instancesLeft != instancesPerFrame && count > instancesLeft)
+        return false;
+    instancesLeft -= (unsigned int)std::min<size_t>(instancesLeft, count);
+
+    const SceneSnapshot &contents = *cell.contents;
+    uint32_t instance = 0;
+    // writeWorld puts the ranges in the order of the cell's models, collectReads checked the counts
+    for (size_t r = 0; r < contents.models.size(); r++)
+    {
+        Model *model = worldModels[cell.models[r]].model;
+        for (uint32_t i = 0; i < contents.models[r].instanceCount; i++, instance++)
+        {
+            const Transform &transform = contents.transforms[instance];
+            unsigned int added = (unsigned int)model->addInstance(transform.position, transform.rotation, transform.scale, *contents.names[instance]);
+            size_t id = (size_t)contents.ids[instance];
+            Model::entities.get<StableId>(model->instanceEntities[added])->value = id;
+            // an ID that is taken (the instance is in the saved scene too) keeps the copy already there
+            if (insertInstanceToSceneTree(index, parent, model, added) == nullptr)
+                model->removeInstance(added);
+            else
+                cell.ids.push_back(id);
+        }
+    }
+    pendingBytes -= cell.reservedBytes;
+    cell.reservedBytes = 0;
+    streamedInstances += cell.ids.size();
+    cell.contents.reset();
+    cell.state = LOADED;
+    stats.cellLoads++;
+    return true;
+}
+
+void WorldStreamer::unloadCell(unsigned int c)
+{
+    Cell &cell = cells[c];
+    for (size_t id : cell.ids)
+        removeInstanceFromSceneTree(index, id); // nothing for instances deleted in the editor
+    streamedInstances -= cell.ids.size();
+    cell.ids.clear();
+    stats.cellUnloads++;
+    dropCell(c);
+}
+
+void WorldStreamer::dropCell(unsigned int c)
+{
+    Cell &cell = cells[c];
+    pendingBytes -= cell.reservedBytes;
+    cell.reservedBytes = 0;
+    for (unsigned int m : cell.models)
+        worldModels[m].cells--;
+    cell.contents.reset();
+    cell.state = UNLOADED;
+    cell.wanted = false;
+    auto at = std::find(active.begin(), active.end(), c);
+    if (at != active.end())
+    {
+        *at = active.back();
+        active.pop_back();
+    }
+}
+
+void WorldStreamer::evictModels(bool now)
+{
+    for (WorldModel &world : worldModels)
+    {
+        if ((world.model == nullptr && world.imported == nullptr) || world.cells > 0)
+        {
+            world.idleFrames = 0;
+            continue;
+        }
+        // instances spawned in the editor keep their model
+        if ((!now && ++world.idleFrames <= modelKeepFrames) || (world.model != nullptr && world.model->instanceCount > 0))
+            continue;
+        if (world.model != nullptr)
+        {
+            loadedModels.erase(std::find(loadedModels.begin(), loadedModels.end(), world.model));
+            loadedBytes -= world.model->bytes;
+            delete world.model;
+            world.model = nullptr;
+        }
+        world.imported.reset();
+        world.idleFrames = 0;
+    }
+}
+
+void WorldStreamer::read()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]() { return stopping || !requests.empty(); });
+        if (stopping)
+            return;
+        ReadJob job = std::move(requests.front());
+        requests.pop_front();
+        lock.unlock();
+
+        job.contents = std::make_unique<SceneSnapshot>();
+        if (!readSceneFile(job.path, *job.contents))
+        {
+            std::cout << "ERROR::WORLD::CANNOT_READ_CELL: " << job.path << std::endl;
+            job.contents.reset();
+        }
+
+        lock.lock();
+        finished.push_back(std::move(job));
+    }
+}
+
+void WorldStreamer::importModels()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        importWake.wait(lock, [this]() { return stopping || !imports.empty(); });
+        if (stopping)
+            return;
+        ImportJob job = std::move(imports.front());
+        imports.pop_front();
+        lock.unlock();
+
+        job.imported = std::make_unique<ModelImport>(Model::import(job.path));
+
+        lock.lock();
+        importsDone.push_back(std::move(job));
+    }
+}
@@ -0,0 +1,163 @@
+#ifndef WORLD_STREAMER_HPP
+#define WORLD_STREAMER_HPP
+
+#include <scene/sceneFile.hpp>
+#include <helpers/openHashMap.hpp>
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Model;
+struct ModelImport;
+class SceneIndex;
+struct SceneTreeNode;
+
+// World (.wld) beside its cells: a header with the cell size, the model table (path, shaders, flags),
+// then per cell its grid coordinates, its instance count and the models it needs, as indices into the
+// table. Each cell is a binary scene file of its own, cell_<x>_<z>.sn in the same directory, holding
+// the instances whose position falls inside it, all of them roots.
+static const uint32_t WORLD_FILE_MAGIC = 0x574E4353; // "SCNW"
+static const uint32_t WORLD_FILE_VERSION = 1;
+
+// Writes the instances of models as a world of cellSize square cells (on x and z) in directory;
+// taking them out of the scene is up to the caller
+bool writeWorld(const std::string &directory, float cellSize, const std::vector<Model *> &models, const SceneIndex &index);
+
+struct WorldStreamerStats {
+    unsigned int cells = 0;
+    unsigned int loaded = 0;
+    unsigned int reading = 0;  // queued for or on the reader thread
+    unsigned int waiting = 0;  // read, waiting for models or the budget
+    size_t instances = 0;      // streamed in
+    unsigned int models = 0;
+    unsigned int importing = 0;  // queued for or on the importer thread
+    size_t bytes = 0;            // estimated, of the loaded models and the streamed instances
+    unsigned int modelLoads = 0; // since the world was opened
+    unsigned int cellLoads = 0;
+    unsigned int cellUnloads = 0;
+    float updateMs = 0.0f;
+};
+
+// Streams the cells of a world around the camera. Cells within loadRadius (measured on x and z, to the
+// nearest point of the cell) are read and parsed on a reader thread, nearest first. The models they
+// need are imported (Assimp and image decoding) on an importer thread; the main thread then uploads
+// them and creates the cells' instances under parent, both with a per frame budget. What is loaded
+// stays under a memory budget, estimated from the imports. Cells only go once they are past unloadRadius, so a camera on a cell border does not make
+// them flicker in and out. Models are shared by the cells that need them and deleted some frames after
+// the last of those cells went. The streamed models are not in the saved scene: the world files are
+// their only copy, edits to streamed instances last until their cell unloads.
+class WorldStreamer {
+public:
+    WorldStreamer(SceneIndex &index, SceneTreeNode *parent);
+    // unloads everything and stops the reader
+    ~WorldStreamer();
+
+    // replaces the world streamed so far
+    bool open(const std::string &worldPath);
+    void close();
+    bool isOpen() const { return !cells.empty(); }
+    // once per frame, before the scene is culled and drawn
+    void update(const glm::vec3 &camera);
+    const std::vector<Model *> &models() const { return loadedModels; }
+
+    float loadRadius = 60.0f;
+    float unloadRadius = 80.0f;
+    size_t memoryBudget = (size_t)1024 * 1024 * 1024; // bytes of loaded models and streamed instances, nearer cells win
+    unsigned int modelLoadsPerFrame = 1;     // GL uploads of imported models, the expensive part left on this thread
+    unsigned int instancesPerFrame = 2000;   // created or removed; a cell is never split across frames
+    unsigned int readsInFlight = 4;
+    unsigned int modelKeepFrames = 120;      // an unused model stays this long, in case its cells come back
+    WorldStreamerStats stats;
+
+private:
+    enum CellState { UNLOADED, READING, READ, LOADED };
+    struct Cell {
+        int x, z;
+        std::string file;
+        std::vector<unsigned int> models; // in worldModels
+        uint32_t instanceCount;
+        CellState state = UNLOADED;
+        bool wanted = false; // still in range when its read finishes
+        bool corrupt = false; // its file does not match the world, it is never loaded
+        std::unique_ptr<SceneSnapshot> contents;
+        std::vector<size_t> ids; // stable IDs of its instances while loaded
+        size_t reservedBytes = 0; // in pendingBytes while it is read or waits
+    };
+    struct WorldModel {
+        SceneModelRecord record;
+        Model *model = nullptr;
+        std::unique_ptr<ModelImport> imported; // waiting for its upload
+        bool importing = false;
+        size_t bytes = 0;            // ModelImport::bytes() once imported, the file size before that
+        unsigned int cells = 0;      // loaded or loading cells that need it
+        unsigned int idleFrames = 0;
+    };
+    struct ReadJob {
+        unsigned int generation; // of the world it was asked for
+        unsigned int cell;
+        std::string path;
+        std::unique_ptr<SceneSnapshot> contents; // null when the read failed
+    };
+    struct ImportJob {
+        unsigned int generation;
+        unsigned int model; // in worldModels
+        std::string path;
+        std::unique_ptr<ModelImport> imported;
+    };
+
+    SceneIndex &index;
+    SceneTreeNode *parent;
+    std::string directory;
+    float cellSize = 1.0f;
+    std::vector<Cell> cells;
+    OpenHashMap<uint64_t, unsigned int> cellAt; // packed grid coordinates -> cell
+    std::vector<WorldModel> worldModels;
+    std::vector<Model *> loadedModels;
+    std::vector<unsigned int> active; // cells that are not UNLOADED
+    size_t streamedInstances = 0;
+    size_t loadedBytes = 0;  // of the uploaded models
+    size_t pendingBytes = 0; // reserved by the cells being read or waiting
+    unsigned int modelLoadsLeft = 0;
+    unsigned int generation = 0; // bumped by close(), reads of an older world are dropped
+
+    // reader and importer threads
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<ReadJob> requests;
+    std::vector<ReadJob> finished;
+    std::condition_variable importWake;
+    std::deque<ImportJob> imports;
+    std::vector<ImportJob> importsDone;
+    bool stopping = false;
+    std::thread reader; // last, they start running once everything above exists
+    std::thread importer;
+
+    float distance(const Cell &cell, const glm::vec3 &camera) const;
+    void collectReads();
+    void requestRead(unsigned int cell);
+    void collectImports();
+    void requestImport(unsigned int model);
+    // estimated bytes of what is loaded, and of what loading the cell would add to it
+    size_t residentBytes() const;
+    size_t cellBytes(const Cell &cell) const;
+    // imports the cell's missing models and uploads what the frame's budget allows, true once all are there
+    bool loadModels(const Cell &cell);
+    // false while it waits for models or the frame's budget
+    bool loadCell(unsigned int cell, unsigned int &instancesLeft);
+    // removes the instances of a loaded cell, then drops it
+    void unloadCell(unsigned int cell);
+    // back to UNLOADED from any state, giving up the cell's models and budget
+    void dropCell(unsigned int cell);
+    // deletes the models no cell needs after modelKeepFrames, or right away with now
+    void evictModels(bool now = false);
+    void read();
+    void importModels();
+};
+
+#endif // WORLD_STREAMER_HPP
@@ -0,0 +1,167 @@
+#include "material.hpp"
+#include <algorithm>
+#include <cstring>
+
+MaterialStats Material::frameStats;
+unsigned long long Material::nextSerial = 1;
+std::vector<Material *> Material::live;
+
+Material::Material(ShaderPermutations *shaders)
+{
+    this->shaders = shaders;
+    serial = nextSerial++;
+    live.push_back(this);
+}
+
+Material::~Material()
+{
+    live.erase(std::find(live.begin(), live.end(), this));
+    delete shaders;
+}
+
+void Material::forgetProgram(unsigned long long programSerial)
+{
+    for (Material *material : live)
+        material->programs.erase(programSerial);
+}
+
+void Material::set(std::string_view name, UniformType type, const float *data, size_t size)
+{
+    const size_t *found = lookup.find(name);
+    if (found == nullptr)
+    {
+        names.emplace_back(name);
+        Uniform uniform;
+        uniform.name = names.back().c_str();
+        uniform.type = type;
+        uniform.offset = block.size();
+        uniform.size = size;
+        uniform.version = 1;
+        block.insert(block.end(), data, data + size);
+        lookup.insert(names.back(), uniforms.size());
+        uniforms.push_back(uniform);
+        return;
+    }
+
+    Uniform &uniform = uniforms[*found];
+    if (uniform.size != size)
+    {
+        std::cout << "ERROR::MATERIAL::UNIFORM_SIZE_MISMATCH: " << name << std::endl;
+        return;
+    }
+    float *stored = &block[uniform.offset];
+    if (uniform.type == type && std::memcmp(stored, data, size * sizeof(float)) == 0)
+        return;
+    uniform.type = type;
+    std::memcpy(stored, data, size * sizeof(float));
+    uniform.version++;
+}
+
+void Material::apply(Shader &shader)
+{
+    ProgramState &state = programs[shader.serial];
+    if (state.locations.size() < uniforms.size())
+    {
+        state.locations.resize(uniforms.size(), -2);
+        state.uploaded.resize(uniforms.size(), 0);
+    }
+    // another material's values are in the program now, ours all go again
+    if (shader.uniformOwner != serial)
+    {
+        std::fill(state.uploaded.begin(), state.uploaded.end(), 0);
+        shader.uniformOwner = serial;
+    }
+
+    for (size_t i = 0; i < uniforms.size(); i++)
+    {
+        const Uniform &uniform = uniforms[i];
+        if (state.uploaded[i] == uniform.version)
+        {
+            frameStats.avoided++;
+            continue;
+        }
+        if (state.locations[i] == -2)
+            state.locations[i] = glGetUniformLocation(shader.ID, uniform.name);
+        // uniforms this variant compiled out have no location, there is nothing to send
+        if (state.locations[i] >= 0)
+        {
+            upload(uniform, state.locations[i]);
+            frameStats.uploads++;
+        }
+        state.uploaded[i] = uniform.version;
+    }
+}
+
+void Material::upload(const Uniform &uniform, GLint location) const
+{
+    const float *data = &block[uniform.offset];
+    switch (uniform.type)
+    {
+    case Int:
+    {
+        int value;
+        std::memcpy(&value, data, sizeof(int));
+        glUniform1i(location, value);
+        break;
+    }
+    case Float:
+        glUniform1f(location, data[0]);
+        break;
+    case Vec2:
+        glUniform2fv(location, 1, data);
+        break;
+    case Vec3:
+        glUniform3fv(location, 1, data);
+        break;
+    case Vec4:
+        glUniform4fv(location, 1, data);
+        break;
+    case Mat3:
+        glUniformMatrix3fv(location, 1, GL_FALSE, data);
+        break;
+    case Mat4:
+        glUniformMatrix4fv(location, 1, GL_FALSE, data);
+        break;
+    }
+}
+// ------------------------------------------------------------------------
+void Material::setBool(std::string_view name, bool value)
+{
+    setInt(name, (int)value);
+}
+void Material::setInt(std::string_view name, int value)
+{
+    float data;
+    std::memcpy(&data, &value, sizeof(float));
+    set(name, Int, &data, 1);
+}
+void Material::setFloat(std::string_view name, float value)
+{
+    set(name, Float, &value, 1);
+}
+// ------------------------------------------------------------------------
+void Material::setVec2(std::string_view name, const glm::vec2 &value)
+{
+    set(name, Vec2, &value[0], 2);
+}
+void Material::setVec3(std::string_view name, const glm::vec3 &value)
+{
+    set(name, Vec3, &value[0], 3);
+}
+void Material::setVec3(std::string_view name, float x, float y, float z)
+{
+    setVec3(name, glm::vec3(x, y, z));
+}
+void Material::setVec4(std::string_view name, const glm::vec4 &value)
+{
+    set(name, Vec4, &value[0], 4);
+}
+// ------------------------------------------------------------------------
+void Material::setMat3(std::string_view name, const glm::mat3 &mat)
+{
+    set(name, Mat3, &mat[0][0], 9);
+}
+void Material::setMat4(std::string_view name, const glm::mat4 &mat)
+{
+    set(name, Mat4, &mat[0][0], 16);
+}
@@ -0,0 +1,77 @@
+#ifndef MATERIAL_HPP
+#define MATERIAL_HPP
+
+#include <shaders/shaderPermutations.hpp>
+#include <helpers/openHashMap.hpp>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Uniform upload counters, reset by Material::beginFrame()
+struct MaterialStats {
+    unsigned int uploads = 0; // glUniform* calls issued
+    unsigned int avoided = 0; // values skipped because the program already had them
+};
+
+// A program family plus a CPU-side copy of its uniform values. Setters only write the shadow
+// block and bump a version when the value really changed; apply() then uploads just the values
+// the bound program has not seen yet. Uniform state lives in the program object, so each variant
+// keeps its own record of what was uploaded to it. Programs can be shared (the placeholders of
+// ShaderCompiler are), so a program that another material uploaded to since starts over.
+class Material {
+public:
+    explicit Material(ShaderPermutations *shaders);
+    ~Material();
+
+    void setBool(std::string_view name, bool value);
+    void setInt(std::string_view name, int value);
+    void setFloat(std::string_view name, float value);
+    void setVec2(std::string_view name, const glm::vec2 &value);
+    void setVec3(std::string_view name, const glm::vec3 &value);
+    void setVec3(std::string_view name, float x, float y, float z);
+    void setVec4(std::string_view name, const glm::vec4 &value);
+    void setMat3(std::string_view name, const glm::mat3 &mat);
+    void setMat4(std::string_view name, const glm::mat4 &mat);
+
+    // Flushes the dirty values into shader, which must be the program currently in use
+    void apply(Shader &shader);
+
+    static void beginFrame() { frameStats = MaterialStats(); }
+    static MaterialStats frameStats;
+    // Drops every material's record of a program, called when the program is deleted
+    static void forgetProgram(unsigned long long programSerial);
+
+    ShaderPermutations *shaders;
+
+private:
+    enum UniformType { Int, Float, Vec2, Vec3, Vec4, Mat3, Mat4 };
+
+    struct Uniform {
+        const char *name;         // in names
+        UniformType type;
+        size_t offset;            // into block, in floats
+        size_t size;              // in floats
+        unsigned int version = 0; // bumped on every real change
+    };
+
+    struct ProgramState {
+        std::vector<GLint> locations;          // -2 until looked up
+        std::vector<unsigned int> uploaded;    // version last sent to this program
+    };
+
+    std::vector<float> block; // shadow copy of every value, tightly packed
+    std::vector<Uniform> uniforms;
+    std::deque<std::string> names; // never moved, the lookup keys point into them
+    OpenHashMap<std::string_view, size_t> lookup; // setters do not build a std::string per call
+    std::unordered_map<unsigned long long, ProgramState> programs; // by Shader::serial
+    unsigned long long serial; // what Shader::uniformOwner holds, addresses get reused
+    static unsigned long long nextSerial;
+    static std::vector<Material *> live;
+
+    void set(std::string_view name, UniformType type, const float *data, size_t size);
+    void upload(const Uniform &uniform, GLint location) const;
+};
+
+#endif // MATERIAL_HPP
@@ -1,8 +1,16 @@
 #include "shader.hpp"
+#include "shaderCompiler.hpp"
+#include "material.hpp"
+#include <helpers/glExtensions.hpp>
+#include <helpers/glState.hpp>
+#include <algorithm>
+#include <filesystem>
 
 
 using namespace std;
 
+unsigned long long Shader::nextSerial = 1;
+
 Shader::Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath)
 {
     // 1. retrieve the vertex/fragment source code from filePath
@@ -47,109 +55,300 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath, const char *geo
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
     }
+    build(vertexCode, fragmentCode, geometryCode);
+    finish();
+}
+
+Shader::Shader(const char *vertexPath, const char *fragmentPath, const ShaderDefines &defines, const char *geometryPath)
+{
+    vertex = vertexPath;
+    fragment = fragmentPath;
+    this->defines = defines;
+
+    std::string vertexCode = preprocess(vertexPath, defines, &sourceFiles["VERTEX"]);
+    std::string fragmentCode = preprocess(fragmentPath, defines, &sourceFiles["FRAGMENT"]);
+    std::string geometryCode;
+    if (geometryPath != nullptr)
+        geometryCode = preprocess(geometryPath, defines, &sourceFiles["GEOMETRY"]);
+
+    build(vertexCode, fragmentCode, geometryPath != nullptr ? geometryCode : std::string());
+}
+
+Shader::Shader(const char *computePath, const ShaderDefines &defines)
+{
+    compute = computePath;
+    this->defines = defines;
+
+    std::string computeCode = preprocess(computePath, defines, &sourceFiles["COMPUTE"]);
+    const char *cShaderCode = computeCode.c_str();
+    computeID = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeID, 1, &cShaderCode, NULL);
+    glCompileShader(computeID);
+    ID = glCreateProgram();
+    glAttachShader(ID, computeID);
+    glLinkProgram(ID);
+    serial = nextSerial++;
+    status = Compiling;
+    finish();
+}
+
+Shader::~Shader()
+{
+    ShaderCompiler::remove(this);
+    if (status == Compiling)
+    {
+        for (unsigned int stage : {vertexID, fragmentID, geometryID, computeID})
+        {
+            if (stage != 0)
+                glDeleteShader(stage);
+        }
+    }
+    // GL may hand the same name to the next program, the cache must not think it is bound
+    if (GLState::currentProgram() == ID)
+        GLState::useProgram(0);
+    glDeleteProgram(ID);
+    Material::forgetProgram(serial);
+}
+
+void Shader::build(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode)
+{
     const char *vShaderCode = vertexCode.c_str();
     const char *fShaderCode = fragmentCode.c_str();
     // 2. compile shaders
-    unsigned int vertex, fragment;
     // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
+    vertexID = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexID, 1, &vShaderCode, NULL);
+    glCompileShader(vertexID);
     // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    fragmentID = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentID, 1, &fShaderCode, NULL);
+    glCompileShader(fragmentID);
     // if geometry shader is given, compile geometry shader
-    unsigned int geometry;
-    if (geometryPath != nullptr)
+    if (!geometryCode.empty())
     {
         const char *gShaderCode = geometryCode.c_str();
-        geometry = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(geometry, 1, &gShaderCode, NULL);
-        glCompileShader(geometry);
-        checkCompileErrors(geometry, "GEOMETRY");
+        geometryID = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(geometryID, 1, &gShaderCode, NULL);
+        glCompileShader(geometryID);
     }
     // shader Program
     ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    if (geometryPath != nullptr)
-        glAttachShader(ID, geometry);
+    glAttachShader(ID, vertexID);
+    glAttachShader(ID, fragmentID);
+    if (geometryID != 0)
+        glAttachShader(ID, geometryID);
     glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+    serial = nextSerial++;
+    // status queries are left to poll()/finish(): asking right away would wait for the compiler
+    status = Compiling;
+}
+
+bool Shader::poll()
+{
+    if (status != Compiling)
+        return true;
+    if (GLExtensions::parallelShaderCompile)
+    {
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done)
+            return false;
+    }
+    finish();
+    return true;
+}
+
+void Shader::finish()
+{
+    if (status != Compiling)
+        return;
+
+    bool ok = true;
+    if (vertexID != 0)
+        ok = checkCompileErrors(vertexID, "VERTEX") && ok;
+    if (fragmentID != 0)
+        ok = checkCompileErrors(fragmentID, "FRAGMENT") && ok;
+    if (geometryID != 0)
+        ok = checkCompileErrors(geometryID, "GEOMETRY") && ok;
+    if (computeID != 0)
+        ok = checkCompileErrors(computeID, "COMPUTE") && ok;
+    ok = checkCompileErrors(ID, "PROGRAM") && ok;
+    status = ok ? Ready : Failed;
+
     // delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    if (geometryPath != nullptr)
-        glDeleteShader(geometry);
+    for (unsigned int stage : {vertexID, fragmentID, geometryID, computeID})
+    {
+        if (stage != 0)
+            glDeleteShader(stage);
+    }
+    vertexID = fragmentID = geometryID = computeID = 0;
+}
+
+bool Shader::appendSource(const std::string &path, std::set<std::string> &included, std::vector<std::string> &files, std::string &out)
+{
+    std::filesystem::path filePath = std::filesystem::path(path).lexically_normal();
+    std::string key = filePath.generic_string();
+    // every file is included at most once, like #pragma once
+    if (included.count(key))
+        return true;
+    included.insert(key);
+
+    std::ifstream file(filePath);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << key << std::endl;
+        return false;
+    }
+
+    int fileIndex = (int)files.size();
+    files.push_back(key);
+    std::filesystem::path directory = filePath.parent_path();
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+        {
+            size_t open = line.find('"', start + 8);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::MALFORMED_INCLUDE: " << key << ":" << lineNumber << std::endl;
+                return false;
+            }
+            std::string includePath = (directory / line.substr(open + 1, close - open - 1)).string();
+            out += "#line 1 " + std::to_string(files.size()) + "\n";
+            if (!appendSource(includePath, included, files, out))
+                return false;
+            out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            continue;
+        }
+        out += line;
+        out += '\n';
+    }
+    return true;
+}
+
+std::string Shader::resolveIncludes(const std::string &path, std::vector<std::string> *files)
+{
+    std::set<std::string> included;
+    std::vector<std::string> localFiles;
+    std::string source;
+    appendSource(path, included, localFiles, source);
+    if (files != nullptr)
+        *files = localFiles;
+    return source;
+}
+
+std::string Shader::preprocess(const std::string &path, const ShaderDefines &defines, std::vector<std::string> *files)
+{
+    std::string source = resolveIncludes(path, files);
+    if (defines.empty())
+        return source;
+
+    // GLSL_VERSION is not a macro: it replaces the #version line, for variants that need a newer GLSL
+    std::string versionOverride;
+    std::string defineBlock;
+    for (const auto &define : defines)
+    {
+        if (define.first == "GLSL_VERSION")
+            versionOverride = define.second;
+        else
+            defineBlock += "#define " + define.first + " " + define.second + "\n";
+    }
+
+    // #version has to stay the first statement, so the defines go right after it
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+        return defineBlock + "#line 1 0\n" + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos)
+    {
+        source += '\n';
+        lineEnd = source.size() - 1;
+    }
+    int versionLine = 1 + (int)std::count(source.begin(), source.begin() + version, '\n');
+    source.insert(lineEnd + 1, defineBlock + "#line " + std::to_string(versionLine + 1) + " 0\n");
+    if (!versionOverride.empty())
+        source.replace(version, lineEnd - version, "#version " + versionOverride);
+    return source;
 }
 
 void Shader::use() const
 {
-    glUseProgram(ID);
+    GLState::useProgram(ID);
 }
 // utility uniform functions
 // ------------------------------------------------------------------------
-void Shader::setBool(const std::string &name, bool value) const
+void Shader::setBool(const char *name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(glGetUniformLocation(ID, name), (int)value);
 }
 // ------------------------------------------------------------------------
-void Shader::setInt(const std::string &name, int value) const
+void Shader::setInt(const char *name, int value) const
+{
+    glUniform1i(glGetUniformLocation(ID, name), value);
+}
+void Shader::setUint(const char *name, unsigned int value) const
+{
+    glUniform1ui(glGetUniformLocation(ID, name), value);
+}
+void Shader::setIntArray(const char *name, const int *values, int count) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1iv(glGetUniformLocation(ID, name), count, values);
 }
 // ------------------------------------------------------------------------
-void Shader::setFloat(const std::string &name, float value) const
+void Shader::setFloat(const char *name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(glGetUniformLocation(ID, name), value);
 }
 // ------------------------------------------------------------------------
-void Shader::setVec2(const std::string &name, const glm::vec2 &value) const
+void Shader::setVec2(const char *name, const glm::vec2 &value) const
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform2fv(glGetUniformLocation(ID, name), 1, &value[0]);
 }
-void Shader::setVec2(const std::string &name, float x, float y) const
+void Shader::setVec2(const char *name, float x, float y) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    glUniform2f(glGetUniformLocation(ID, name), x, y);
 }
 // ------------------------------------------------------------------------
-void Shader::setVec3(const std::string &name, const glm::vec3 &value) const
+void Shader::setVec3(const char *name, const glm::vec3 &value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(glGetUniformLocation(ID, name), 1, &value[0]);
 }
-void Shader::setVec3(const std::string &name, float x, float y, float z) const
+void Shader::setVec3(const char *name, float x, float y, float z) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(glGetUniformLocation(ID, name), x, y, z);
 }
 // ------------------------------------------------------------------------
-void Shader::setVec4(const std::string &name, const glm::vec4 &value) const
+void Shader::setVec4(const char *name, const glm::vec4 &value) const
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(glGetUniformLocation(ID, name), 1, &value[0]);
 }
-void Shader::setVec4(const std::string &name, float x, float y, float z, float w) const
+void Shader::setVec4(const char *name, float x, float y, float z, float w) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    glUniform4f(glGetUniformLocation(ID, name), x, y, z, w);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const
+void Shader::setMat2(const char *name, const glm::mat2 &mat) const
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const
+void Shader::setMat3(const char *name, const glm::mat3 &mat) const
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const
+void Shader::setMat4(const char *name, const glm::mat4 &mat) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 }
 
-void Shader::checkCompileErrors(GLuint shader, std::string type)
+bool Shader::checkCompileErrors(GLuint shader, std::string type)
 {
     GLint success;
     GLchar infoLog[1024];
@@ -161,6 +360,9 @@ void Shader::checkCompileErrors(GLuint shader, std::string type)
             glGetShaderInfoLog(shader, 1024, NULL, infoLog);
             std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n"
                       << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            const std::vector<std::string> &files = sourceFiles[type];
+            for (size_t i = 0; i < files.size(); i++)
+                std::cout << "  source string " << i << ": " << files[i] << std::endl;
         }
     }
     else
@@ -173,4 +375,5 @@ void Shader::checkCompileErrors(GLuint shader, std::string type)
                       << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
+    return success == GL_TRUE;
 }
\ No newline at end of file
@@ -8,42 +8,90 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
+#include <set>
+#include <vector>
+
+// #define name -> value pairs injected after the #version line. An ordered map keeps
+// the iteration order stable so the same set always produces the same source.
+typedef std::map<std::string, std::string> ShaderDefines;
 
 // A simple OpenGL shader class for loading, compiling, linking, and using GLSL programs.
 class Shader {
 public:
+    enum Status { Compiling, Ready, Failed };
+
     unsigned int ID; // OpenGL program ID
+    Status status = Compiling;
+    unsigned long long serial; // unique per built program, unlike ID which GL may hand out again
+    unsigned long long uniformOwner = 0; // serial of the Material whose values the program holds
 
-    // Constructor that builds the shader program from vertex and fragment shader file paths
+    // Constructor that builds the shader program from vertex and fragment shader file paths.
+    // Blocks until the program is linked.
     Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr);
+    // Same as above, but every stage is run through preprocess() with the given defines.
+    // Does not wait for the driver: use poll() (or let ShaderCompiler do it) before drawing with it.
+    Shader(const char *vertexPath, const char *fragmentPath, const ShaderDefines &defines, const char *geometryPath = nullptr);
+    // Compute program (GL 4.3, see GLExtensions::computeShader), preprocessed like the above.
+    // Blocks until the program is linked.
+    Shader(const char *computePath, const ShaderDefines &defines);
+    ~Shader();
+
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
+
+    // Reads a shader file, resolves #include "file" (relative to the including file, each file
+    // included once) and injects the defines right after the #version line. A GLSL_VERSION
+    // entry replaces the #version line instead of becoming a macro.
+    // Every file gets a #line directive, so source string N in a compile error is files[N].
+    static std::string preprocess(const std::string &path, const ShaderDefines &defines, std::vector<std::string> *files = nullptr);
+    // Resolves #include only; used to find out which defines a source actually references
+    static std::string resolveIncludes(const std::string &path, std::vector<std::string> *files = nullptr);
+
+    // Non-blocking status check, true once the program is Ready or Failed
+    bool poll();
+    // Waits for compilation and reports errors
+    void finish();
+    bool ready() const { return status == Ready; }
 
     // Activate the shader
     void use() const;
 
-    // Utility uniform setters
-    void setBool(const std::string& name, bool value) const;
-    void setInt(const std::string& name, int value) const;
-    void setFloat(const std::string& name, float value) const;
+    // Utility uniform setters, names are C strings so literals do not allocate on every call
+    void setBool(const char* name, bool value) const;
+    void setInt(const char* name, int value) const;
+    void setUint(const char* name, unsigned int value) const;
+    void setIntArray(const char* name, const int *values, int count) const;
+    void setFloat(const char* name, float value) const;
 
-    void setVec2(const std::string& name, const glm::vec2& value) const;
-    void setVec2(const std::string& name, float x, float y) const;
+    void setVec2(const char* name, const glm::vec2& value) const;
+    void setVec2(const char* name, float x, float y) const;
 
-    void setVec3(const std::string& name, const glm::vec3& value) const;
-    void setVec3(const std::string& name, float x, float y, float z) const;
+    void setVec3(const char* name, const glm::vec3& value) const;
+    void setVec3(const char* name, float x, float y, float z) const;
 
-    void setVec4(const std::string& name, const glm::vec4& value) const;
-    void setVec4(const std::string& name, float x, float y, float z, float w) const;
+    void setVec4(const char* name, const glm::vec4& value) const;
+    void setVec4(const char* name, float x, float y, float z, float w) const;
 
-    void setMat2(const std::string& name, const glm::mat2& mat) const;
-    void setMat3(const std::string& name, const glm::mat3& mat) const;
-    void setMat4(const std::string& name, const glm::mat4& mat) const;
+    void setMat2(const char* name, const glm::mat2& mat) const;
+    void setMat3(const char* name, const glm::mat3& mat) const;
+    void setMat4(const char* name, const glm::mat4& mat) const;
 
     std::string vertex;
     std::string fragment;
+    std::string compute;
+    ShaderDefines defines;
+    std::map<std::string, std::vector<std::string>> sourceFiles; // per stage, files by source string number
 
 private:
+    static unsigned long long nextSerial;
+    unsigned int vertexID = 0, fragmentID = 0, geometryID = 0, computeID = 0; // kept until finish() reads their logs
+
+    void build(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode);
+    static bool appendSource(const std::string &path, std::set<std::string> &included, std::vector<std::string> &files, std::string &out);
+
     // Internal utility for error checking
-    void checkCompileErrors(GLuint shader, std::string type);
+    bool checkCompileErrors(GLuint shader, std::string type);
 };
 
 #endif // SHADER_HPP
@@ -0,0 +1,70 @@
+#include "shaderCompiler.hpp"
+#include <helpers/glExtensions.hpp>
+
+std::vector<ShaderCompiler::PendingShader> ShaderCompiler::pending;
+ShaderPermutations *ShaderCompiler::placeholders = nullptr;
+unsigned long long ShaderCompiler::frame = 0;
+unsigned int ShaderCompiler::deferFrames = 2;
+
+void ShaderCompiler::init(const char *placeholderVertex, const char *placeholderFragment)
+{
+    if (GLExtensions::parallelShaderCompile)
+        glextMaxShaderCompilerThreads(0xFFFFFFFF); // let the driver pick the thread count
+
+    placeholders = new ShaderPermutations(placeholderVertex, placeholderFragment, false);
+}
+
+void ShaderCompiler::update()
+{
+    frame++;
+
+    unsigned int blockingBudget = 1;
+    for (size_t i = 0; i < pending.size();)
+    {
+        PendingShader &entry = pending[i];
+        bool done = false;
+        if (GLExtensions::parallelShaderCompile)
+        {
+            done = entry.shader->poll();
+        }
+        else if (frame - entry.submitFrame >= deferFrames && blockingBudget > 0)
+        {
+            entry.shader->finish();
+            blockingBudget--;
+            done = true;
+        }
+
+        if (done)
+        {
+            pending[i] = pending.back();
+            pending.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void ShaderCompiler::enqueue(Shader *shader)
+{
+    pending.push_back(PendingShader{shader, frame});
+}
+
+void ShaderCompiler::remove(Shader *shader)
+{
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        if (pending[i].shader == shader)
+        {
+            pending[i] = pending.back();
+            pending.pop_back();
+            return;
+        }
+    }
+}
+
+Shader *ShaderCompiler::placeholder(const ShaderDefines &defines)
+{
+    return placeholders->get(defines);
+}
@@ -0,0 +1,39 @@
+#ifndef SHADER_COMPILER_HPP
+#define SHADER_COMPILER_HPP
+
+#include <shaders/shaderPermutations.hpp>
+#include <vector>
+
+// Tracks programs whose compile/link was submitted but not yet confirmed, so nothing has to wait
+// on the driver inside a frame. With KHR_parallel_shader_compile the completion status is polled;
+// without it the status query is deferred a few frames (drivers usually compile in the background
+// meanwhile) and at most one program is finalized per frame.
+// Until a program is ready, draws use the missingShader placeholder.
+class ShaderCompiler {
+public:
+    // Compiles the placeholder permutations synchronously; call once after the GL context exists
+    static void init(const char *placeholderVertex, const char *placeholderFragment);
+    // Polls the queue, call once per frame
+    static void update();
+
+    static void enqueue(Shader *shader);
+    static void remove(Shader *shader);
+    // missingShader variant with the same instancing setup as the requested one
+    static Shader *placeholder(const ShaderDefines &defines);
+
+    static size_t pendingCount() { return pending.size(); }
+
+    static unsigned int deferFrames; // frames to wait before a blocking status query
+
+private:
+    struct PendingShader {
+        Shader *shader;
+        unsigned long long submitFrame;
+    };
+
+    static std::vector<PendingShader> pending;
+    static ShaderPermutations *placeholders;
+    static unsigned long long frame;
+};
+
+#endif // SHADER_COMPILER_HPP
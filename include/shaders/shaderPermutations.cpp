@@ -0,0 +1,155 @@
+#include "shaderPermutations.hpp"
+#include "shaderCompiler.hpp"
+#include <cctype>
+
+ShaderPermutations::ShaderPermutations(const char *vertexPath, const char *fragmentPath, bool async)
+{
+    vertex = vertexPath;
+    fragment = fragmentPath;
+    this->async = async;
+    referencedNames = identifiersOf(Shader::resolveIncludes(vertex) + Shader::resolveIncludes(fragment));
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+    for (auto &variant : variants)
+        delete variant.second;
+    for (auto &variant : retired)
+        delete variant.second;
+}
+
+Shader *ShaderPermutations::get(const ShaderDefines &defines)
+{
+    const std::string &key = keyOf(defines);
+    Shader *variant;
+    auto found = variants.find(key);
+    if (found != variants.end())
+    {
+        variant = found->second;
+    }
+    else
+    {
+        variant = new Shader(vertex.c_str(), fragment.c_str(), filterDefines(defines));
+        variants[key] = variant;
+        if (async)
+            ShaderCompiler::enqueue(variant);
+        else
+            variant->finish();
+    }
+
+    if (!async || variant->ready())
+    {
+        auto old = retired.find(key);
+        if (old != retired.end())
+        {
+            delete old->second;
+            retired.erase(old);
+        }
+        return variant;
+    }
+
+    if (variant->status == Shader::Compiling)
+    {
+        auto old = retired.find(key);
+        if (old != retired.end() && old->second->ready())
+            return old->second;
+    }
+    return ShaderCompiler::placeholder(defines);
+}
+
+void ShaderPermutations::reload()
+{
+    for (auto &variant : variants)
+    {
+        auto old = retired.find(variant.first);
+        if (old != retired.end())
+        {
+            // reloaded again before the last rebuild finished: keep the older, working program
+            if (old->second->ready() && !variant.second->ready())
+            {
+                delete variant.second;
+                continue;
+            }
+            delete old->second;
+        }
+        retired[variant.first] = variant.second;
+    }
+    variants.clear();
+    requests.clear(); // the sources may mention other defines now, which changes the keys
+    referencedNames = identifiersOf(Shader::resolveIncludes(vertex) + Shader::resolveIncludes(fragment));
+}
+
+const std::string &ShaderPermutations::keyOf(const ShaderDefines &defines)
+{
+    for (const Request &request : requests)
+    {
+        if (request.defines == defines)
+            return request.key;
+    }
+    requests.push_back(Request{defines, permutationKey(filterDefines(defines))});
+    return requests.back().key;
+}
+
+ShaderDefines ShaderPermutations::filterDefines(const ShaderDefines &defines) const
+{
+    ShaderDefines used;
+    for (const auto &define : defines)
+    {
+        // GLSL_VERSION replaces the #version line, it matters whether the sources name it or not
+        if (uses(define.first) || define.first == "GLSL_VERSION")
+            used.insert(define);
+    }
+    return used;
+}
+
+std::string ShaderPermutations::permutationKey(const ShaderDefines &defines)
+{
+    std::string key;
+    for (const auto &define : defines)
+    {
+        key += define.first;
+        key += '=';
+        key += define.second;
+        key += ';';
+    }
+    return key;
+}
+
+std::unordered_set<std::string> ShaderPermutations::identifiersOf(const std::string &source)
+{
+    std::unordered_set<std::string> names;
+    auto isStart = [](char c) { return std::isalpha((unsigned char)c) || c == '_'; };
+    auto isPart = [](char c) { return std::isalnum((unsigned char)c) || c == '_'; };
+    size_t i = 0;
+    while (i < source.size())
+    {
+        if (source.compare(i, 2, "//") == 0)
+        {
+            i = source.find('\n', i);
+        }
+        else if (source.compare(i, 2, "/*") == 0)
+        {
+            i = source.find("*/", i + 2);
+            i = i == std::string::npos ? i : i + 2;
+        }
+        else if (isStart(source[i]))
+        {
+            size_t end = i + 1;
+            while (end < source.size() && isPart(source[end]))
+                end++;
+            names.insert(source.substr(i, end - i));
+            i = end;
+        }
+        else if (std::isdigit((unsigned char)source[i]))
+        {
+            // numbers like 1e5 or 0x1F are not identifiers
+            while (i < source.size() && isPart(source[i]))
+                i++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return names;
+}
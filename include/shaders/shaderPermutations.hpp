@@ -0,0 +1,51 @@
+#ifndef SHADER_PERMUTATIONS_HPP
+#define SHADER_PERMUTATIONS_HPP
+
+#include <shaders/shader.hpp>
+#include <unordered_map>
+#include <unordered_set>
+
+// Lazily compiled variants of one vertex/fragment pair. Each distinct define set is compiled the
+// first time it is asked for and cached afterwards. Defines the sources never mention are dropped
+// before the lookup, so e.g. a shader without lights does not get one variant per light count.
+class ShaderPermutations {
+public:
+    // async: hand new variants to ShaderCompiler instead of waiting for them
+    ShaderPermutations(const char *vertexPath, const char *fragmentPath, bool async = true);
+    ~ShaderPermutations();
+
+    // Returns a program that can be drawn with right now: the variant for the given defines once it
+    // is linked, until then the previous build of it (after a reload) or the placeholder
+    Shader *get(const ShaderDefines &defines);
+    // Recompiles every variant from disk; the old programs stay in use until their replacements are ready
+    void reload();
+
+    size_t variantCount() const { return variants.size(); }
+    // True when the sources use name as an identifier outside comments, i.e. a define of that name would
+    // change the program
+    bool uses(const std::string &name) const { return referencedNames.count(name) != 0; }
+
+    std::string vertex;
+    std::string fragment;
+
+private:
+    bool async;
+    std::unordered_map<std::string, Shader *> variants;
+    std::unordered_map<std::string, Shader *> retired; // pre-reload builds, dropped once replaced
+    // identifiers of the include-resolved vertex + fragment source, comments left out; filters defines
+    std::unordered_set<std::string> referencedNames;
+    // define sets asked for so far and their variant keys; the same few sets come back every
+    // frame, so after the first request get() neither filters nor builds a key string
+    struct Request {
+        ShaderDefines defines;
+        std::string key;
+    };
+    std::vector<Request> requests;
+
+    const std::string &keyOf(const ShaderDefines &defines);
+    ShaderDefines filterDefines(const ShaderDefines &defines) const;
+    static std::string permutationKey(const ShaderDefines &defines);
+    static std::unordered_set<std::string> identifiersOf(const std::string &source);
+};
+
+#endif // SHADER_PERMUTATIONS_HPP
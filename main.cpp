@@ -3,15 +3,38 @@
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <stack>
+#include <random>
+#include <chrono>
 #include <shaders/shader.hpp>
+#include <shaders/shaderCompiler.hpp>
+#include <helpers/glExtensions.hpp>
+#include <helpers/glState.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <camera/camera.hpp>
 #include <model/model.hpp>
+#include <lighting/lightClusters.hpp>
+#include <lighting/lightCulling.hpp>
+#include <lighting/deferredRenderer.hpp>
+#include <lighting/shadowCascades.hpp>
+#include <culling/occlusionCuller.hpp>
+#include <culling/gpuCuller.hpp>
+#include <culling/sceneBVH.hpp>
+#include <helpers/gpuTimer.hpp>
+#include <helpers/dynamicResolution.hpp>
+#include <helpers/frameAllocator.hpp>
+#include <helpers/allocationCounter.hpp>
+#include <helpers/jobSystem.hpp>
 #include <imgui/imgui.h>
 #include <helpers/sceneTree.hpp>
+#include <scene/systems.hpp>
+#include <scene/sceneFile.hpp>
+#include <scene/sceneJournal.hpp>
+#include <scene/sceneSaver.hpp>
+#include <scene/worldStreamer.hpp>
 #include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/backends/imgui_impl_opengl3.h>
 
@@ -29,13 +52,20 @@ void ShowFileBrowser();
 void drawAllUI();
 void drawMainUI();
 void drawSceneTree();
+void pickInstance(GLFWwindow *window, const glm::mat4 &projection);
 void saveScene();
-void loadScene();
+bool loadScene();
+void describeTextSceneModel(SceneModelRecord &record);
+void partitionScene();
 void saveData();
 void loadData();
 void resetData();
+void setLightingUniforms(Material *material);
+void gatherPointLights(Model *lights, vector<PointLight> &pointLights);
 
 float cameraFOV = 45.0f;
+float cameraNear = 0.1f;
+float cameraFar = 100.0f;
 unsigned int SCR_WIDTH = 1280;
 unsigned int SCR_HEIGHT = 720;
 
@@ -56,6 +86,7 @@ float PanSensitivity = 1.0f;
 float ForwardSensitivity = 1.0f;
 
 float skyColor[3]{0.4f, 0.4f, 0.9f};
+float dirLightDirection[3] = {-0.2f, -1.0f, -0.3f};
 float dirLightDiffuseColor[3] = {0.5f, 0.5f, 0.5f};
 float dirLightAmbientColor[3] = {0.2f, 0.2f, 0.2f};
 float dirLightSpecularColor[3] = {1.0f, 1.0f, 1.0f};
@@ -64,22 +95,46 @@ float lightDiffuseColor[3] = {0.8f, 0.8f, 0.8f};
 float lightSpecularColor[3] = {1.0f, 1.0f, 1.0f};
 float lightLinear = 0.09f;
 float lightQuatratic = 0.032f;
-
-string pointLightAttribs[7] = {
-    ".position",
-    ".ambient",
-    ".diffuse",
-    ".specular",
-    ".constant",
-    ".linear",
-    ".quadratic"};
+bool spotLightEnabled = false;
+bool clusteredLighting = true;
+int extraLightCount = 0; // point lights without a cube, scattered around the scene
+vector<PointLight> extraLights;
+vector<PointLight> pointLights; // refilled every frame, keeps its capacity
+LightClusters *lightClusters;
+LightCulling *lightCulling; // per-object light lists when clustering is off
+
+enum RenderMode { ForwardRendering, DeferredRendering };
+int renderMode = ForwardRendering;
+DeferredRenderer *deferredRenderer;
+bool depthPrePass = false;
+ShaderPermutations *depthShaders; // position-only program for the pre-pass and shadow maps
+bool shadowsEnabled = true;
+ShadowCascades *shadowCascades;
+SceneBVH *sceneBVH; // every instance's world bounds, for culling and light assignment
+bool frustumCulling = true;
+bool occlusionCulling = true;
+OcclusionCuller *occlusionCuller;
+bool gpuCulling = false;
+GPUCuller *gpuCuller = nullptr; // only with GLExtensions::computeShader
+DynamicResolution *dynamicResolution;
+JobSystem *jobSystem; // workers for the per frame passes: transforms, light binning, culling
+size_t frameAllocations = 0; // operator new calls of the last frame on the main thread, UI excluded (debug builds)
+bool reportFrameAllocations = false; // prints the next frame that allocates, then turns itself off
 
 static fs::path currentPath = fs::current_path();
 static std::string selectedFile = "";
 
-vector<Model *> sceneModels;
+vector<Model *> sceneModels; // the saved scene
+vector<Model *> drawModels; // sceneModels, then the ones worldStreamer has loaded
+WorldStreamer *worldStreamer;
+float worldCellSize = 20.0f;
+SceneIndex sceneIndex;
 SceneTreeNode *rootNode;
 SceneTreeNode *sceneRootNode;
+SceneTreeNode *selectedNode = nullptr; // edited in the Scene Tree window, set by clicking the scene
+SceneSaver *sceneSaver; // writes saves on its own thread
+SceneJournal *sceneJournal; // edits made since the scene file was written
+float pickMs = 0.0f;
 int main()
 {
     loadData();
@@ -92,53 +147,91 @@ int main()
     }
 
     setUpImGui(window);
+    jobSystem = new JobSystem();
+    lightClusters = new LightClusters(*jobSystem);
+    lightCulling = new LightCulling();
+    depthShaders = new ShaderPermutations("resources/shaders/depthOnly_vertex.glsl", "resources/shaders/depthOnly_fragment.glsl");
+    shadowCascades = new ShadowCascades();
+    occlusionCuller = new OcclusionCuller(*jobSystem);
+    sceneBVH = new SceneBVH();
+    dynamicResolution = new DynamicResolution();
+    if (GLExtensions::computeShader)
+        gpuCuller = new GPUCuller();
+    deferredRenderer = new DeferredRenderer("resources/shaders/deferredLighting_vertex.glsl", "resources/shaders/deferredLighting_fragment.glsl");
+
+    // the saved scene when there is one: the lit model first, the light cubes second
+    Model* cubeModel;
+    bool sceneLoaded = loadScene();
+    if (sceneLoaded)
+    {
+        cubeModel = sceneModels[1];
+    }
+    else
+    {
+        glm::vec3 pointLightPositions[] = {
+            glm::vec3(0.7f, 0.2f, 2.0f),
+            glm::vec3(2.3f, -3.3f, -4.0f),
+            glm::vec3(-4.0f, 2.0f, -12.0f),
+            glm::vec3(0.0f, 0.0f, -3.0f)};
 
-    glm::vec3 pointLightPositions[] = {
-        glm::vec3(0.7f, 0.2f, 2.0f),
-        glm::vec3(2.3f, -3.3f, -4.0f),
-        glm::vec3(-4.0f, 2.0f, -12.0f),
-        glm::vec3(0.0f, 0.0f, -3.0f)};
-
-    string path = "resources/models/champion.fbx";
+        string path = "resources/models/champion.fbx";
 
-    rootNode = new SceneTreeNode{nullptr, 0, nullptr, nullptr};
-    
-    string fragment = "resources/shaders/objectLighting_fragment.glsl";
-    string vertex = "resources/shaders/objectLighting_vertex.glsl";
-    Model* test = new Model(path.c_str(), vertex.c_str(), fragment.c_str(), "champion");
-    test->transforms[0] = Transform{glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-90.0f, 0.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f)};
+        string fragment = "resources/shaders/objectLighting_fragment.glsl";
+        string vertex = "resources/shaders/objectLighting_vertex.glsl";
+        Model* test = new Model(path.c_str(), vertex.c_str(), fragment.c_str(), "champion");
+        test->transform(0) = Transform{glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-90.0f, 0.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f)};
 
-    sceneRootNode = insertInstanceToSceneTree(rootNode, test, 0);
+        sceneRootNode = insertInstanceToSceneTree(sceneIndex, nullptr, test, 0);
+        rootNode = sceneRootNode;
 
-    cout << "Inserted model with Hash ID: " << sceneRootNode->NodeModel->Hash_ID[sceneRootNode->instanceCount] << endl;
+        cout << "Inserted model with Hash ID: " << sceneRootNode->NodeModel->id(sceneRootNode->instance()) << endl;
 
-    path = "resources/models/testCube.fbx";
-    fragment = "resources/shaders/litObject_fragment.glsl";
-    vertex = "resources/shaders/litObject_vertex.glsl";
-    Model* cubeModel = new Model(path.c_str(), vertex.c_str(), fragment.c_str(), "cube");
-    cubeModel->transforms[0] = Transform{pointLightPositions[0], glm::vec3(-90.0f, 0.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f)};
+        path = "resources/models/testCube.fbx";
+        fragment = "resources/shaders/litObject_fragment.glsl";
+        vertex = "resources/shaders/litObject_vertex.glsl";
+        cubeModel = new Model(path.c_str(), vertex.c_str(), fragment.c_str(), "cube");
+        cubeModel->castsShadows = false; // the cubes mark the point lights, they would shadow their own light
+        cubeModel->isOccluder = false;
+        cubeModel->transform(0) = Transform{pointLightPositions[0], glm::vec3(-90.0f, 0.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f)};
 
-    SceneTreeNode *sceneLightNode = insertInstanceToSceneTree(rootNode, cubeModel, 0);
-    cout << "Inserted model with Hash ID: " << cubeModel->Hash_ID[0] << endl;
-    sceneRootNode->childrenInstances.push_back(sceneLightNode);
-    sceneLightNode->parentNode = sceneRootNode;
+        SceneTreeNode *sceneLightNode = insertInstanceToSceneTree(sceneIndex, sceneRootNode, cubeModel, 0);
+        cout << "Inserted model with Hash ID: " << cubeModel->id(0) << endl;
 
-    SceneTreeNode* sceneNode;
+        for (unsigned int i = 1; i < 4; i++)
+        {
+            cubeModel->addInstance(pointLightPositions[i], glm::vec3(-90.0f, 0.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f), "lightCube " + std::to_string(i));
+            insertInstanceToSceneTree(sceneIndex, sceneLightNode, cubeModel, i);
+            cout << "Inserted model with Hash ID: " << cubeModel->id(i) << endl;
+        }
 
-    for (unsigned int i = 1; i < 4; i++)
-    {
-        int index = cubeModel->addInstance(pointLightPositions[i], glm::vec3(-90.0f, 0.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f), "lightCube " + std::to_string(i));
-        sceneNode = insertInstanceToSceneTree(rootNode, cubeModel, i);
-        cout << "Inserted model with Hash ID: " << sceneNode->NodeModel->Hash_ID[i] << endl;
-        sceneLightNode->childrenInstances.push_back(sceneNode);
-        sceneNode->parentNode = sceneLightNode;
+        sceneModels.push_back(test);
+        sceneModels.push_back(cubeModel);
     }
-
-    sceneModels.push_back(test);
-    sceneModels.push_back(cubeModel);
+    // the edits the scene file missed; a fresh snapshot with them is written in the background
+    sceneSaver = new SceneSaver();
+    sceneJournal = new SceneJournal("localData/scene.snj", "localData/scene.sn", *sceneSaver);
+    if (sceneJournal->replay(sceneModels, sceneIndex, sceneRootNode) > 0)
+        cout << "Replayed " << sceneJournal->stats.replayed << " scene edits from localData/scene.snj" << endl;
+    if (sceneJournal->stats.replayed > 0 || !sceneLoaded)
+        sceneJournal->compact(sceneModels, sceneIndex);
+    sceneModels[0]->material->setFloat("material.shininess", 0.0f);
+    // cells of a partitioned world come and go around the camera, under the scene root
+    worldStreamer = new WorldStreamer(sceneIndex, sceneRootNode);
+    if (worldStreamer->open("localData/world/world.wld"))
+        cout << "Streaming " << worldStreamer->stats.cells << " world cells" << endl;
+
+    // light state decides which shader permutations get used; the sets are only rebuilt when it changes
+    ShaderDefines lightDefines;
+    int lightDefinesState = -1;
+    ShaderDefines gbufferDefines{{"GBUFFER_PASS", ""}};
 
     while (!glfwWindowShouldClose(window))
     {
+        FrameAllocator::frame.reset();
+        jobSystem->endFrame();
+        size_t allocationsBefore = AllocationCounter::allocations();
+        AllocationCounter::begin();
+
         // Skip frame if minimized
         if (SCR_WIDTH == 0 || SCR_HEIGHT == 0)
         {
@@ -151,15 +244,28 @@ int main()
         lastFrame = currentFrame;
 
         processInput(window);
-
-        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && glfwGetInputMode(window, GLFW_CURSOR) == GLFW_CURSOR_DISABLED)
+        if (worldStreamer->isOpen())
         {
-
-            if (!mousePressLeft)
-            {
-                glm::vec3 newPos = camera.Position;
-                newPos += camera.Front;
-            }
+            // a selected instance can stream out with its cell
+            size_t selectedId = selectedNode != nullptr ? selectedNode->NodeModel->id(selectedNode->instance()) : 0;
+            worldStreamer->update(camera.Position);
+            if (selectedNode != nullptr && getInstanceInSceneTree(sceneIndex, selectedId) != selectedNode)
+                selectedNode = nullptr;
+        }
+        drawModels.assign(sceneModels.begin(), sceneModels.end());
+        drawModels.insert(drawModels.end(), worldStreamer->models().begin(), worldStreamer->models().end());
+        // passes over the entity chunks, spread over the job workers, bring every instance's world matrix and bounds up to date
+        updateWorldMatrices(Model::entities, *jobSystem);
+        updateWorldBounds(Model::entities, *jobSystem);
+        GLState::beginFrame();
+        GPUTimers::beginFrame();
+        ShaderCompiler::update();
+
+        // a click on the scene (not on a window) selects the instance under the cursor, once the BVH is current
+        bool pick = false;
+        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse)
+        {
+            pick = !mousePressLeft;
             mousePressLeft = true;
         }
         else
@@ -168,63 +274,177 @@ int main()
         }
 
         glClearColor(skyColor[0], skyColor[1], skyColor[2], 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        Model *model = sceneModels[0];
-        //setting lighting uniforms
+        glm::mat4 projection = glm::perspective(glm::radians(cameraFOV), (float)SCR_WIDTH / (float)SCR_HEIGHT, cameraNear, cameraFar);
+        glm::mat4 view = camera.GetViewMatrix();
+
+        int lightState = (clusteredLighting ? 1 : 0) | (spotLightEnabled ? 2 : 0) | (shadowsEnabled ? 4 : 0);
+        if (lightState != lightDefinesState)
         {
-            model->shader->use();
-            model->shader->setVec3("ViewDir", camera.Position);
-            model->shader->setFloat("material.shininess", 0.0f);
-            model->shader->setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-            model->shader->setVec3("dirLight.ambient", dirLightAmbientColor[0], dirLightAmbientColor[1], dirLightAmbientColor[2]);
-            model->shader->setVec3("dirLight.diffuse", dirLightDiffuseColor[0], dirLightDiffuseColor[1], dirLightDiffuseColor[2]);
-            model->shader->setVec3("dirLight.specular", dirLightSpecularColor[0], dirLightSpecularColor[1], dirLightSpecularColor[2]);
-
-            model->shader->setVec3("spotLight.position", camera.Position);
-            model->shader->setVec3("spotLight.direction", camera.Front);
-            model->shader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            model->shader->setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-            model->shader->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-            model->shader->setFloat("spotLight.constant", 1.0f);
-            model->shader->setFloat("spotLight.linear", 0.09f);
-            model->shader->setFloat("spotLight.quadratic", 0.032f);
-            model->shader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            model->shader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-            for (int i = 0; i < 4; i++)
+            lightDefines.clear();
+            lightDefines[clusteredLighting ? "USE_CLUSTERED" : "USE_LIGHT_LISTS"] = "";
+            if (spotLightEnabled)
+                lightDefines["USE_SPOTLIGHT"] = "";
+            if (shadowsEnabled)
+                lightDefines["USE_SHADOWS"] = "";
+            lightDefinesState = lightState;
+        }
+
+        // in deferred mode the models that can write the G-buffer are lit by the lighting pass instead
+        bool deferred = renderMode == DeferredRendering;
+        FrameVector<Model *> gbufferModels, forwardModels;
+        for (Model *model : drawModels)
+        {
+            bool toGBuffer = deferred && model->material->shaders->uses("GBUFFER_PASS");
+            model->selectShaders(toGBuffer ? gbufferDefines : lightDefines);
+            (toGBuffer ? gbufferModels : forwardModels).push_back(model);
+        }
+        Material *litMaterial = deferred ? deferredRenderer->material : sceneModels[0]->material;
+        sceneBVH->update(drawModels);
+        if (pick)
+            pickInstance(window, projection);
+
+        //setting lighting uniforms, the materials only upload what changed
+        Material::beginFrame();
+        setLightingUniforms(litMaterial);
+        sceneModels[1]->material->setVec3("mainColor", glm::vec3(lightDiffuseColor[0], lightDiffuseColor[1], lightDiffuseColor[2]));
+        if (shadowsEnabled)
+        {
+            GPUTimers::begin("Shadow cascades");
+            shadowCascades->update(drawModels, depthShaders, view, glm::radians(cameraFOV), (float)SCR_WIDTH / (float)SCR_HEIGHT, cameraNear,
+                                   glm::vec3(dirLightDirection[0], dirLightDirection[1], dirLightDirection[2]), SCR_WIDTH, SCR_HEIGHT);
+            GPUTimers::end();
+            shadowCascades->bind(litMaterial);
+        }
+
+        // from here on the scene goes into the scaled target (cleared by beginFrame), the shadow maps have their own
+        float gpuMs = 0.0f;
+        for (const GPUTimers::Timer *timer : GPUTimers::active())
+            gpuMs += timer->gpuMs;
+        dynamicResolution->beginFrame(SCR_WIDTH, SCR_HEIGHT, deltaTime * 1000.0f, gpuMs);
+        unsigned int renderWidth = dynamicResolution->width;
+        unsigned int renderHeight = dynamicResolution->height;
+        gatherPointLights(cubeModel, pointLights);
+        if (!clusteredLighting)
+        {
+            lightCulling->update(pointLights, projection * view, sceneBVH);
+            lightCulling->bind(litMaterial);
+        }
+        for (Model *model : drawModels)
+        {
+            if (!clusteredLighting && model->material->shaders->uses("USE_LIGHT_LISTS"))
+                lightCulling->assign(model);
+            else
+                model->lightLists.clear();
+        }
+        if (clusteredLighting)
+        {
+            lightClusters->update(pointLights, view, glm::radians(cameraFOV), (float)SCR_WIDTH / (float)SCR_HEIGHT, cameraNear, cameraFar);
+            lightClusters->bind(litMaterial, renderWidth, renderHeight);
+        }
+
+        // the BVH drops whole subtrees outside the frustum, then occluders go into the CPU depth buffer and
+        // the remaining instance boxes are tested against its pyramid;
+        // shadows are done by now, they still need the instances the camera cannot see.
+        // The GPU path tests against the same pyramid (an empty one leaves it frustum culling only)
+        bool cullOnGPU = gpuCulling && gpuCuller != nullptr;
+        Model::gpuCuller = cullOnGPU ? gpuCuller : nullptr;
+        if (occlusionCulling || cullOnGPU)
+        {
+            occlusionCuller->begin(projection * view);
+            for (Model *model : drawModels)
             {
-                pointLightPositions[i].x = cubeModel->transforms[i].position.x;
-                pointLightPositions[i].y = cubeModel->transforms[i].position.y;
-                pointLightPositions[i].z = cubeModel->transforms[i].position.z;
-
-                model->shader->setVec3("pointLights[" + to_string(i) + "]" + pointLightAttribs[0], pointLightPositions[0]);
-                model->shader->setVec3("pointLights[" + to_string(i) + "]" + pointLightAttribs[1], lightAmbientColor[0], lightAmbientColor[1], lightAmbientColor[2]);
-                model->shader->setVec3("pointLights[" + to_string(i) + "]" + pointLightAttribs[2], lightDiffuseColor[0], lightDiffuseColor[1], lightDiffuseColor[2]);
-                model->shader->setVec3("pointLights[" + to_string(i) + "]" + pointLightAttribs[3], lightSpecularColor[0], lightSpecularColor[1], lightSpecularColor[2]);
-                model->shader->setFloat("pointLights[" + to_string(i) + "]" + pointLightAttribs[4], 1.0f);
-                model->shader->setFloat("pointLights[" + to_string(i) + "]" + pointLightAttribs[5], lightLinear);
-                model->shader->setFloat("pointLights[" + to_string(i) + "]" + pointLightAttribs[6], lightQuatratic);
+                if (!model->isOccluder || !occlusionCulling)
+                    continue;
+                model->updateModelMatrices();
+                for (const glm::mat4 &matrix : model->modelMatrix)
+                    occlusionCuller->addOccluder(model->occluder, matrix);
             }
+            occlusionCuller->rasterize();
         }
-
-        model = sceneModels[1];
-        for (unsigned int i = 0; i < 1; i++)
+        if (cullOnGPU)
+            gpuCuller->begin(*occlusionCuller);
+        for (Model *model : drawModels)
+            model->instanceVisible.clear();
+        if (frustumCulling || occlusionCulling)
+            sceneBVH->cullFrustum(projection * view);
+        if (occlusionCulling)
         {
-            model->shader->use();
-            model->shader->setVec3("mainColor", glm::vec3(lightDiffuseColor[0], lightDiffuseColor[1], lightDiffuseColor[2]));
+            // a job per model, instanceVisible packs bits so a model's instances stay in one job
+            FrameVector<OcclusionStats> counts(drawModels.size());
+            jobSystem->parallelFor((unsigned int)drawModels.size(), 1, [&](unsigned int begin, unsigned int end) {
+                for (unsigned int m = begin; m < end; m++)
+                {
+                    Model *model = drawModels[m];
+                    if (model->gpuCulled())
+                        continue;
+                    for (unsigned int i = 0; i < model->modelMatrix.size(); i++)
+                    {
+                        if (model->instanceVisible[i])
+                            model->instanceVisible[i] = occlusionCuller->visible(model->instanceBounds(i), counts[m]);
+                    }
+                }
+            });
+            for (const OcclusionStats &modelCounts : counts)
+            {
+                occlusionCuller->stats.tested += modelCounts.tested;
+                occlusionCuller->stats.frustumCulled += modelCounts.frustumCulled;
+                occlusionCuller->stats.occluded += modelCounts.occluded;
+            }
         }
 
-        glm::mat4 projection = glm::perspective(glm::radians(cameraFOV), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
+        if (deferred)
+        {
+            GPUTimers::begin("G-buffer");
+            deferredRenderer->beginGeometryPass(renderWidth, renderHeight);
+            for (Model *model : gbufferModels)
+                model->Draw(projection, view);
+            GPUTimers::end();
+
+            GPUTimers::begin("Deferred lighting");
+            deferredRenderer->lightingPass(lightDefines, projection, view, dynamicResolution->framebuffer());
+            GPUTimers::end();
+        }
 
-        for (int i = 0; i < sceneModels.size(); i++)
+        // lay down depth first, so the shading pass only runs for the visible fragment of each pixel
+        bool prePass = depthPrePass && !deferred;
+        if (prePass)
         {
-            Model *model = sceneModels[i];
+            GPUTimers::begin("Depth pre-pass");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (Model *model : forwardModels)
+                model->DrawDepth(depthShaders, projection, view);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            GPUTimers::end();
+            GLState::depthFunc(GL_EQUAL);
+            GLState::depthMask(false);
+        }
+
+        GPUTimers::begin("Forward");
+        for (Model *model : forwardModels)
             model->Draw(projection, view);
+        GPUTimers::end();
+
+        if (prePass)
+        {
+            GLState::depthFunc(GL_LESS);
+            GLState::depthMask(true);
+        }
+        dynamicResolution->present();
+
+        if (GLState::debugValidate)
+            GLState::validate();
+
+        AllocationCounter::end();
+        frameAllocations = AllocationCounter::allocations() - allocationsBefore;
+        if (reportFrameAllocations && frameAllocations > 0)
+        {
+            cout << "ERROR::FRAME::HEAP_ALLOCATIONS: " << frameAllocations << " in one frame" << endl;
+            reportFrameAllocations = false;
         }
 
         drawAllUI();
+        sceneJournal->update(sceneModels, sceneIndex);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -232,13 +452,31 @@ int main()
 
     cout << "closing application" << endl;
 
+    // before the models go away, the scene is captured from them; the saver writes it meanwhile
+    sceneJournal->wait();
+    saveScene();
+
+    delete worldStreamer;
     for (unsigned int i = 0; i < sceneModels.size(); i++)
     {
         delete sceneModels[i];
     }
+    delete lightClusters;
+    delete lightCulling;
+    delete deferredRenderer;
+    delete shadowCascades;
+    delete occlusionCuller;
+    delete jobSystem;
+    delete sceneBVH;
+    delete gpuCuller;
+    delete dynamicResolution;
+    delete depthShaders;
 
     saveData();
-    saveScene();
+    // once the scene is written the journal has nothing left to add
+    sceneJournal->wait();
+    delete sceneJournal;
+    delete sceneSaver;
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -248,6 +486,64 @@ int main()
     return 0;
 }
 
+void setLightingUniforms(Material *material)
+{
+    material->setVec3("viewPos", camera.Position);
+    material->setVec3("dirLight.direction", dirLightDirection[0], dirLightDirection[1], dirLightDirection[2]);
+    material->setVec3("dirLight.ambient", dirLightAmbientColor[0], dirLightAmbientColor[1], dirLightAmbientColor[2]);
+    material->setVec3("dirLight.diffuse", dirLightDiffuseColor[0], dirLightDiffuseColor[1], dirLightDiffuseColor[2]);
+    material->setVec3("dirLight.specular", dirLightSpecularColor[0], dirLightSpecularColor[1], dirLightSpecularColor[2]);
+
+    if (spotLightEnabled)
+    {
+        material->setVec3("spotLight.position", camera.Position);
+        material->setVec3("spotLight.direction", camera.Front);
+        material->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+        material->setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
+        material->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
+        material->setFloat("spotLight.constant", 1.0f);
+        material->setFloat("spotLight.linear", 0.09f);
+        material->setFloat("spotLight.quadratic", 0.032f);
+        material->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+        material->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+    }
+}
+
+void gatherPointLights(Model *lights, vector<PointLight> &pointLights)
+{
+    pointLights.clear();
+    PointLight light;
+    light.ambient = glm::vec3(lightAmbientColor[0], lightAmbientColor[1], lightAmbientColor[2]);
+    light.diffuse = glm::vec3(lightDiffuseColor[0], lightDiffuseColor[1], lightDiffuseColor[2]);
+    light.specular = glm::vec3(lightSpecularColor[0], lightSpecularColor[1], lightSpecularColor[2]);
+    light.linear = lightLinear;
+    light.quadratic = lightQuatratic;
+    for (unsigned int i = 0; i < lights->instanceCount; i++)
+    {
+        light.position = lights->transform(i).position;
+        pointLights.push_back(light);
+    }
+
+    // the extra lights keep their positions and colors, so only regenerate when the count changes
+    if (extraLights.size() != (size_t)extraLightCount)
+    {
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        extraLights.resize(extraLightCount);
+        for (PointLight &extra : extraLights)
+        {
+            extra.position = glm::vec3(spread(random) * 30.0f, spread(random) * 5.0f, spread(random) * 30.0f);
+            extra.diffuse = glm::vec3(unit(random), unit(random), unit(random));
+            extra.ambient = extra.diffuse * 0.05f;
+            extra.specular = extra.diffuse;
+            extra.linear = 0.7f;
+            extra.quadratic = 1.8f;
+        }
+    }
+    pointLights.insert(pointLights.end(), extraLights.begin(), extraLights.end());
+}
+
 GLFWwindow* setupOpenGL(){
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -274,8 +570,11 @@ GLFWwindow* setupOpenGL(){
         std::cout << "Failed to initialize GLAD" << std::endl;
         return nullptr;
     }
+    GLExtensions::load((GLADloadproc)glfwGetProcAddress);
+    ShaderCompiler::init("resources/shaders/missingShader_vertex.glsl", "resources/shaders/missingShader_fragment.glsl");
 
-    glEnable(GL_DEPTH_TEST);
+    GLState::invalidate();
+    GLState::enable(GL_DEPTH_TEST);
 
     return window;
 }
@@ -291,97 +590,95 @@ void setUpImGui(GLFWwindow* window){
     ImGui_ImplOpenGL3_Init("#version 330");
 }
 
+// The scene file is written in the background; the journal is trimmed once it is on disk
 void saveScene()
 {
-    // save the scene to a file
-    ofstream sceneFile;
-    sceneFile.open("localData/scene.sn");
-    if (sceneFile.is_open())
-    {
-        for (int i = 0; i < sceneModels.size(); i++)
-        {
-            Model *model = sceneModels[i];
-            sceneFile << model->directory << endl;
-            sceneFile << model->instanceCount << endl;
-
-            for (unsigned int j = 0; j < model->instanceCount; j++)
-            {
-
-                sceneFile << model->Hash_ID[j] << endl;
-
-                for (unsigned int k = 0; k < 3; k++)
-                {
-                    sceneFile << model->transforms[j].position[k] << ' ';
-                }
-                sceneFile << endl;
-                for (unsigned int k = 0; k < 3; k++)
-                {
-                    sceneFile << model->transforms[j].rotation[k] << ' ';
-                }
-                sceneFile << endl;
-                for (unsigned int k = 0; k < 3; k++)
-                {
-                    sceneFile << model->transforms[j].scale[k] << ' ';
-                }
-                sceneFile << endl;
-            }
-            
-        }
+    sceneJournal->compact(sceneModels, sceneIndex);
+}
 
-        sceneFile.close();
+bool loadScene()
+{
+    const string scenePath = "localData/scene.sn";
+    std::error_code error;
+    if (!fs::exists(scenePath, error))
+        return false;
+    if (!isBinarySceneFile(scenePath))
+    {
+        // saved before the binary format: the text is kept next to it and converted
+        const string textPath = "localData/scene_text.sn";
+        fs::rename(scenePath, textPath, error);
+        if (error || !convertTextScene(textPath, scenePath, describeTextSceneModel))
+            return false;
+        cout << "Converted text scene, the original is " << textPath << endl;
     }
 
-    /*
-    loop through each model,
-        save the path, number of instances
-        loop though for the number of instances
-            save the name, position, rotation, scale, hash id
-    */
+    vector<SceneTreeNode *> roots;
+    if (!loadSceneFile(scenePath, sceneModels, sceneIndex, roots) || sceneModels.size() < 2 || roots.empty())
+    {
+        for (Model *model : sceneModels)
+            delete model;
+        sceneModels.clear();
+        clearSceneTree(sceneIndex);
+        return false;
+    }
+    sceneRootNode = roots[0];
+    rootNode = sceneRootNode;
+    cout << "Loaded " << sceneIndex.size() << " instances of " << sceneModels.size() << " models from " << scenePath << endl;
+    return true;
 }
 
-void loadScene()
+// Moves the instances of every model after the first two (the scene root's and the light cubes') out of
+// the scene into a streamed world of worldCellSize cells
+void partitionScene()
 {
-    ifstream sceneFile;
-    sceneFile.open("localData/scene.sn");
-
-    if (sceneFile.is_open())
+    vector<Model *> moved(sceneModels.begin() + 2, sceneModels.end());
+    if (moved.empty() || !writeWorld("localData/world", worldCellSize, moved, sceneIndex))
     {
-        string path;
-        sceneFile >> path;
-        unsigned int numInstances;
-        sceneFile >> numInstances;
-
-        for (unsigned int i = 0; i < numInstances; i++)
+        cout << "ERROR::WORLD::PARTITION_FAILED" << endl;
+        return;
+    }
+    selectedNode = nullptr;
+    for (Model *model : moved)
+    {
+        while (model->instanceCount > 0)
         {
-            glm::vec3 position;
-            glm::vec3 rotation;
-            glm::vec3 scale;
-            size_t hashID;
-            sceneFile >> hashID;
-            sceneFile >> position.x >> position.y >> position.z;
-            sceneFile >> rotation.x >> rotation.y >> rotation.z;
-            sceneFile >> scale.x >> scale.y >> scale.z;
-
-
+            size_t id = model->id(model->instanceCount - 1);
+            sceneJournal->recordDelete(id);
+            if (getInstanceInSceneTree(sceneIndex, id) != nullptr)
+                removeInstanceFromSceneTree(sceneIndex, id);
+            else
+                model->removeInstance(model->instanceCount - 1);
         }
-        
+        delete model;
     }
-    /*
-    loop through each model,
-        load the path, number of instances
-        loop though for the number of instances
-            load the name, position, rotation, scale, hash id
-    */
+    sceneModels.resize(2);
+    saveScene();
+    if (worldStreamer->open("localData/world/world.wld"))
+        cout << "Partitioned the scene into " << worldStreamer->stats.cells << " world cells" << endl;
 }
 
-void saveData()
+// Text scenes did not store shaders: the light cube keeps its unlit shader, everything else is lit
+void describeTextSceneModel(SceneModelRecord &record)
 {
-    ofstream saveFile;
-    saveFile.open("localData/saveData.sv");
-    if (saveFile.is_open())
+    if (fs::path(record.path).stem() == "testCube")
     {
-        cout << "save file opened" << endl;
+        record.vertexShader = "resources/shaders/litObject_vertex.glsl";
+        record.fragmentShader = "resources/shaders/litObject_fragment.glsl";
+        record.castsShadows = false;
+        record.isOccluder = false;
+    }
+    else
+    {
+        record.vertexShader = "resources/shaders/objectLighting_vertex.glsl";
+        record.fragmentShader = "resources/shaders/objectLighting_fragment.glsl";
+    }
+}
 
+void saveData()
+{
+    // formatted here, written and synced by the saver
+    std::ostringstream saveFile;
+    {
         saveFile << PanSensitivity << endl;
         saveFile << RotateSensitivity << endl;
         saveFile << ForwardSensitivity << endl;
@@ -419,9 +716,9 @@ void saveData()
 
         saveFile << currentPath << endl;
         saveFile << cameraFOV << endl;
-
-        saveFile.close();
     }
+    std::string text = saveFile.str();
+    sceneSaver->saveBytes("localData/saveData.sv", std::vector<unsigned char>(text.begin(), text.end()));
 }
 
 void loadData()
@@ -586,11 +883,108 @@ void drawAllUI(){
     ImGui::End();
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    // the ImGui backend talks to GL directly
+    GLState::invalidate();
 }
 
 void drawMainUI(){
     ImGui::Begin("OpenGL UI");
     ImGui::Text("FPS: %.1f", deltaTime != 0.0f ? (1.0f / deltaTime) : 0.0f);
+    ImGui::Text("Uniform uploads: %u (avoided %u)", Material::frameStats.uploads, Material::frameStats.avoided);
+    ImGui::Text("GL state calls: %u (skipped %u)", GLState::frameStats.issued, GLState::frameStats.skipped);
+    ImGui::Checkbox("Validate GL state cache", &GLState::debugValidate);
+    if (AllocationCounter::enabled)
+    {
+        ImGui::Text("Heap allocations: %zu last frame (UI excluded)", frameAllocations);
+        ImGui::Checkbox("Report the next allocating frame", &reportFrameAllocations);
+    }
+    ImGui::Text("Frame memory: %zu of %zu KB (peak %zu KB)", FrameAllocator::frame.used() / 1024, FrameAllocator::frame.capacity() / 1024, FrameAllocator::frame.peak / 1024);
+    const char *renderModes[] = {"Forward", "Deferred"};
+    ImGui::Combo("Render mode", &renderMode, renderModes, 2);
+    ImGui::Checkbox("Depth pre-pass (forward)", &depthPrePass);
+    ImGui::Checkbox("Dynamic resolution", &dynamicResolution->enabled);
+    if (dynamicResolution->enabled)
+    {
+        ImGui::SliderFloat("Target frame ms", &dynamicResolution->targetMs, 4.0f, 50.0f);
+        ImGui::SliderFloat("Min scale", &dynamicResolution->minScale, 0.25f, 1.0f);
+        ImGui::Text("Rendering %ux%u (%.0f%%)", dynamicResolution->width, dynamicResolution->height, dynamicResolution->scale * 100.0f);
+    }
+    ImGui::Checkbox("Shadows", &shadowsEnabled);
+    ImGui::SameLine();
+    ImGui::Checkbox("Cache cascades", &shadowCascades->cache);
+    ImGui::SliderFloat("Shadow distance", &shadowCascades->shadowDistance, 10.0f, 100.0f);
+    ImGui::Text("Shadow pass: %u cascades, %u draws", shadowCascades->stats.cascadesRendered, shadowCascades->stats.draws);
+    // occlusion culling tests the frustum first, so it is on whenever occlusion culling is
+    bool frustumShown = frustumCulling || occlusionCulling;
+    ImGui::BeginDisabled(occlusionCulling);
+    if (ImGui::Checkbox("Frustum culling", &frustumShown))
+        frustumCulling = frustumShown;
+    ImGui::EndDisabled();
+    if (occlusionCulling)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(part of occlusion culling)");
+    }
+    ImGui::Text("BVH: %u in frustum of %u instances, depth %u, SAH cost %.1f (built %.1f), %u rebuilds",
+                sceneBVH->inFrustum, sceneBVH->tree().stats.items, sceneBVH->tree().stats.depth,
+                sceneBVH->cost, sceneBVH->tree().stats.builtCost, sceneBVH->rebuilds);
+    ImGui::Text("  refit %u moved in %.3f ms, %u rotations", sceneBVH->tree().stats.refitted,
+                sceneBVH->tree().stats.refitMs, sceneBVH->tree().stats.rotations);
+    if (worldStreamer->isOpen())
+    {
+        const WorldStreamerStats &world = worldStreamer->stats;
+        ImGui::Text("World: %u of %u cells loaded, %u reading, %u waiting, %.2f ms", world.loaded, world.cells, world.reading, world.waiting, world.updateMs);
+        ImGui::Text("  %zu instances of %u models streamed in, %u model loads, %u importing", world.instances, world.models, world.modelLoads, world.importing);
+        ImGui::Text("  %.1f of %.0f MB (estimated)", world.bytes / (1024.0 * 1024.0), worldStreamer->memoryBudget / (1024.0 * 1024.0));
+        ImGui::SliderFloat("Stream radius", &worldStreamer->loadRadius, 10.0f, 500.0f);
+        ImGui::SliderFloat("Unload radius", &worldStreamer->unloadRadius, 10.0f, 600.0f);
+        worldStreamer->unloadRadius = std::max(worldStreamer->unloadRadius, worldStreamer->loadRadius);
+    }
+    else
+    {
+        // only once: the world files then hold the only copy of those instances
+        ImGui::SliderFloat("World cell size", &worldCellSize, 5.0f, 200.0f);
+        if (ImGui::Button("Partition scene into cells"))
+            partitionScene();
+    }
+    if (ImGui::TreeNode("Job workers"))
+    {
+        for (unsigned int i = 0; i < jobSystem->workerCount(); i++)
+        {
+            const JobWorkerStats &worker = jobSystem->stats[i];
+            ImGui::ProgressBar(worker.utilization, ImVec2(200.0f, 0.0f), FrameAllocator::frame.format("%u jobs, %u stolen", worker.jobs, worker.steals));
+            ImGui::SameLine();
+            if (i == 0)
+                ImGui::Text("main thread");
+            else
+                ImGui::Text("worker %u", i);
+        }
+        ImGui::TreePop();
+    }
+    ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+    if (occlusionCulling)
+        ImGui::Text("Occlusion: %u occluders (%u tris), %u of %u culled (%u frustum), %.2f ms on %u threads",
+                    occlusionCuller->stats.occluders, occlusionCuller->stats.triangles,
+                    occlusionCuller->stats.occluded + occlusionCuller->stats.frustumCulled, occlusionCuller->stats.tested,
+                    occlusionCuller->stats.frustumCulled, occlusionCuller->stats.rasterMs, jobSystem->workerCount());
+    if (gpuCuller != nullptr)
+    {
+        ImGui::Checkbox("GPU instance culling", &gpuCulling);
+        ImGui::SameLine();
+        ImGui::Checkbox("Validate against CPU", &gpuCuller->validate);
+        if (gpuCulling)
+            ImGui::Text("GPU culling: %u instances in %u dispatches", gpuCuller->stats.instances, gpuCuller->stats.dispatches);
+        if (gpuCulling && gpuCuller->validate)
+            ImGui::Text("  %u visible, %u differ from the CPU test", gpuCuller->stats.visible, gpuCuller->stats.mismatches);
+    }
+    else
+        ImGui::Text("GPU instance culling needs GL 4.3");
+    for (const GPUTimers::Timer *timer : GPUTimers::active())
+        ImGui::Text("%s: %.2f ms GPU, %.2f ms CPU", timer->name.c_str(), timer->gpuMs, timer->cpuMs);
+    ImGui::Text("Shaders compiling: %zu (%s)", ShaderCompiler::pendingCount(), GLExtensions::parallelShaderCompile ? "parallel" : "deferred");
+    ImGui::Checkbox("Batch materials of models loaded next", &Model::useTextureArrays);
+    ImGui::SameLine();
+    ImGui::Text("(%zu array pages, %s)", TextureArrayPool::pageCount(), GLExtensions::bindlessTexture ? "bindless" : "texture arrays");
 
     ImGui::SliderFloat("RotateSensitivity", &RotateSensitivity, 0.1f, 5.0f);
     ImGui::SliderFloat("PanSensitivity", &PanSensitivity, 0.1f, 5.0f);
@@ -598,6 +992,7 @@ void drawMainUI(){
     ImGui::SliderFloat("CameraFOV", &cameraFOV, 45.0f, 120.0f);
 
     ImGui::ColorEdit3("SkyColor", skyColor);
+    ImGui::DragFloat3("DirLightDirection", dirLightDirection, 0.01f, -1.0f, 1.0f);
     ImGui::ColorEdit3("DirLightDiffuseColor", dirLightDiffuseColor);
     ImGui::ColorEdit3("DirLightAmbientColor", dirLightAmbientColor);
     ImGui::ColorEdit3("DirLightSpecularColor", dirLightSpecularColor);
@@ -617,38 +1012,97 @@ void drawMainUI(){
     ImGui::ColorEdit3("LightSpecularColor", lightSpecularColor);
     ImGui::DragFloat("light linear", &lightLinear, 0.01, 0.01);
     ImGui::DragFloat("light quadratic", &lightQuatratic, 0.005, 0.05);
+    ImGui::Checkbox("Flashlight", &spotLightEnabled);
+    ImGui::Checkbox("Clustered lighting", &clusteredLighting);
+    ImGui::SliderInt("Extra point lights", &extraLightCount, 0, 4096);
+    if (!clusteredLighting)
+        ImGui::Text("Light lists: %u of %u lights visible, %u assigned, longest %u", lightCulling->stats.visible, lightCulling->stats.lights, lightCulling->stats.assigned, lightCulling->stats.longestList);
+    if (clusteredLighting)
+        ImGui::Text("Clusters: %u lights, %u indices, max %u per cluster, %.2f ms on %u threads", lightClusters->stats.lights, lightClusters->stats.indices, lightClusters->stats.maxPerCluster, lightClusters->stats.binMs, jobSystem->workerCount());
 }
 
 void drawSceneTree(){
     ImGui::Begin("Scene Tree");
 
-    static SceneTreeNode *selectedNode = nullptr;
+    static char searchName[128] = "";
+    if (ImGui::InputText("Find by name", searchName, sizeof(searchName), ImGuiInputTextFlags_EnterReturnsTrue))
+    {
+        SceneTreeNode *found = getInstanceInSceneTreeByName(sceneIndex, searchName);
+        if (found != nullptr)
+            selectedNode = found;
+    }
+    ImGui::Text("%zu instances indexed, last pick %.3f ms", sceneIndex.size(), pickMs);
+    ImGui::Text("%zu scene nodes, %zu pooled", sceneTreeNodes.size(), sceneTreeNodes.capacity());
+    ImGui::Text("Journal: %zu KB, %zu edits, %zu compactions%s", sceneJournal->size() / 1024, sceneJournal->stats.records,
+                sceneJournal->stats.compactions, sceneJournal->compacting() ? " (writing)" : "");
+    if (ImGui::Button("Save scene"))
+        saveScene();
+    if (sceneSaver->busy())
+    {
+        ImGui::SameLine();
+        ImGui::ProgressBar(sceneSaver->progress(), ImVec2(-1.0f, 0.0f), sceneSaver->phase());
+    }
+    ImGui::Text("Last save: %.2f ms capture, %.1f ms encode and write", sceneSaver->captureMs, sceneJournal->stats.lastCompactMs);
     drawSceneTreeHierarchical(rootNode, selectedNode);
 
     if (selectedNode)
     {
         ImGui::Separator();
-        ImGui::Text("Selected Model: %s", selectedNode->NodeModel->names[selectedNode->instanceCount].c_str());
-        ImGui::DragFloat3("Position", glm::value_ptr(selectedNode->NodeModel->transforms[selectedNode->instanceCount].position), 0.1f);
-        ImGui::DragFloat3("Rotation", glm::value_ptr(selectedNode->NodeModel->transforms[selectedNode->instanceCount].rotation), 1.0f);
-        ImGui::DragFloat3("Scale", glm::value_ptr(selectedNode->NodeModel->transforms[selectedNode->instanceCount].scale), 0.1f, 0.1f, 10.0f);
+        ImGui::Text("Selected Model: %s", selectedNode->NodeModel->name(selectedNode->instance()).c_str());
+        Transform &transform = selectedNode->NodeModel->transform(selectedNode->instance());
+        bool edited = ImGui::DragFloat3("Position", glm::value_ptr(transform.position), 0.1f);
+        edited |= ImGui::DragFloat3("Rotation", glm::value_ptr(transform.rotation), 1.0f);
+        edited |= ImGui::DragFloat3("Scale", glm::value_ptr(transform.scale), 0.1f, 0.1f, 10.0f);
+        if (edited)
+            sceneJournal->recordTransform(selectedNode->NodeModel->id(selectedNode->instance()), transform);
+        // the root holds the hierarchy together, everything else can go (its children move up a level)
+        if (selectedNode != rootNode && ImGui::Button("Delete instance"))
+        {
+            size_t id = selectedNode->NodeModel->id(selectedNode->instance());
+            selectedNode = nullptr;
+            sceneJournal->recordDelete(id);
+            removeInstanceFromSceneTree(sceneIndex, id);
+        }
     }
 
     ImGui::End();
 }
 
+void pickInstance(GLFWwindow *window, const glm::mat4 &projection)
+{
+    double x, y;
+    int width, height;
+    glfwGetCursorPos(window, &x, &y);
+    glfwGetWindowSize(window, &width, &height); // cursor positions are in window units, not framebuffer pixels
+    if (width == 0 || height == 0)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    glm::vec3 origin, direction;
+    camera.ScreenRay((float)x, (float)y, (float)width, (float)height, projection, origin, direction);
+    float distance;
+    int item = sceneBVH->raycast(origin, direction, distance);
+    pickMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (item < 0)
+        return;
+    const SceneItem &hit = (*sceneBVH)[item];
+    SceneTreeNode *node = getInstanceInSceneTree(sceneIndex, hit.model->id(hit.instance));
+    if (node != nullptr)
+        selectedNode = node;
+}
+
 void drawSceneTreeHierarchical(SceneTreeNode* node, SceneTreeNode*& selectedNode)
 {
     if (!node || !node->NodeModel)
         return;
 
     // label for this node
-    std::string label = node->NodeModel->names[node->instanceCount];
+    const std::string &label = node->NodeModel->name(node->instance());
 
     // is this node selected?
     ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow |
                                ImGuiTreeNodeFlags_OpenOnDoubleClick |
-                               (node->childrenInstances.empty() ? ImGuiTreeNodeFlags_Leaf : 0) |
+                               (node->firstChild == nullptr ? ImGuiTreeNodeFlags_Leaf : 0) |
                                ((selectedNode == node) ? ImGuiTreeNodeFlags_Selected : 0);
 
     bool open = ImGui::TreeNodeEx((void*)node, flags, "%s", label.c_str());
@@ -660,7 +1114,7 @@ void drawSceneTreeHierarchical(SceneTreeNode* node, SceneTreeNode*& selectedNode
     // draw children recursively
     if (open)
     {
-        for (SceneTreeNode* child : node->childrenInstances)
+        for (SceneTreeNode* child = node->firstChild; child != nullptr; child = child->nextSibling)
             drawSceneTreeHierarchical(child, selectedNode);
 
         ImGui::TreePop();
@@ -714,10 +1168,10 @@ void ShowFileBrowser()
                 alreadyLoaded = true;
                 cout << "Model already loaded: " << model->directory << endl;
                 int index = model->addInstance(camera.Position + camera.Front * 2.0f, glm::vec3(-90.0f, 0.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f), selectedFile);
-                sceneNode = insertInstanceToSceneTree(rootNode, model, index);
-                cout << "Inserted model with Hash ID: " << sceneNode->NodeModel->Hash_ID[index] << endl;
-                sceneRootNode->childrenInstances.push_back(sceneNode);
-                sceneNode->parentNode = sceneRootNode;
+                sceneNode = insertInstanceToSceneTree(sceneIndex, sceneRootNode, model, index);
+                if (sceneNode != nullptr)
+                    sceneJournal->recordSpawn(model, index, sceneRootNode->NodeModel->id(sceneRootNode->instance()));
+                cout << "Inserted model with Hash ID: " << model->id(index) << endl;
                 break;
             }
         }
@@ -727,21 +1181,21 @@ void ShowFileBrowser()
         if (!alreadyLoaded){
             cout << "Loading model from: " << (currentPath / selectedFile).string() << endl;
             Model *newModel = new Model((currentPath / selectedFile).string().c_str(), vertex.c_str(), fragment.c_str(), selectedFile);
-            newModel->transforms[0].position = camera.Position + camera.Front * 2.0f;
-            newModel->transforms[0].scale = glm::vec3(0.2f, 0.2f, 0.2f);
-            newModel->transforms[0].rotation = glm::vec3(-90.0f, 0.0f, 0.0f);
-
-            sceneNode = insertInstanceToSceneTree(rootNode, newModel, 0);
-            cout << "Inserted model with Hash ID: " << sceneNode->NodeModel->Hash_ID[0] << endl;
-            sceneRootNode->childrenInstances.push_back(sceneNode);
+            newModel->transform(0).position = camera.Position + camera.Front * 2.0f;
+            newModel->transform(0).scale = glm::vec3(0.2f, 0.2f, 0.2f);
+            newModel->transform(0).rotation = glm::vec3(-90.0f, 0.0f, 0.0f);
+
+            sceneNode = insertInstanceToSceneTree(sceneIndex, sceneRootNode, newModel, 0);
+            if (sceneNode != nullptr)
+                sceneJournal->recordSpawn(newModel, 0, sceneRootNode->NodeModel->id(sceneRootNode->instance()));
+            cout << "Inserted model with Hash ID: " << newModel->id(0) << endl;
             sceneModels.push_back(newModel);
-            sceneNode->parentNode = sceneRootNode;
         }
         
     }
 
     if (ImGui::Button("reload shaders")){
-        for (Model* model : sceneModels) {
+        for (Model* model : drawModels) {
             model->reloadShader();
         }
     }
@@ -0,0 +1,70 @@
+#version 330 core
+out vec4 FragColor;
+
+// filled from the G-buffer per pixel, lighting.glsl reads material.shininess
+struct Material {
+    float shininess;
+};
+Material material;
+
+in vec2 TexCoords;
+
+uniform sampler2D gAlbedoSpec; // rgb albedo, a specular intensity
+uniform sampler2D gNormal;     // xyz world normal, w shininess
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec3 viewPos;
+uniform mat4 view;
+
+#include "include/lighting.glsl"
+
+uniform DirLight dirLight;
+#ifdef USE_SPOTLIGHT
+uniform SpotLight spotLight;
+#endif
+#ifdef USE_LIGHT_LISTS
+#include "include/lightLists.glsl"
+#endif
+#ifdef USE_CLUSTERED
+#include "include/clusteredLights.glsl"
+#endif
+#ifdef USE_SHADOWS
+#include "include/shadows.glsl"
+#endif
+
+void main()
+{
+    float depth = texture(gDepth, TexCoords).r;
+    if (depth == 1.0)
+        discard;
+
+    vec4 clip = vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 FragPos = world.xyz / world.w;
+
+    vec4 albedoSpec = texture(gAlbedoSpec, TexCoords);
+    vec4 normalShininess = texture(gNormal, TexCoords);
+    surfaceDiffuse = albedoSpec.rgb;
+    surfaceSpecular = vec3(albedoSpec.a);
+    material.shininess = normalShininess.w;
+    vec3 norm = normalize(normalShininess.xyz);
+    vec3 viewDir = normalize(viewPos - FragPos);
+
+#ifdef USE_SHADOWS
+    dirLightVisibility = CalcDirShadow(FragPos, norm);
+#endif
+    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+
+#ifdef USE_LIGHT_LISTS
+    result += CalcVisibleLights(norm, FragPos, viewDir);
+#endif
+#ifdef USE_CLUSTERED
+    result += CalcClusteredLights(norm, FragPos, viewDir);
+#endif
+
+#ifdef USE_SPOTLIGHT
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+// depth pre-pass: positions only, fed from the meshes' position stream
+layout (location = 0) in vec3 aPos;
+
+#include "include/transform.glsl"
+
+void main()
+{
+    gl_Position = transformPosition(aPos);
+}
@@ -0,0 +1,31 @@
+// Clustered point lights, filled by LightClusters on the CPU every frame.
+// The fragment finds its cluster from its screen tile and view depth and only evaluates the
+// lights binned there. Include after lighting.glsl; expects the camera's uniform mat4 view.
+
+#include "pointLightData.glsl"
+
+uniform samplerBuffer clusterLightData;
+uniform usamplerBuffer clusterGrid;      // (offset, count) into clusterIndices per cluster
+uniform usamplerBuffer clusterIndices;
+uniform vec3 clusterGridSize;
+uniform vec2 clusterTileSize;            // in pixels
+uniform float clusterScale;
+uniform float clusterBias;
+
+vec3 CalcClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    ivec3 gridSize = ivec3(clusterGridSize);
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * clusterScale - clusterBias), 0, gridSize.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), gridSize.xy - 1);
+    int cluster = tile.x + gridSize.x * (tile.y + gridSize.y * slice);
+
+    uvec2 range = texelFetch(clusterGrid, cluster).xy;
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        result += CalcPointLight(fetchPointLight(clusterLightData, index), normal, fragPos, viewDir);
+    }
+    return result;
+}
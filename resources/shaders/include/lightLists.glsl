@@ -0,0 +1,36 @@
+// Range-culled point lights, filled by LightCulling. lightListData holds the lights that touch
+// the view frustum; each draw gets objectLights, the indices of the few that reach its bounds.
+// Include after lighting.glsl.
+
+#ifndef MAX_OBJECT_LIGHTS
+#define MAX_OBJECT_LIGHTS 8
+#endif
+
+#include "pointLightData.glsl"
+
+uniform samplerBuffer lightListData;
+uniform int visibleLightCount;
+uniform int objectLightCount;
+uniform int objectLights[MAX_OBJECT_LIGHTS];
+
+// the lights of the current draw
+vec3 CalcObjectLights(vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < MAX_OBJECT_LIGHTS; i++)
+    {
+        if (i >= objectLightCount)
+            break;
+        result += CalcPointLight(fetchPointLight(lightListData, objectLights[i]), normal, fragPos, viewDir);
+    }
+    return result;
+}
+
+// every light in the frustum, for fullscreen passes that cover all objects at once
+vec3 CalcVisibleLights(vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < visibleLightCount; i++)
+        result += CalcPointLight(fetchPointLight(lightListData, i), normal, fragPos, viewDir);
+    return result;
+}
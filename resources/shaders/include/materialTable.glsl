@@ -0,0 +1,48 @@
+// Per-material texture lookup for the batched path, where one draw covers many materials.
+// USE_BINDLESS: the material table is an SSBO holding bindless handles of the array pages.
+// Otherwise: the table is a texture buffer of layer indices and the three pages are bound.
+// layers = (diffuse, specular, normal, unused), -1 where the material has no such texture.
+
+#ifdef USE_BINDLESS
+struct MaterialEntry {
+    uvec2 diffusePage;
+    uvec2 specularPage;
+    uvec2 normalPage;
+    uvec2 unused;
+    ivec4 layers;
+};
+
+layout(std430, binding = 0) readonly buffer MaterialTable {
+    MaterialEntry materials[];
+};
+
+vec4 sampleMaterial(uvec2 page, int layer)
+{
+    if (layer < 0)
+        return vec4(0.0);
+    return texture(sampler2DArray(page), vec3(TexCoords, float(layer)));
+}
+
+vec3 materialDiffuse()  { return sampleMaterial(materials[MaterialIndex].diffusePage, materials[MaterialIndex].layers.x).rgb; }
+vec3 materialSpecular() { return sampleMaterial(materials[MaterialIndex].specularPage, materials[MaterialIndex].layers.y).rgb; }
+bool materialHasNormal() { return materials[MaterialIndex].layers.z >= 0; }
+vec3 materialNormal()   { return sampleMaterial(materials[MaterialIndex].normalPage, materials[MaterialIndex].layers.z).rgb; }
+#else
+uniform isamplerBuffer materialTable;
+uniform sampler2DArray diffusePages;
+uniform sampler2DArray specularPages;
+uniform sampler2DArray normalPages;
+
+vec4 sampleMaterial(sampler2DArray pages, int layer)
+{
+    if (layer < 0)
+        return vec4(0.0);
+    return texture(pages, vec3(TexCoords, float(layer)));
+}
+
+ivec4 materialLayers() { return texelFetch(materialTable, MaterialIndex); }
+vec3 materialDiffuse()  { return sampleMaterial(diffusePages, materialLayers().x).rgb; }
+vec3 materialSpecular() { return sampleMaterial(specularPages, materialLayers().y).rgb; }
+bool materialHasNormal() { return materialLayers().z >= 0; }
+vec3 materialNormal()   { return sampleMaterial(normalPages, materialLayers().z).rgb; }
+#endif
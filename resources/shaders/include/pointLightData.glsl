@@ -0,0 +1,21 @@
+// Point lights packed 4 texels each into a texture buffer by LightClusters and LightCulling:
+// (position, radius), (ambient, constant), (diffuse, linear), (specular, quadratic).
+// Include after lighting.glsl.
+
+PointLight fetchPointLight(samplerBuffer data, int index)
+{
+    vec4 positionRadius = texelFetch(data, index * 4);
+    vec4 ambientConstant = texelFetch(data, index * 4 + 1);
+    vec4 diffuseLinear = texelFetch(data, index * 4 + 2);
+    vec4 specularQuadratic = texelFetch(data, index * 4 + 3);
+
+    PointLight light;
+    light.position = positionRadius.xyz;
+    light.ambient = ambientConstant.rgb;
+    light.diffuse = diffuseLinear.rgb;
+    light.specular = specularQuadratic.rgb;
+    light.constant = ambientConstant.w;
+    light.linear = diffuseLinear.w;
+    light.quadratic = specularQuadratic.w;
+    return light;
+}
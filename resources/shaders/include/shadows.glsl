@@ -0,0 +1,36 @@
+// Cascaded shadow lookup for the directional light, filled by ShadowCascades.
+// Expects the camera's uniform mat4 view to be declared by the including shader.
+
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 cascadeMatrices[4];
+uniform vec4 cascadeSplits; // view distance each cascade reaches
+
+// 0 fully shadowed, 1 lit
+float CalcDirShadow(vec3 fragPos, vec3 normal)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    if (depth > cascadeSplits.w)
+        return 1.0;
+    int cascade = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (depth > cascadeSplits[i])
+            cascade = i + 1;
+    }
+
+    // push the lookup off the surface, further in the coarser cascades, against acne
+    vec3 offsetPos = fragPos + normal * 0.02 * float(cascade + 1);
+    vec4 lightClip = cascadeMatrices[cascade] * vec4(offsetPos, 1.0);
+    vec3 coords = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+    coords.z = min(coords.z, 1.0);
+
+    // 3x3 taps on top of the hardware 2x2 compare filter
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float visibility = 0.0;
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+            visibility += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+    }
+    return visibility / 9.0;
+}
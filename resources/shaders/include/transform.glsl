@@ -0,0 +1,20 @@
+// Model matrix source: a per-instance vertex attribute when USE_INSTANCING is defined,
+// otherwise the usual "model" uniform.
+#ifdef USE_INSTANCING
+layout (location = 7) in mat4 aInstanceModel;
+#define MODEL_MATRIX aInstanceModel
+#else
+uniform mat4 model;
+#define MODEL_MATRIX model
+#endif
+uniform mat4 view;
+uniform mat4 projection;
+
+// Every program computes clip space through here, so the depth pre-pass and the shading pass
+// write bit-identical depth, which GL_EQUAL testing relies on.
+invariant gl_Position;
+
+vec4 transformPosition(vec3 position)
+{
+    return projection * (view * (MODEL_MATRIX * vec4(position, 1.0)));
+}
@@ -0,0 +1,115 @@
+#version 430 core
+// GPU instance culling (GPUCuller): one invocation per instance runs the frustum and Hi-Z test of
+// OcclusionCuller::classify, visible instances are appended to the instance buffer and counted into
+// every indirect command of the model
+layout(local_size_x = 64) in;
+
+// DrawElementsIndirectCommand, same layout as MeshBatch::IndirectCommand
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// binding 0 is the bindless material table
+layout(std430, binding = 1) readonly buffer Instances { mat4 instances[]; };
+layout(std430, binding = 2) writeonly buffer VisibleInstances { mat4 visibleInstances[]; };
+layout(std430, binding = 3) buffer Commands { DrawCommand commands[]; };
+layout(std430, binding = 4) writeonly buffer Results { uint results[]; }; // OcclusionCuller::Result per instance
+
+uniform mat4 viewProjection;
+uniform vec3 boundsMin; // model space box shared by every instance
+uniform vec3 boundsMax;
+uniform uint instanceCount;
+uniform uint commandCount;
+uniform sampler2D hiZ; // max-depth pyramid, one mip per level
+uniform int hiZLevels;
+
+const uint VISIBLE = 0u;
+const uint OUTSIDE_FRUSTUM = 1u;
+const uint OCCLUDED = 2u;
+
+vec3 corner(vec3 low, vec3 high, int index)
+{
+    return vec3((index & 1) != 0 ? high.x : low.x, (index & 2) != 0 ? high.y : low.y, (index & 4) != 0 ? high.z : low.z);
+}
+
+uint classify(mat4 model)
+{
+    if (boundsMin.x > boundsMax.x)
+        return VISIBLE;
+
+    // world space box of the instance, like Model::instanceBounds
+    vec3 worldMin = vec3(1e30);
+    vec3 worldMax = vec3(-1e30);
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 world = vec3(model * vec4(corner(boundsMin, boundsMax, i), 1.0));
+        worldMin = min(worldMin, world);
+        worldMax = max(worldMax, world);
+    }
+
+    vec4 clip[8];
+    for (int i = 0; i < 8; i++)
+        clip[i] = viewProjection * vec4(corner(worldMin, worldMax, i), 1.0);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bool above = true, below = true;
+        for (int i = 0; i < 8; i++)
+        {
+            above = above && clip[i][axis] > clip[i].w;
+            below = below && clip[i][axis] < -clip[i].w;
+        }
+        if (above || below)
+            return OUTSIDE_FRUSTUM;
+    }
+
+    vec3 ndcMin = vec3(1e30);
+    vec3 ndcMax = vec3(-1e30);
+    for (int i = 0; i < 8; i++)
+    {
+        if (clip[i].w <= 1e-5)
+            return VISIBLE;
+        vec3 ndc = clip[i].xyz / clip[i].w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    float nearest = ndcMin.z * 0.5 + 0.5;
+
+    ivec2 size = textureSize(hiZ, 0);
+    ivec2 low = max(ivec2(floor((ndcMin.xy * 0.5 + 0.5) * vec2(size))), ivec2(0));
+    ivec2 high = min(ivec2(floor((ndcMax.xy * 0.5 + 0.5) * vec2(size))), size - 1);
+
+    int level = 0;
+    while (level + 1 < hiZLevels && ((high.x >> level) - (low.x >> level) > 1 || (high.y >> level) - (low.y >> level) > 1))
+        level++;
+    ivec2 levelSize = textureSize(hiZ, level);
+    float farthest = 0.0;
+    for (int y = min(low.y >> level, levelSize.y - 1); y <= min(high.y >> level, levelSize.y - 1); y++)
+    {
+        for (int x = min(low.x >> level, levelSize.x - 1); x <= min(high.x >> level, levelSize.x - 1); x++)
+            farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+    }
+    return nearest > farthest ? OCCLUDED : VISIBLE;
+}
+
+void main()
+{
+    uint instance = gl_GlobalInvocationID.x;
+    if (instance >= instanceCount)
+        return;
+
+    uint result = classify(instances[instance]);
+    results[instance] = result;
+    if (result != VISIBLE)
+        return;
+
+    // the first command hands out the slot, the others only need the same total
+    uint slot = atomicAdd(commands[0].instanceCount, 1u);
+    for (uint i = 1u; i < commandCount; i++)
+        atomicAdd(commands[i].instanceCount, 1u);
+    visibleInstances[slot] = instances[instance];
+}
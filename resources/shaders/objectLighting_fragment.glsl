@@ -1,140 +1,98 @@
 #version 330 core
+// the bindless permutation overrides GLSL_VERSION, SSBOs need 430
+#ifdef USE_BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
+#ifdef GBUFFER_PASS
+// deferred geometry pass, see DeferredRenderer
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec4 gNormal;
+#else
 out vec4 FragColor;
-
-#define NR_POINT_LIGHTS 4
+#endif
 
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_diffuse2;
     sampler2D texture_specular1;
     sampler2D texture_specular2;  
+#ifdef USE_NORMAL_MAP
+    sampler2D texture_normal1;
+#endif
     float shininess;
 }; 
 
-struct SpotLight{
-    vec3 position;  
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-	
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct PointLight {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-};
-
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
+#if defined(USE_NORMAL_MAP) || defined(USE_TEXTURE_ARRAY)
+in mat3 TBN;
+#endif
+#ifdef USE_TEXTURE_ARRAY
+flat in int MaterialIndex;
+#include "include/materialTable.glsl"
+#endif
   
 uniform vec3 viewPos;
+uniform mat4 view;
 uniform Material material;
+
+#include "include/lighting.glsl"
+
 uniform DirLight dirLight;
+#ifdef USE_SPOTLIGHT
 uniform SpotLight spotLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+#endif
+#ifdef USE_LIGHT_LISTS
+#include "include/lightLists.glsl"
+#endif
+#ifdef USE_CLUSTERED
+#include "include/clusteredLights.glsl"
+#endif
+#ifdef USE_SHADOWS
+#include "include/shadows.glsl"
+#endif
 
 void main()
 {
+#ifdef USE_TEXTURE_ARRAY
+    surfaceDiffuse = materialDiffuse();
+    surfaceSpecular = materialSpecular();
+    vec3 norm = normalize(Normal);
+    if (materialHasNormal())
+        norm = normalize(TBN * (materialNormal() * 2.0 - 1.0));
+#else
+    surfaceDiffuse = vec3(texture(material.texture_diffuse1, TexCoords));
+    surfaceSpecular = vec3(texture(material.texture_specular1, TexCoords));
+#ifdef USE_NORMAL_MAP
+    vec3 norm = texture(material.texture_normal1, TexCoords).rgb * 2.0 - 1.0;
+    norm = normalize(TBN * norm);
+#else
     vec3 norm = normalize(Normal);
+#endif
+#endif
+#ifdef GBUFFER_PASS
+    gAlbedoSpec = vec4(surfaceDiffuse, surfaceSpecular.r);
+    gNormal = vec4(norm, material.shininess);
+#else
     vec3 viewDir = normalize(viewPos - FragPos);
 
+#ifdef USE_SHADOWS
+    dirLightVisibility = CalcDirShadow(FragPos, norm);
+#endif
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
 
-    for(int i = 0; i < NR_POINT_LIGHTS; i++){
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
-    }
+#ifdef USE_LIGHT_LISTS
+    result += CalcObjectLights(norm, FragPos, viewDir);
+#endif
+#ifdef USE_CLUSTERED
+    result += CalcClusteredLights(norm, FragPos, viewDir);
+#endif
 
-    //result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+#ifdef USE_SPOTLIGHT
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+#endif
 
     FragColor = vec4(result, 1.0);
+#endif
 } 
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-
-    float diff = max(dot(normal, lightDir), 0.0);
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    return (ambient + diffuse + specular);
-}
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
-
-// calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
-    // spotlight intensity
-    float theta = dot(lightDir, normalize(-light.direction)); 
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
-    return (ambient + diffuse + specular);
-}
\ No newline at end of file
@@ -2,20 +2,36 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#if defined(USE_NORMAL_MAP) || defined(USE_TEXTURE_ARRAY)
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+#endif
+#ifdef USE_TEXTURE_ARRAY
+layout (location = 11) in int aMaterial;
+flat out int MaterialIndex;
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+#if defined(USE_NORMAL_MAP) || defined(USE_TEXTURE_ARRAY)
+out mat3 TBN;
+#endif
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/transform.glsl"
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    mat3 normalMatrix = mat3(transpose(inverse(MODEL_MATRIX)));
+    FragPos = vec3(MODEL_MATRIX * vec4(aPos, 1.0));
+    Normal = normalMatrix * aNormal;  
     TexCoords = aTexCoords;
+#if defined(USE_NORMAL_MAP) || defined(USE_TEXTURE_ARRAY)
+    TBN = mat3(normalize(normalMatrix * aTangent), normalize(normalMatrix * aBitangent), normalize(Normal));
+#endif
+#ifdef USE_TEXTURE_ARRAY
+    MaterialIndex = aMaterial;
+#endif
     
-    gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = transformPosition(aPos);
+}